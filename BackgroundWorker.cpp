@@ -0,0 +1,89 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "BackgroundWorker.h"
+
+namespace CDMi {
+
+BackgroundWorker::BackgroundWorker()
+    : _lock()
+    , _signal()
+    , _jobs()
+    , _thread()
+    , _running(false)
+{
+}
+
+BackgroundWorker::~BackgroundWorker()
+{
+    Stop();
+}
+
+void BackgroundWorker::Submit(const Job& job)
+{
+    std::unique_lock<std::mutex> lock(_lock);
+
+    if (_running == false) {
+        _running = true;
+        _thread = std::thread(&BackgroundWorker::Process, this);
+    }
+
+    _jobs.push_back(job);
+    _signal.notify_all();
+}
+
+void BackgroundWorker::Stop()
+{
+    std::unique_lock<std::mutex> lock(_lock);
+
+    _running = false;
+    _jobs.clear();
+    _signal.notify_all();
+
+    if (_thread.joinable() == true) {
+        std::thread thread(std::move(_thread));
+        lock.unlock();
+
+        // A job that is executing right now is allowed to finish.
+        thread.join();
+    }
+}
+
+void BackgroundWorker::Process()
+{
+    std::unique_lock<std::mutex> lock(_lock);
+
+    // A thread that is being stopped must not pick up jobs submitted to its
+    // successor.
+    while ((_running == true) && (_thread.get_id() == std::this_thread::get_id())) {
+        if (_jobs.empty() == true) {
+            _signal.wait(lock);
+        } else {
+            Job job(_jobs.front());
+            _jobs.pop_front();
+
+            lock.unlock();
+            job();
+            lock.lock();
+        }
+    }
+}
+
+} // namespace CDMi
@@ -0,0 +1,59 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace CDMi {
+
+// Single thread executing jobs in submission order. Used for work that must
+// not run on the OCDM call path (e.g. binding decrypt contexts ahead of use).
+// The thread is started on the first Submit() and joined in Stop(); jobs that
+// have not started by then are dropped.
+class BackgroundWorker {
+public:
+    typedef std::function<void()> Job;
+
+    BackgroundWorker(const BackgroundWorker&) = delete;
+    BackgroundWorker& operator=(const BackgroundWorker&) = delete;
+
+    BackgroundWorker();
+    ~BackgroundWorker();
+
+    void Submit(const Job& job);
+    void Stop();
+
+private:
+    void Process();
+
+private:
+    std::mutex _lock;
+    std::condition_variable _signal;
+    std::deque<Job> _jobs;
+    std::thread _thread;
+    bool _running;
+};
+
+} // namespace CDMi
@@ -0,0 +1,232 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "CallbackDispatcher.h"
+
+namespace CDMi {
+
+CallbackDispatcher::CallbackDispatcher(const uint32_t capacity)
+    : _capacity(capacity)
+    , _lock()
+    , _signal()
+    , _events()
+    , _lastProperties()
+    , _delivering(nullptr)
+    , _thread()
+    , _running(false)
+{
+}
+
+CallbackDispatcher::~CallbackDispatcher()
+{
+    Stop();
+}
+
+void CallbackDispatcher::Properties(IMediaKeySessionCallback* callback, const std::shared_ptr<const std::string>& properties)
+{
+    {
+        std::unique_lock<std::mutex> lock(_lock);
+
+        std::map<IMediaKeySessionCallback*, std::shared_ptr<const std::string> >::iterator index = _lastProperties.find(callback);
+        if (index != _lastProperties.end()) {
+            if ((index->second == properties) || (*(index->second) == *properties)) {
+                return;
+            }
+            index->second = properties;
+        } else {
+            _lastProperties.insert(std::make_pair(callback, properties));
+        }
+    }
+
+    Event event;
+    event.type = EVENT_PROPERTIES;
+    event.callback = callback;
+    event.keyIdLength = 0;
+    event.properties = properties;
+    event.error = 0;
+    event.sysError = CDMi_SUCCESS;
+    Post(event);
+}
+
+void CallbackDispatcher::KeyStatusesUpdate(IMediaKeySessionCallback* callback, const char status[], const std::vector<uint8_t>& keyIds, const uint8_t keyIdLength)
+{
+    Event event;
+    event.type = EVENT_KEY_STATUSES_UPDATE;
+    event.callback = callback;
+    event.text = status;
+    event.keyIds = keyIds;
+    event.keyIdLength = keyIdLength;
+    event.error = 0;
+    event.sysError = CDMi_SUCCESS;
+    Post(event);
+}
+
+void CallbackDispatcher::KeyStatusesUpdated(IMediaKeySessionCallback* callback)
+{
+    Event event;
+    event.type = EVENT_KEY_STATUSES_UPDATED;
+    event.callback = callback;
+    event.keyIdLength = 0;
+    event.error = 0;
+    event.sysError = CDMi_SUCCESS;
+    Post(event);
+}
+
+void CallbackDispatcher::Error(IMediaKeySessionCallback* callback, const int16_t error, const CDMi_RESULT sysError, const char message[])
+{
+    Event event;
+    event.type = EVENT_ERROR;
+    event.callback = callback;
+    event.keyIdLength = 0;
+    event.text = message;
+    event.error = error;
+    event.sysError = sysError;
+    Post(event);
+}
+
+void CallbackDispatcher::Revoke(IMediaKeySessionCallback* callback)
+{
+    std::unique_lock<std::mutex> lock(_lock);
+
+    for (std::deque<Event>::iterator index = _events.begin(); index != _events.end();) {
+        if (index->callback == callback) {
+            index = _events.erase(index);
+        } else {
+            ++index;
+        }
+    }
+    _lastProperties.erase(callback);
+    _signal.notify_all();
+
+    // A callback revoking itself from within a delivery can not wait for it.
+    if (std::this_thread::get_id() != _thread.get_id()) {
+        while (_delivering == callback) {
+            _signal.wait(lock);
+        }
+    }
+}
+
+void CallbackDispatcher::Stop()
+{
+    std::unique_lock<std::mutex> lock(_lock);
+
+    _running = false;
+    _events.clear();
+    _lastProperties.clear();
+    _signal.notify_all();
+
+    if (_thread.joinable() == true) {
+        std::thread thread(std::move(_thread));
+        lock.unlock();
+
+        thread.join();
+    }
+}
+
+void CallbackDispatcher::Post(const Event& event)
+{
+    if (event.callback == nullptr) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(_lock);
+
+    if (_running == false) {
+        _running = true;
+        _thread = std::thread(&CallbackDispatcher::Process, this);
+    }
+
+    // Players wait for key statuses and errors, so only properties are held
+    // to the capacity.
+    if ((_events.size() < _capacity) || (event.type != EVENT_PROPERTIES)) {
+        _events.push_back(event);
+        _signal.notify_all();
+    } else if (Merge(event) == false) {
+        // Dropped, so the same properties must get through next time.
+        _lastProperties.erase(event.callback);
+        TRACE_L1("Callback queue full, properties dropped");
+    }
+}
+
+// Replaces the properties still queued for the same callback, they are
+// superseded. Only used when the queue is full.
+bool CallbackDispatcher::Merge(const Event& event)
+{
+    bool merged = false;
+
+    for (std::deque<Event>::iterator index = _events.begin(); (index != _events.end()) && (merged == false); ++index) {
+        if ((index->callback == event.callback) && (index->type == EVENT_PROPERTIES)) {
+            index->properties = event.properties;
+            merged = true;
+        }
+    }
+
+    return (merged);
+}
+
+void CallbackDispatcher::Deliver(const Event& event)
+{
+    switch (event.type) {
+    case EVENT_PROPERTIES: {
+        // The message includes the terminating zero, as the receiving side
+        // expects.
+        char url[] = "properties";
+        event.callback->OnKeyMessage(reinterpret_cast<const uint8_t*>(event.properties->c_str()), event.properties->length() + 1, url);
+        break;
+    }
+    case EVENT_KEY_STATUSES_UPDATE:
+        for (size_t offset = 0; (event.keyIdLength > 0) && ((offset + event.keyIdLength) <= event.keyIds.size()); offset += event.keyIdLength) {
+            event.callback->OnKeyStatusUpdate(event.text.c_str(), &event.keyIds[offset], event.keyIdLength);
+        }
+        event.callback->OnKeyStatusesUpdated();
+        break;
+    case EVENT_KEY_STATUSES_UPDATED:
+        event.callback->OnKeyStatusesUpdated();
+        break;
+    case EVENT_ERROR:
+        event.callback->OnError(event.error, event.sysError, event.text.c_str());
+        break;
+    }
+}
+
+void CallbackDispatcher::Process()
+{
+    std::unique_lock<std::mutex> lock(_lock);
+
+    while ((_running == true) && (_thread.get_id() == std::this_thread::get_id())) {
+        if (_events.empty() == true) {
+            _signal.wait(lock);
+        } else {
+            Event event(_events.front());
+            _events.pop_front();
+            _delivering = event.callback;
+            _signal.notify_all();
+
+            lock.unlock();
+            Deliver(event);
+            lock.lock();
+
+            _delivering = nullptr;
+            _signal.notify_all();
+        }
+    }
+}
+
+} // namespace CDMi
@@ -0,0 +1,105 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include "cdmi.h"
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace CDMi {
+
+// Delivers session callbacks (output protection properties, key statuses and
+// errors) on one long-lived thread, so they are never invoked with the DRM
+// app context lock held and no thread is spawned per notification.
+// Events for a callback are delivered in the order they were posted. Posting
+// never blocks, as it happens with the DRM lock held. The capacity only holds
+// for properties: when the queue is full, new properties replace the ones
+// still queued for the callback or are dropped. Key statuses and errors are
+// always queued.
+class CallbackDispatcher {
+private:
+    enum EventType {
+        EVENT_PROPERTIES,
+        EVENT_KEY_STATUSES_UPDATE,
+        EVENT_KEY_STATUSES_UPDATED,
+        EVENT_ERROR
+    };
+
+    struct Event {
+        EventType type;
+        IMediaKeySessionCallback* callback;
+        std::string text;
+        std::shared_ptr<const std::string> properties;
+        std::vector<uint8_t> keyIds;
+        uint8_t keyIdLength;
+        int16_t error;
+        CDMi_RESULT sysError;
+    };
+
+public:
+    CallbackDispatcher(const CallbackDispatcher&) = delete;
+    CallbackDispatcher& operator=(const CallbackDispatcher&) = delete;
+
+    CallbackDispatcher(const uint32_t capacity);
+    ~CallbackDispatcher();
+
+    // Output protection levels as a JSON object, sent with OnKeyMessage to
+    // the "properties" URL. The payload is shared, not copied. A payload
+    // identical to the previous one posted for the same callback is dropped.
+    void Properties(IMediaKeySessionCallback* callback, const std::shared_ptr<const std::string>& properties);
+    // The same status for every key in keyIds (keyIdLength sized key IDs back
+    // to back), followed by OnKeyStatusesUpdated, all as a single event.
+    void KeyStatusesUpdate(IMediaKeySessionCallback* callback, const char status[], const std::vector<uint8_t>& keyIds, const uint8_t keyIdLength);
+    void KeyStatusesUpdated(IMediaKeySessionCallback* callback);
+    void Error(IMediaKeySessionCallback* callback, const int16_t error, const CDMi_RESULT sysError, const char message[]);
+
+    // Drops everything still queued for the callback and waits for a delivery
+    // to it that is in progress, after which the callback may be destroyed.
+    // Must not be called with the DRM lock held, the delivery may need it.
+    void Revoke(IMediaKeySessionCallback* callback);
+
+    void Stop();
+
+private:
+    void Post(const Event& event);
+    bool Merge(const Event& event);
+    void Deliver(const Event& event);
+    void Process();
+
+private:
+    const uint32_t _capacity;
+    std::mutex _lock;
+    std::condition_variable _signal;
+    std::deque<Event> _events;
+    std::map<IMediaKeySessionCallback*, std::shared_ptr<const std::string> > _lastProperties;
+    IMediaKeySessionCallback* _delivering;
+    std::thread _thread;
+    bool _running;
+};
+
+} // namespace CDMi
@@ -0,0 +1,132 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "FileUtils.h"
+
+#include <core/core.h>
+#include <cryptalgo/cryptalgo.h>
+
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace WPEFramework;
+
+namespace CDMi {
+
+static const off_t HASH_BUFFER_SIZE = 64 * 1024;
+
+bool WriteNewFile(const std::string& fileName, const uint8_t data[], const size_t length)
+{
+    const std::string newFileName(fileName + ".new");
+    const int fd = ::open(newFileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    bool result = (fd >= 0);
+    size_t offset = 0;
+
+    while ((result == true) && (offset < length)) {
+        const ssize_t count = ::write(fd, &data[offset], length - offset);
+
+        if (count > 0) {
+            offset += count;
+        } else if ((count < 0) && (errno != EINTR)) {
+            result = false;
+        }
+    }
+
+    if (fd >= 0) {
+        result = ((::fsync(fd) == 0) && result);
+        result = ((::close(fd) == 0) && result);
+    }
+
+    if (result == false) {
+        TRACE_L1(_T("Failed to write %s"), newFileName.c_str());
+        ::remove(newFileName.c_str());
+    }
+
+    return result;
+}
+
+bool CommitNewFile(const std::string& fileName)
+{
+    const std::string newFileName(fileName + ".new");
+
+    if (::rename(newFileName.c_str(), fileName.c_str()) != 0) {
+        TRACE_L1(_T("Failed to rename %s"), newFileName.c_str());
+        ::remove(newFileName.c_str());
+        return false;
+    }
+
+    std::vector<char> directory(fileName.begin(), fileName.end());
+    directory.push_back('\0');
+
+    const int fd = ::open(::dirname(directory.data()), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0) {
+        ::fsync(fd);
+        ::close(fd);
+    }
+
+    return true;
+}
+
+void DiscardNewFile(const std::string& fileName)
+{
+    ::remove((fileName + ".new").c_str());
+}
+
+bool ReplaceFile(const std::string& fileName, const uint8_t data[], const size_t length)
+{
+    return ((WriteNewFile(fileName, data, length) == true) && (CommitNewFile(fileName) == true));
+}
+
+bool HashFile(const int fd, const off_t length, uint8_t hash[SHA256_LENGTH])
+{
+    Crypto::SHA256 calculator;
+    std::vector<uint8_t> buffer(static_cast<size_t>(std::min(HASH_BUFFER_SIZE, length)));
+    bool result = true;
+    off_t offset = 0;
+
+    while ((result == true) && (offset < length)) {
+        const size_t size = static_cast<size_t>(std::min(static_cast<off_t>(buffer.size()), length - offset));
+        const ssize_t got = ::pread(fd, buffer.data(), size, offset);
+
+        if (got > 0) {
+            calculator.Input(buffer.data(), static_cast<uint32_t>(got));
+            offset += got;
+        } else if ((got < 0) && (errno == EINTR)) {
+            continue;
+        } else {
+            // Truncated meanwhile, or a read error.
+            result = false;
+        }
+    }
+
+    if (result == true) {
+        ::memcpy(hash, calculator.Result(), SHA256_LENGTH);
+    }
+
+    return result;
+}
+
+} // namespace CDMi
@@ -0,0 +1,50 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <sys/types.h>
+
+namespace CDMi {
+
+// Files that are replaced as a whole: the new content goes to
+// <fileName>.new, is synced, and is then renamed over fileName. A crash
+// halfway never leaves a truncated file behind.
+
+// Writes and syncs <fileName>.new, to be committed or discarded after.
+bool WriteNewFile(const std::string& fileName, const uint8_t data[], const size_t length);
+// Renames <fileName>.new over fileName, and syncs the directory so the rename
+// is durable as well.
+bool CommitNewFile(const std::string& fileName);
+void DiscardNewFile(const std::string& fileName);
+// All of the above in one go.
+bool ReplaceFile(const std::string& fileName, const uint8_t data[], const size_t length);
+
+static constexpr uint32_t SHA256_LENGTH = 32;
+
+// SHA-256 over the first length bytes of the open file fd. The file is read
+// rather than mapped, as it may be truncated meanwhile, e.g. the DRM store
+// while it is cleaned up or recreated. Then the hash fails, as it does when
+// the file holds less than length bytes.
+bool HashFile(const int fd, const off_t length, uint8_t hash[SHA256_LENGTH]);
+
+} // namespace CDMi
@@ -15,12 +15,15 @@
  */
 
 #include "MediaSession.h"
+#include "FileUtils.h"
+#include <algorithm>
 #include <assert.h>
 #include <iostream>
 #include <sstream>
 #include <string>
 #include <string.h>
 #include <vector>
+#include <dirent.h>
 #include <sys/utsname.h>
 
 #include <nexus_random_number.h>
@@ -38,7 +41,6 @@
 #include <drmrevocation.h>
 #include <drmxmlparser.h>
 #include <drmmathsafe.h>
-#include <prdy_http.h>
 #include <drm_data.h>
 
 using SafeCriticalSection = WPEFramework::Core::SafeSyncType<WPEFramework::Core::CriticalSection>;
@@ -46,8 +48,9 @@ extern WPEFramework::Core::CriticalSection drmAppContextMutex_;
 
 #define NYI_KEYSYSTEM "keysystem-placeholder"
 
-// ~100 KB to start * 64 (2^6) ~= 6.4 MB, don't allocate more than ~6.4 MB
-#define DRM_MAXIMUM_APPCONTEXT_OPAQUE_BUFFER_SIZE ( 64 * MINIMUM_APPCONTEXT_OPAQUE_BUFFER_SIZE )
+// Time a license that needs secure time waits for the secure clock, which is
+// set up in the background.
+static const uint32_t SECURE_CLOCK_WAIT_MS = 30000;
 
 OutputProtection::OutputProtection()
     : compressedDigitalVideoLevel(0)
@@ -75,8 +78,10 @@ void OutputProtection::setMaxResDecode(uint32_t width, uint32_t height)
 }
 namespace CDMi {
 
-    MediaKeySession::DecryptContext::DecryptContext(IMediaKeySessionCallback* mcallback)
+    MediaKeySession::DecryptContext::DecryptContext(IMediaKeySessionCallback* mcallback, CallbackDispatcher* mdispatcher)
     : callback(mcallback)
+    , dispatcher(mdispatcher)
+    , lastUse(0)
     {
         ZEROMEM(&drmDecryptContext, sizeof(DRM_DECRYPT_CONTEXT));
     }
@@ -86,9 +91,10 @@ namespace CDMi {
 // Parse out the first PlayReady initialization header found in the concatenated
 // block of headers in _initData_.
 // If a PlayReady header is found, this function returns true and the header
-// contents are stored in _output_.
+// contents are stored in _output_. The key IDs of a version 1 box are stored
+// in _keyIds_, in the standard (big-endian) format.
 // Otherwise, returns false and _output_ is not touched.
-bool parsePlayreadyInitializationData(const std::string& initData, std::string* output)
+bool parsePlayreadyInitializationData(const std::string& initData, std::string* output, std::vector<std::vector<uint8_t> >* keyIds)
 {
     BufferReader input(reinterpret_cast<const uint8_t*>(initData.data()), initData.length());
 
@@ -170,15 +176,21 @@ bool parsePlayreadyInitializationData(const std::string& initData, std::string*
             continue;
         }
 
+        std::vector<std::vector<uint8_t> > boxKeyIds;
         if (version == 1) {
-            // v1 has additional fields for key IDs.  We can skip them.
+            // v1 has additional fields for key IDs, these are the keys the
+            // content will rotate through.
             uint32_t numKeyIds;
             if (!input.Read4(&numKeyIds)) {
                 return false;
             }
 
-            if (!input.SkipBytes(numKeyIds * 16)) {
-                return false;
+            for (uint32_t i = 0; i < numKeyIds; ++i) {
+                std::vector<uint8_t> keyId;
+                if (!input.ReadVec(&keyId, 16)) {
+                    return false;
+                }
+                boxKeyIds.push_back(keyId);
             }
         }
 
@@ -193,6 +205,7 @@ bool parsePlayreadyInitializationData(const std::string& initData, std::string*
             return false;
         }
 
+        keyIds->swap(boxKeyIds);
         return true;
     }
 
@@ -200,62 +213,6 @@ bool parsePlayreadyInitializationData(const std::string& initData, std::string*
     return false;
 }
 
-bool MediaKeySession::LoadRevocationList(const char *revListFile)
-{
-    DRM_RESULT dr = DRM_SUCCESS;
-    FILE    * fRev;
-    uint8_t * revBuf = nullptr;
-    size_t    fileSize = 0;
-    uint32_t  currSize = 0;
-
-    assert(revListFile != nullptr);
-
-    fRev = fopen(revListFile, "rb");
-    if( fRev == nullptr)
-    {
-        return true;
-    }
-
-    /* get the size of the file */
-    fseek(fRev, 0, SEEK_END);
-    fileSize = ftell(fRev);
-    fseek(fRev, 0, SEEK_SET);
-
-    revBuf = (uint8_t *)BKNI_Malloc(fileSize);
-    if( revBuf == nullptr)
-    {
-        goto ErrorExit;
-    }
-
-    BKNI_Memset(revBuf, 0x00, fileSize);
-
-    for(;;) {
-        uint8_t buf[512];
-        int rc = fread(buf, 1, sizeof(buf), fRev);
-        if(rc<=0) {
-            break;
-       }
-        BKNI_Memcpy(revBuf+currSize, buf, rc);
-        currSize += rc;
-    }
-
-    ChkDR( Drm_Revocation_StorePackage(
-            m_poAppContext,
-            ( DRM_CHAR * )revBuf,
-            fileSize ) );
-
-    if( revBuf != nullptr)
-        BKNI_Free(revBuf);
-
-    return true;
-
-ErrorExit:
-    if( revBuf != nullptr)
-        BKNI_Free(revBuf);
-
-    return false;
-}
-
 // PlayReady license policy callback which should be
 // customized for platform/environment that hosts the CDM.
 // It is currently implemented as a place holder that
@@ -377,21 +334,33 @@ DRM_RESULT MediaKeySession::PolicyCallback(
  MediaKeySession::MediaKeySession(
      const uint8_t *f_pbInitData, uint32_t f_cbInitData, 
      const uint8_t *f_pbCDMData, uint32_t f_cbCDMData, 
-     DRM_VOID *f_pOEMContext, DRM_APP_CONTEXT * appContext)
+     DRM_VOID *f_pOEMContext, DRM_APP_CONTEXT * appContext,
+     const bool persistent,
+     const SessionEnvironment& environment)
         : m_poAppContext(appContext)
         , m_oDecryptContext(nullptr)
-        , m_pbOpaqueBuffer(nullptr)
-        , m_cbOpaqueBuffer(0)
-        , m_pbRevocationBuffer(nullptr)
         , m_customData(reinterpret_cast<const char*>(f_pbCDMData), f_cbCDMData)
         , m_piCallback(nullptr)
         , m_eKeyState(KEY_CLOSED)
         , m_fCommit(false)
         , m_pOEMContext(f_pOEMContext)
         , mDrmHeader()
+        , m_fPersistent(persistent)
         , m_SessionId()
         , mBatchId()
+        , mInMemoryLicenses(0)
         , m_decryptInited(false)
+        , mDecryptContextClock(0)
+        , mDecryptContextHits(0)
+        , mDecryptContextMisses(0)
+        , mDecryptContextEvictions(0)
+        , mEnvironment(environment)
+        , mInitDataKeyIds()
+        , mSessionKeyIds()
+        , mLoadSessionId()
+        , mAlive(new bool(true))
+        , mPendingChallenge()
+        , mPendingChallengeTime()
         , pNexusMemory(nullptr)
         , mNexusMemorySize(512 * 1024) {
 
@@ -402,7 +371,6 @@ DRM_RESULT MediaKeySession::PolicyCallback(
     DRM_RESULT dr = DRM_SUCCESS;
     DRM_ID oSessionID;
     DRM_DWORD cchEncodedSessionID = sizeof(m_rgchSessionID);
-    std::string playreadyInitData;
 
     // The current state MUST be KEY_CLOSED otherwise error out.
     ChkBOOL(m_eKeyState == KEY_CLOSED, DRM_E_INVALIDARG);
@@ -415,20 +383,10 @@ DRM_RESULT MediaKeySession::PolicyCallback(
     }
 
     if (f_pbInitData != nullptr) {
+        // The app context is shared with the other sessions.
+        SafeCriticalSection systemLock(drmAppContextMutex_);
 
-        std::string initData(reinterpret_cast<const char *>(f_pbInitData), f_cbInitData);
-        if (!parsePlayreadyInitializationData(initData, &playreadyInitData)) {
-            playreadyInitData = initData;
-        }
-
-        // TODO: can we do this nicer?
-        mDrmHeader.resize(f_cbInitData);
-        memcpy(&mDrmHeader[0], f_pbInitData, f_cbInitData);
-
-        ChkDR(Drm_Content_SetProperty(m_poAppContext,
-                                      DRM_CSP_AUTODETECT_HEADER,
-                                      reinterpret_cast<const uint8_t *>(playreadyInitData.data()),
-                                      playreadyInitData.size()));
+        ChkDR(ApplyInitData(f_pbInitData, f_cbInitData));
 
         // Generate a random media session ID.
         ChkDR(Oem_Random_GetBytes(m_poAppContext, (DRM_BYTE *)&oSessionID, sizeof(oSessionID)));
@@ -453,6 +411,47 @@ ErrorExit:
     }
 }
 
+// Takes the DRM header (and the KIDs) from the init data and makes it the
+// current header of the app context.
+DRM_RESULT MediaKeySession::ApplyInitData(const uint8_t initData[], const uint32_t initDataLength)
+{
+    std::string playreadyInitData;
+    std::string rawInitData(reinterpret_cast<const char *>(initData), initDataLength);
+
+    mInitDataKeyIds.clear();
+    parsePlayreadyInitializationData(rawInitData, &playreadyInitData, &mInitDataKeyIds);
+
+    // The decrypt contexts are keyed on the PlayReady KID format.
+    for (std::vector<uint8_t>& keyId : mInitDataKeyIds) {
+        ToggleKeyIdFormat(keyId.size(), &keyId[0]);
+    }
+
+    // TODO: can we do this nicer?
+    mDrmHeader.assign(initData, initData + initDataLength);
+
+    return SelectSessionHeader();
+}
+
+// The current header is app context state, which other sessions and the
+// decrypt context prefetch change as they go. So every step that depends on
+// it selects the header of the session again first.
+// Must be called with drmAppContextMutex_ taken.
+DRM_RESULT MediaKeySession::SelectSessionHeader()
+{
+    std::string playreadyInitData;
+    std::vector<std::vector<uint8_t> > keyIds;
+    const std::string rawInitData(mDrmHeader.begin(), mDrmHeader.end());
+
+    if (!parsePlayreadyInitializationData(rawInitData, &playreadyInitData, &keyIds)) {
+        playreadyInitData = rawInitData;
+    }
+
+    return (Drm_Content_SetProperty(m_poAppContext,
+                                    DRM_CSP_AUTODETECT_HEADER,
+                                    reinterpret_cast<const uint8_t *>(playreadyInitData.data()),
+                                    playreadyInitData.size()));
+}
+
 MediaKeySession::~MediaKeySession(void)
 {
     Close();
@@ -476,172 +475,617 @@ const char *MediaKeySession::GetKeySystem(void) const
 void MediaKeySession::Run(const IMediaKeySessionCallback *f_piMediaKeySessionCallback)
 {
     LOGGER(LINFO_, "Set session callback to %p", f_piMediaKeySessionCallback);
-    if (f_piMediaKeySessionCallback) {
-        m_piCallback = const_cast<IMediaKeySessionCallback *>(f_piMediaKeySessionCallback);
+    SetCallback(const_cast<IMediaKeySessionCallback *>(f_piMediaKeySessionCallback));
+
+    if ((m_piCallback != nullptr) && (mDrmHeader.size() != 0)) {
+        playreadyGenerateKeyRequest();
+    }
+}
+
+void MediaKeySession::SetCallback(IMediaKeySessionCallback *callback)
+{
+    IMediaKeySessionCallback* previous = nullptr;
 
-        if (mDrmHeader.size() != 0) {
-            playreadyGenerateKeyRequest();
+    {
+        SafeCriticalSection systemLock(drmAppContextMutex_);
+        previous = SwapCallback(callback);
+    }
+
+    // Nothing may be delivered to the previous callback once it has been
+    // replaced, its owner is free to destroy it. A delivery in progress may
+    // need the DRM lock, so this waits for it without holding that.
+    if (previous != nullptr) {
+        mEnvironment.dispatcher->Revoke(previous);
+    }
+}
+
+// Must be called with drmAppContextMutex_ taken. Returns the callback that was
+// replaced, if any, which still has to be revoked.
+IMediaKeySessionCallback* MediaKeySession::SwapCallback(IMediaKeySessionCallback *callback)
+{
+    IMediaKeySessionCallback* previous = nullptr;
+
+    if (callback != m_piCallback) {
+        previous = m_piCallback;
+        m_piCallback = callback;
+
+        for (DecryptContextMap::iterator it = mDecryptContextMap.begin(); it != mDecryptContextMap.end(); ++it) {
+            if (it->second) {
+                it->second->callback = callback;
+            }
         }
-    } else {
-        m_piCallback = nullptr;
     }
+
+    return (previous);
 }
 
 bool MediaKeySession::playreadyGenerateKeyRequest() {
     DRM_RESULT dr = DRM_SUCCESS;
-    DRM_BYTE *pbChallenge = nullptr;
     DRM_DWORD cbChallenge = 0;
-    DRM_CHAR *pchSilentURL = nullptr;
     DRM_DWORD cchSilentURL = 0;
+    std::vector<DRM_BYTE> challenge;
+    std::vector<DRM_CHAR> silentURL;
+    IMediaKeySessionCallback* callback = nullptr;
 
-    if(m_eKeyState == KEY_INIT){
-        // Try to figure out the size of the license acquisition
-        // challenge to be returned.
-        dr = Drm_LicenseAcq_GenerateChallenge(m_poAppContext,
-                                            g_rgpdstrRights,
-                                            DRM_NO_OF(g_rgpdstrRights),
-                                            nullptr,
-                                            !m_customData.empty() ? m_customData.c_str() : nullptr,
-                                            m_customData.size(),
-                                            nullptr,
-                                            &cchSilentURL,
-                                            nullptr,
-                                            nullptr,
-                                            nullptr,
-                                            &cbChallenge,
-                                            nullptr);
-        if (dr == DRM_E_BUFFERTOOSMALL)
-        {
-            if (cchSilentURL > 0)
+    // open scope for DRM_APP_CONTEXT mutex, it also guards the shared
+    // challenge buffers.
+    {
+        SafeCriticalSection systemLock(drmAppContextMutex_);
+        ChallengeBuffers& buffers = *(mEnvironment.challengeBuffers);
+
+        if(m_eKeyState == KEY_INIT){
+            ChkDR(SelectSessionHeader());
+
+            // Generating a challenge is expensive, so try to do it in one go with
+            // buffers the size of the largest challenge so far. Only when that
+            // turns out too small, grow them to the size just reported and
+            // generate again. PlayReady doesn't like valid pointer + size 0, so
+            // the first go on empty buffers only asks for the sizes.
+            cchSilentURL = buffers.silentURL.size() - 1;
+            cbChallenge = buffers.challenge.size() - 1;
+            dr = Drm_LicenseAcq_GenerateChallenge(m_poAppContext,
+                                                g_rgpdstrRights,
+                                                DRM_NO_OF(g_rgpdstrRights),
+                                                nullptr,
+                                                !m_customData.empty() ? m_customData.c_str() : nullptr,
+                                                m_customData.size(),
+                                                (cchSilentURL > 0) ? &buffers.silentURL[0] : nullptr,
+                                                &cchSilentURL,
+                                                nullptr,
+                                                nullptr,
+                                                (cbChallenge > 0) ? &buffers.challenge[0] : nullptr,
+                                                &cbChallenge,
+                                                nullptr);
+            if (dr == DRM_E_BUFFERTOOSMALL)
             {
-                ChkMem(pchSilentURL = (DRM_CHAR *)Oem_MemAlloc(cchSilentURL + 1));
-                ZEROMEM(pchSilentURL, cchSilentURL + 1);
+                LOGGER(LINFO_, "Growing challenge buffers to %u bytes, URL to %u characters",
+                    static_cast<unsigned int>(cbChallenge), static_cast<unsigned int>(cchSilentURL));
+
+                if (buffers.silentURL.size() <= cchSilentURL)
+                {
+                    buffers.silentURL.resize(cchSilentURL + 1);
+                }
+                if (buffers.challenge.size() <= cbChallenge)
+                {
+                    buffers.challenge.resize(cbChallenge + 1);
+                }
+
+                // Supply a buffer to receive the license acquisition challenge.
+                cchSilentURL = buffers.silentURL.size() - 1;
+                cbChallenge = buffers.challenge.size() - 1;
+                ChkDR(Drm_LicenseAcq_GenerateChallenge(m_poAppContext,
+                                                    g_rgpdstrRights,
+                                                    DRM_NO_OF(g_rgpdstrRights),
+                                                    nullptr,
+                                                    !m_customData.empty() ? m_customData.c_str() : nullptr,
+                                                    m_customData.size(),
+                                                    (cchSilentURL > 0) ? &buffers.silentURL[0] : nullptr,
+                                                    &cchSilentURL,
+                                                    nullptr,
+                                                    nullptr,
+                                                    &buffers.challenge[0],
+                                                    &cbChallenge,
+                                                    nullptr));
             }
-
-            // Allocate buffer that is sufficient to store the license acquisition
-            // challenge.
-            if (cbChallenge > 0)
+            else
             {
-                ChkMem(pbChallenge = (DRM_BYTE *)Oem_MemAlloc(cbChallenge + 1));
-                ZEROMEM(pbChallenge, cbChallenge + 1);
+                ChkDR(dr);
             }
-            dr = DRM_SUCCESS;
-        }
-        else
-        {
-            ChkDR(dr);
-        }
 
-        // Supply a buffer to receive the license acquisition challenge.
-        ChkDR(Drm_LicenseAcq_GenerateChallenge(m_poAppContext,
-                                            g_rgpdstrRights,
-                                            DRM_NO_OF(g_rgpdstrRights),
-                                            nullptr,
-                                            !m_customData.empty() ? m_customData.c_str() : nullptr,
-                                            m_customData.size(),
-                                            pchSilentURL,
-                                            &cchSilentURL,
-                                            nullptr,
-                                            nullptr,
-                                            pbChallenge,
-                                            &cbChallenge,
-                                            nullptr));
+            m_eKeyState = KEY_PENDING;
 
-        pbChallenge[cbChallenge] = 0;
-        m_eKeyState = KEY_PENDING;
+            LOGGER(LINFO_, "Generated license acquisition challenge.");
 
-        LOGGER(LINFO_, "Generated license acquisition challenge.");
+            // The buffers are shared with the other sessions, the callback
+            // gets its own copy so it can be made without the lock.
+            challenge.assign(buffers.challenge.begin(), buffers.challenge.begin() + cbChallenge);
+            challenge.push_back(0);
+            silentURL.assign(buffers.silentURL.begin(), buffers.silentURL.begin() + cchSilentURL);
+            silentURL.push_back(0);
+            callback = m_piCallback;
+        }
+    }
 
-        // Everything is OK and trigger a callback to let the caller
-        // handle the key message.
-        m_piCallback->OnKeyMessage((const uint8_t *) pbChallenge, cbChallenge, (char *) pchSilentURL);
+    // Everything is OK and trigger a callback to let the caller
+    // handle the key message. The caller may call back into the CDM from
+    // it, so the DRM lock must not be held.
+    if (callback != nullptr) {
+        callback->OnKeyMessage(&challenge[0], cbChallenge, &silentURL[0]);
     }
 
 ErrorExit:
     if (DRM_FAILED(dr))
     {
-        if (m_piCallback != nullptr)
-        {
-            m_piCallback->OnError(0, CDMi_S_FALSE, "KeyError");
-        }
+        mEnvironment.dispatcher->Error(m_piCallback, 0, CDMi_S_FALSE, "KeyError");
         m_eKeyState = KEY_ERROR;
         LOGGER(LERROR_, "Failure during license acquisition challenge. (error: 0x%08X)",(unsigned int)dr);
     }
 
-    SAFE_OEM_FREE(pbChallenge);
-    SAFE_OEM_FREE(pchSilentURL);
-
     return (dr == DRM_SUCCESS);
 }
 
+// Restores a persistent-license session recorded by an earlier Update(). The
+// session to load is named by SessionToLoad(), or else found by the init data
+// the session was created with. Its licenses are in the store already, so
+// this binds straight away instead of generating a challenge.
 CDMi_RESULT MediaKeySession::Load(void)
 {
+    // open scope for DRM_APP_CONTEXT mutex
+    SafeCriticalSection systemLock(drmAppContextMutex_);
+
+    DRM_RESULT dr = DRM_SUCCESS;
+    SessionRecord record;
+
+    if (m_fPersistent == false) {
+        LOGGER(LERROR_, "Only persistent-license sessions can be loaded");
+        return CDMi_S_FALSE;
+    }
+
+    if ((FindSessionRecord(record) == false) || (record.initData.empty() == true)) {
+        LOGGER(LERROR_, "No persistent session found to load");
+        return CDMi_S_FALSE;
+    }
+
+    LOGGER(LINFO_, "Loading persistent session %s", record.sessionId.c_str());
+
+    ZEROMEM(m_rgchSessionID, sizeof(m_rgchSessionID));
+    strncpy(m_rgchSessionID, record.sessionId.c_str(), sizeof(m_rgchSessionID) - 1);
+
+    ChkDR(ApplyInitData(&record.initData[0], record.initData.size()));
+    mSessionKeyIds = record.keyIds;
+
+    ChkDR(BindSession());
+
+    ReportKeyStatus("KeyUsable", mSessionKeyIds);
+
+ErrorExit:
+    if (DRM_FAILED(dr)) {
+        LOGGER(LERROR_, "Failed to load persistent session (error: 0x%08X)", static_cast<unsigned int>(dr));
+        m_eKeyState = KEY_ERROR;
+        return CDMi_S_FALSE;
+    }
+
+    return CDMi_SUCCESS;
+}
+
+std::string MediaKeySession::SessionRecordFile(const std::string& sessionId) const
+{
+    // Session IDs are base64, keep '/' out of the file name.
+    std::string fileName(sessionId);
+    std::replace(fileName.begin(), fileName.end(), '/', '_');
 
-  return CDMi_S_FALSE;
+    return (mEnvironment.sessionRecordPath + fileName);
 }
 
-void MediaKeySession::Update(const uint8_t *f_pbKeyMessageResponse, uint32_t  f_cbKeyMessageResponse)
+static void AppendRecordField(std::vector<uint8_t>& record, const uint8_t data[], const uint32_t length)
 {
+    const uint8_t size[] = {
+        static_cast<uint8_t>(length >> 24), static_cast<uint8_t>(length >> 16),
+        static_cast<uint8_t>(length >> 8), static_cast<uint8_t>(length)
+    };
 
-    DRM_RESULT dr = DRM_SUCCESS;    
-    DRM_LICENSE_RESPONSE oLicenseResponse;
+    record.insert(record.end(), size, size + sizeof(size));
+    record.insert(record.end(), data, data + length);
+}
 
-    ChkArg(f_pbKeyMessageResponse != nullptr && f_cbKeyMessageResponse > 0);
+// The record holds, each preceded by its big-endian 32 bit length: the
+// session ID, the init data and the concatenated 16 byte key IDs.
+bool MediaKeySession::SaveSessionRecord() const
+{
+    const std::string fileName(SessionRecordFile(m_rgchSessionID));
+    std::vector<uint8_t> record;
+    std::vector<uint8_t> keyIds;
 
-    BKNI_Memset(&oLicenseResponse, 0, sizeof(oLicenseResponse));
+    for (const std::vector<uint8_t>& keyId : mSessionKeyIds) {
+        keyIds.insert(keyIds.end(), keyId.begin(), keyId.end());
+    }
 
-    LOGGER(LINFO_, "Processing license acquisition response...");
-    ChkDR(Drm_LicenseAcq_ProcessResponse(m_poAppContext,
-                                        DRM_PROCESS_LIC_RESPONSE_SIGNATURE_NOT_REQUIRED,
-                                        const_cast<DRM_BYTE *>(f_pbKeyMessageResponse),
-                                        f_cbKeyMessageResponse,
-                                        &oLicenseResponse));
+    AppendRecordField(record, reinterpret_cast<const uint8_t*>(m_rgchSessionID), strlen(m_rgchSessionID));
+    AppendRecordField(record, mDrmHeader.data(), mDrmHeader.size());
+    AppendRecordField(record, keyIds.data(), keyIds.size());
 
+    const bool result = ReplaceFile(fileName, record.data(), record.size());
+    if (result == false) {
+        LOGGER(LERROR_, "Failed to write %s", fileName.c_str());
+    }
 
-    LOGGER(LINFO_, "Binding License...");
-    while ((dr = Drm_Reader_Bind(m_poAppContext,
-                        g_rgpdstrRights,
-                        DRM_NO_OF(g_rgpdstrRights),
-                        PolicyCallback,
-                        nullptr,
-                        m_oDecryptContext)) == DRM_E_BUFFERTOOSMALL) {
-        uint8_t *pbNewOpaqueBuffer = nullptr;
-        m_cbOpaqueBuffer *= 2;
-
-        ChkMem( pbNewOpaqueBuffer = ( uint8_t* )Oem_MemAlloc(m_cbOpaqueBuffer) );
-
-        if( m_cbOpaqueBuffer > DRM_MAXIMUM_APPCONTEXT_OPAQUE_BUFFER_SIZE ) {
-            ChkDR( DRM_E_OUTOFMEMORY );
-        }
-        ChkDR( Drm_ResizeOpaqueBuffer(
-                m_poAppContext,
-                pbNewOpaqueBuffer,
-                m_cbOpaqueBuffer ) );
-        /*
-        Free the old buffer and then transfer the new buffer ownership
-        Free must happen after Drm_ResizeOpaqueBuffer because that
-        function assumes the existing buffer is still valid
-        */
-        SAFE_OEM_FREE(m_pbOpaqueBuffer);
-        m_pbOpaqueBuffer = pbNewOpaqueBuffer;
+    return result;
+}
+
+/* static */ bool MediaKeySession::ParseSessionRecord(const uint8_t data[], const size_t length, SessionRecord& record)
+{
+    BufferReader input(data, length);
+    uint32_t fieldLength;
+    std::vector<uint8_t> keyIds;
+
+    if ((input.Read4(&fieldLength) == false) || (input.ReadString(&record.sessionId, fieldLength) == false) ||
+        (input.Read4(&fieldLength) == false) || (input.ReadVec(&record.initData, fieldLength) == false) ||
+        (input.Read4(&fieldLength) == false) || (input.ReadVec(&keyIds, fieldLength) == false) ||
+        ((fieldLength % DRM_ID_SIZE) != 0)) {
+        return false;
+    }
+
+    record.keyIds.clear();
+    for (size_t offset = 0; offset < keyIds.size(); offset += DRM_ID_SIZE) {
+        record.keyIds.push_back(std::vector<uint8_t>(keyIds.begin() + offset, keyIds.begin() + offset + DRM_ID_SIZE));
+    }
+
+    return true;
+}
+
+// The session named by SessionToLoad(), or else the one created with the same
+// init data. Which one to pick is not known when several were, so then none is.
+bool MediaKeySession::FindSessionRecord(SessionRecord& record) const
+{
+    std::vector<std::string> candidates;
+    uint32_t found = 0;
+
+    if (mLoadSessionId.empty() == false) {
+        candidates.push_back(mLoadSessionId);
+    } else if (mDrmHeader.empty() == false) {
+        DIR* directory = opendir(mEnvironment.sessionRecordPath.c_str());
+        if (directory != nullptr) {
+            struct dirent* entry;
+            while ((entry = readdir(directory)) != nullptr) {
+                const std::string name(entry->d_name);
+                if ((name[0] != '.') && (name.find(".new") == std::string::npos)) {
+                    std::string id(name);
+                    std::replace(id.begin(), id.end(), '_', '/');
+                    candidates.push_back(id);
+                }
+            }
+            closedir(directory);
+        }
+    }
+
+    for (const std::string& candidate : candidates) {
+        WPEFramework::Core::DataElementFile dataBuffer(SessionRecordFile(candidate), WPEFramework::Core::File::USER_READ);
+        SessionRecord candidateRecord;
+
+        if ((dataBuffer.IsValid() == true) &&
+            (ParseSessionRecord(dataBuffer.Buffer(), static_cast<size_t>(dataBuffer.Size()), candidateRecord) == true)) {
+
+            if ((mLoadSessionId.empty() == false) ? (candidateRecord.sessionId == mLoadSessionId) : (candidateRecord.initData == mDrmHeader)) {
+                record = candidateRecord;
+                ++found;
+            }
+        }
+    }
+
+    if (found > 1) {
+        LOGGER(LERROR_, "%u persistent sessions have this init data, load one by its session ID", found);
+    }
+
+    return (found == 1);
+}
+
+// Non-persistent licenses have no signature, so the
+// LIC_RESPONSE_SIGNATURE_NOT_REQUIRED flag must be used for those.
+// The response struct only has room for DRM_MAX_LICENSE_ACK (usually 20)
+// acks. Batched responses carry more licenses than that, in which case the
+// acks are allocated in acks and the response is processed again. Use
+// LicenseAcks() to get at them either way.
+DRM_RESULT MediaKeySession::ProcessLicenseResponse(const uint8_t response[], const uint32_t responseLength, DRM_LICENSE_RESPONSE& licenseResponse, std::vector<DRM_LICENSE_ACK>& acks)
+{
+    const DRM_DWORD flags = (m_fPersistent == true) ? DRM_PROCESS_LIC_RESPONSE_NO_FLAGS : DRM_PROCESS_LIC_RESPONSE_SIGNATURE_NOT_REQUIRED;
+
+    // MUST zero the input DRM_LICENSE_RESPONSE struct!
+    ZEROMEM(&licenseResponse, sizeof(DRM_LICENSE_RESPONSE));
+
+    DRM_RESULT dr = Drm_LicenseAcq_ProcessResponse(m_poAppContext,
+                                                   flags,
+                                                   const_cast<DRM_BYTE *>(response),
+                                                   (DRM_DWORD)responseLength,
+                                                   &licenseResponse);
+
+    if ((dr == DRM_E_LICACQ_TOO_MANY_LICENSES) && (licenseResponse.m_cAcks > DRM_MAX_LICENSE_ACK)) {
+        const DRM_DWORD count = licenseResponse.m_cAcks;
+
+        LOGGER(LINFO_, "License response holds %u licenses, processing again with room for all of them", static_cast<unsigned int>(count));
+
+        acks.resize(count);
+        ZEROMEM(&acks[0], count * sizeof(DRM_LICENSE_ACK));
+        ZEROMEM(&licenseResponse, sizeof(DRM_LICENSE_RESPONSE));
+        licenseResponse.m_pAcks = &acks[0];
+        licenseResponse.m_cMaxAcks = count;
+
+        dr = Drm_LicenseAcq_ProcessResponse(m_poAppContext,
+                                            flags,
+                                            const_cast<DRM_BYTE *>(response),
+                                            (DRM_DWORD)responseLength,
+                                            &licenseResponse);
+    }
+
+    // Licenses and the secure stop are written to the store, which may have
+    // filled up. Clean it up and have another go before giving up.
+    if ((mEnvironment.storeMaintenance != nullptr) && (StoreFull(dr, licenseResponse) == true)) {
+        // The maintenance thread cleans up on the same app context.
+        SafeCriticalSection systemLock(drmAppContextMutex_);
+
+        LOGGER(LWARNING_, "DRM store full, processing the license response again after a cleanup");
+
+        if (DRM_SUCCEEDED(mEnvironment.storeMaintenance->Cleanup(m_poAppContext))) {
+            DRM_LICENSE_ACK* const pAcks = licenseResponse.m_pAcks;
+            const DRM_DWORD cMaxAcks = licenseResponse.m_cMaxAcks;
+
+            ZEROMEM(&licenseResponse, sizeof(DRM_LICENSE_RESPONSE));
+            licenseResponse.m_pAcks = pAcks;
+            licenseResponse.m_cMaxAcks = cMaxAcks;
+
+            dr = Drm_LicenseAcq_ProcessResponse(m_poAppContext,
+                                                flags,
+                                                const_cast<DRM_BYTE *>(response),
+                                                (DRM_DWORD)responseLength,
+                                                &licenseResponse);
+        }
+    }
+
+    if ((DRM_SUCCEEDED(dr)) && (mEnvironment.storeMaintenance != nullptr)) {
+        mEnvironment.storeMaintenance->Changed();
+    }
+
+    // Persistent licenses go to the HDS store instead.
+    if (DRM_SUCCEEDED(dr) && (m_fPersistent == false)) {
+        const DRM_LICENSE_ACK* const acks = LicenseAcks(licenseResponse);
+        DRM_DWORD stored = 0;
+
+        for (DRM_DWORD i = 0; i < licenseResponse.m_cAcks; ++i) {
+            if (DRM_SUCCEEDED(acks[i].m_dwResult)) {
+                ++stored;
+            }
+        }
+
+        AddInMemoryLicenses(stored);
+    }
+
+    return dr;
+}
+
+/* static */ bool MediaKeySession::StoreFull(const DRM_RESULT dr, const DRM_LICENSE_RESPONSE& licenseResponse)
+{
+    bool full = (dr == DRM_E_DST_STORE_FULL);
+
+    if (DRM_SUCCEEDED(dr)) {
+        const DRM_LICENSE_ACK* const acks = LicenseAcks(licenseResponse);
+
+        for (DRM_DWORD i = 0; (i < licenseResponse.m_cAcks) && (full == false); ++i) {
+            full = (acks[i].m_dwResult == DRM_E_DST_STORE_FULL);
+        }
     }
-    ChkDR(dr);
+
+    return (full);
+}
+
+// The keys licensed by the response, in PlayReady format.
+/* static */ std::vector<std::vector<uint8_t> > MediaKeySession::LicensedKeyIds(const DRM_LICENSE_RESPONSE& licenseResponse)
+{
+    const DRM_LICENSE_ACK* const acks = LicenseAcks(licenseResponse);
+    std::vector<std::vector<uint8_t> > keyIds;
+
+    for (DRM_DWORD i = 0; i < licenseResponse.m_cAcks; ++i) {
+        if (DRM_SUCCEEDED(acks[i].m_dwResult)) {
+            keyIds.push_back(std::vector<uint8_t>(acks[i].m_oKID.rgb, acks[i].m_oKID.rgb + DRM_ID_SIZE));
+        }
+    }
+
+    return keyIds;
+}
+
+// PlayReady grows a full in-memory license store by doubling it, which is
+// costly. Keep track of how much it must be holding, so the next start can
+// reserve the right size up front.
+void MediaKeySession::AddInMemoryLicenses(const DRM_DWORD count)
+{
+    LicenseStoreUsage& usage = *(mEnvironment.licenseStore);
+
+    mInMemoryLicenses += count;
+    usage.licenses += count;
+
+    while ((usage.capacity > 0) && ((usage.licenses * LICENSE_SIZE_BYTES) > usage.capacity)) {
+        usage.capacity *= 2;
+        ++usage.resizes;
+        LOGGER(LINFO_, "In-memory license store grown to %u bytes for %u licenses (%u resizes)",
+            static_cast<unsigned int>(usage.capacity), static_cast<unsigned int>(usage.licenses), usage.resizes);
+    }
+
+    if (usage.licenses > usage.peak) {
+        usage.peak = usage.licenses;
+        mEnvironment.tuning->LicenseStorePeak(usage.peak);
+    }
+}
+
+// Announces all keys licensed by the response as usable, in one go.
+void MediaKeySession::ReportUsableKeys(const DRM_LICENSE_RESPONSE& licenseResponse)
+{
+    const DRM_LICENSE_ACK* const acks = LicenseAcks(licenseResponse);
+    std::vector<uint8_t> keyIds;
+
+    keyIds.reserve(licenseResponse.m_cAcks * DRM_ID_SIZE);
+    for (DRM_DWORD i = 0; i < licenseResponse.m_cAcks; ++i) {
+        if (DRM_SUCCEEDED(acks[i].m_dwResult)) {
+            keyIds.insert(keyIds.end(), acks[i].m_oKID.rgb, acks[i].m_oKID.rgb + DRM_ID_SIZE);
+            // Make MS endianness to Cenc endianness.
+            ToggleKeyIdFormat(DRM_ID_SIZE, &keyIds[keyIds.size() - DRM_ID_SIZE]);
+        }
+    }
+
+    mEnvironment.dispatcher->KeyStatusesUpdate(m_piCallback, "KeyUsable", keyIds, DRM_ID_SIZE);
+}
+
+// Announces the status for the keys given in PlayReady format, in one go.
+void MediaKeySession::ReportKeyStatus(const char status[], const std::vector<std::vector<uint8_t> >& keyIds)
+{
+    std::vector<uint8_t> standardKeyIds;
+
+    standardKeyIds.reserve(keyIds.size() * DRM_ID_SIZE);
+    for (const std::vector<uint8_t>& keyId : keyIds) {
+        if (keyId.size() == DRM_ID_SIZE) {
+            standardKeyIds.insert(standardKeyIds.end(), keyId.begin(), keyId.end());
+            ToggleKeyIdFormat(DRM_ID_SIZE, &standardKeyIds[standardKeyIds.size() - DRM_ID_SIZE]);
+        }
+    }
+
+    mEnvironment.dispatcher->KeyStatusesUpdate(m_piCallback, status, standardKeyIds, DRM_ID_SIZE);
+}
+
+// Binds the license for the current header into the decrypt context of the
+// session and commits, after which the session is ready for decryption.
+// Must be called with drmAppContextMutex_ taken.
+DRM_RESULT MediaKeySession::BindSession()
+{
+    DRM_RESULT dr = DRM_SUCCESS;
+
+    ChkDR(SelectSessionHeader());
+
+    // Closed by Remove(), when the keys went.
+    if (m_oDecryptContext == nullptr) {
+        m_oDecryptContext = new DRM_DECRYPT_CONTEXT;
+        memset(m_oDecryptContext, 0, sizeof(DRM_DECRYPT_CONTEXT));
+    }
+
+    LOGGER(LINFO_, "Binding License...");
+    ChkDR(ReaderBind(g_rgpdstrRights,
+                     DRM_NO_OF(g_rgpdstrRights),
+                     PolicyCallback,
+                     nullptr,
+                     m_oDecryptContext));
 
     ChkDR( Drm_Reader_Commit( m_poAppContext, nullptr, nullptr ) );
 
     m_eKeyState = KEY_READY;
     LOGGER(LINFO_, "Key processed, now ready for content decryption");
 
+ErrorExit:
+    return dr;
+}
+
+// Drm_Reader_Bind, growing the opaque buffer of the app context for as long as
+// the bind reports it is too small. The size a bind got by with is recorded,
+// so the next start reserves it up front.
+DRM_RESULT MediaKeySession::ReaderBind(const DRM_CONST_STRING* rights[], const DRM_DWORD rightsCount, DRMPFNPOLICYCALLBACK policyCallback, const DRM_VOID* policyCallbackData, DRM_DECRYPT_CONTEXT* decryptContext)
+{
+    DRM_RESULT dr;
+
+    while ((dr = Drm_Reader_Bind(m_poAppContext,
+                        rights,
+                        rightsCount,
+                        policyCallback,
+                        policyCallbackData,
+                        decryptContext)) == DRM_E_BUFFERTOOSMALL) {
+        ChkDR(GrowOpaqueBuffer());
+    }
+
+    if (DRM_SUCCEEDED(dr)) {
+        mEnvironment.tuning->OpaqueBufferSize(mEnvironment.opaqueBuffer->size);
+    }
+
+ErrorExit:
+    return dr;
+}
+
+// The opaque buffer is shared by all sessions, so whatever one bind needed the
+// others get as well.
+DRM_RESULT MediaKeySession::GrowOpaqueBuffer()
+{
+    DRM_RESULT dr = DRM_SUCCESS;
+    OpaqueBuffer& opaqueBuffer = *(mEnvironment.opaqueBuffer);
+    const DRM_DWORD cbNewOpaqueBuffer = opaqueBuffer.size * 2;
+    DRM_BYTE *pbNewOpaqueBuffer = nullptr;
+
+    if( cbNewOpaqueBuffer > DRM_MAXIMUM_APPCONTEXT_OPAQUE_BUFFER_SIZE ) {
+        ChkDR( DRM_E_OUTOFMEMORY );
+    }
+
+    ChkMem( pbNewOpaqueBuffer = ( DRM_BYTE* )Oem_MemAlloc(cbNewOpaqueBuffer) );
+
+    ChkDR( Drm_ResizeOpaqueBuffer(
+            m_poAppContext,
+            pbNewOpaqueBuffer,
+            cbNewOpaqueBuffer ) );
+    /*
+    Free the old buffer and then transfer the new buffer ownership
+    Free must happen after Drm_ResizeOpaqueBuffer because that
+    function assumes the existing buffer is still valid
+    */
+    SAFE_OEM_FREE(opaqueBuffer.buffer);
+    opaqueBuffer.buffer = pbNewOpaqueBuffer;
+    opaqueBuffer.size = cbNewOpaqueBuffer;
+    pbNewOpaqueBuffer = nullptr;
+
+    LOGGER(LINFO_, "Grown the opaque buffer to %u bytes", static_cast<unsigned int>(opaqueBuffer.size));
+
+ErrorExit:
+    SAFE_OEM_FREE(pbNewOpaqueBuffer);
+    return dr;
+}
+
+void MediaKeySession::Update(const uint8_t *f_pbKeyMessageResponse, uint32_t  f_cbKeyMessageResponse)
+{
+
+    DRM_RESULT dr = DRM_SUCCESS;    
+    DRM_LICENSE_RESPONSE oLicenseResponse;
+    std::vector<DRM_LICENSE_ACK> oLicenseAcks;
+
+    ChkArg(f_pbKeyMessageResponse != nullptr && f_cbKeyMessageResponse > 0);
+
+    // The shared opaque buffer, the tuning and the license store usage are
+    // only to be touched with the DRM lock held. It is taken per step, as
+    // waiting for the secure clock must not hold it.
+    LOGGER(LINFO_, "Processing license acquisition response...");
+    {
+        SafeCriticalSection systemLock(drmAppContextMutex_);
+        dr = ProcessLicenseResponse(f_pbKeyMessageResponse,
+                                    f_cbKeyMessageResponse,
+                                    oLicenseResponse,
+                                    oLicenseAcks);
+    }
+    if (WaitForSecureClock(dr) == true) {
+        SafeCriticalSection systemLock(drmAppContextMutex_);
+        dr = ProcessLicenseResponse(f_pbKeyMessageResponse,
+                                    f_cbKeyMessageResponse,
+                                    oLicenseResponse,
+                                    oLicenseAcks);
+    }
+    ChkDR(dr);
+
+    {
+        SafeCriticalSection systemLock(drmAppContextMutex_);
+        dr = BindSession();
+    }
+    if (WaitForSecureClock(dr) == true) {
+        SafeCriticalSection systemLock(drmAppContextMutex_);
+        dr = BindSession();
+    }
+    ChkDR(dr);
+
+    if (m_fPersistent == true) {
+        // So that the session can be loaded again later.
+        mSessionKeyIds = LicensedKeyIds(oLicenseResponse);
+        SaveSessionRecord();
+    }
+
     if((m_piCallback != nullptr) && (m_eKeyState == KEY_READY) && (DRM_SUCCEEDED(dr))){
-        for (uint8_t i = 0; i < oLicenseResponse.m_cAcks; ++i) {
-            if (DRM_SUCCEEDED(oLicenseResponse.m_rgoAcks[i].m_dwResult)) {
-                // Make MS endianness to Cenc endianness.
-                ToggleKeyIdFormat(DRM_ID_SIZE, oLicenseResponse.m_rgoAcks[i].m_oKID.rgb);
-                
-                m_piCallback->OnKeyStatusUpdate("KeyUsable", oLicenseResponse.m_rgoAcks[i].m_oKID.rgb, DRM_ID_SIZE);
-            }
-        }
-        m_piCallback->OnKeyStatusesUpdated();
+        ReportUsableKeys(oLicenseResponse);
     }
 
 ErrorExit:
@@ -666,36 +1110,83 @@ ErrorExit:
         }
         
         m_eKeyState = KEY_ERROR;
-        if (m_piCallback) {
-            m_piCallback->OnError(0, CDMi_S_FALSE, "KeyError");
-            m_piCallback->OnKeyStatusesUpdated();
-        }
+        mEnvironment.dispatcher->Error(m_piCallback, 0, CDMi_S_FALSE, "KeyError");
+        mEnvironment.dispatcher->KeyStatusesUpdated(m_piCallback);
     }
     return;
 }
 
+// Deletes the persistent licenses for the keys of this session, and the
+// record of the session.
 CDMi_RESULT MediaKeySession::Remove(void)
 {
-    return CDMi_S_FALSE;
+    // open scope for DRM_APP_CONTEXT mutex
+    SafeCriticalSection systemLock(drmAppContextMutex_);
+
+    if ((m_fPersistent == false) || (mDrmHeader.empty() == true)) {
+        LOGGER(LERROR_, "Nothing persistent to remove");
+        return CDMi_S_FALSE;
+    }
+
+    DRM_RESULT dr = SelectSessionHeader();
+    if (DRM_FAILED(dr)) {
+        LOGGER(LERROR_, "Failed to select the DRM header (error: 0x%08X)", static_cast<unsigned int>(dr));
+        return CDMi_S_FALSE;
+    }
+
+    // The keys go, so must the decrypt contexts bound to them.
+    CleanDecryptContexts();
+
+    // Without a KID, the licenses for all KIDs in the current header go.
+    DRM_DWORD cLicDeleted = 0;
+    dr = Drm_StoreMgmt_DeleteLicenses(m_poAppContext, nullptr, &cLicDeleted);
+    if (DRM_FAILED(dr) && (dr != DRM_E_NOMORE)) {
+        LOGGER(LERROR_, "Error in Drm_StoreMgmt_DeleteLicenses 0x%08X", static_cast<unsigned int>(dr));
+        return CDMi_S_FALSE;
+    }
+
+    LOGGER(LINFO_, "Deleted %u persistent licenses of session %s", static_cast<unsigned int>(cLicDeleted), m_rgchSessionID);
+
+    remove(SessionRecordFile(m_rgchSessionID).c_str());
+
+    ReportKeyStatus("KeyReleased", mSessionKeyIds);
+    mSessionKeyIds.clear();
+
+    return CDMi_SUCCESS;
 }
 
 CDMi_RESULT MediaKeySession::Close(void)
 {
-    m_eKeyState = KEY_CLOSED;
+    IMediaKeySessionCallback* previous = nullptr;
 
-    CleanLicenseStore(m_poAppContext);
+    {
+        SafeCriticalSection systemLock(drmAppContextMutex_);
 
-    CleanDecryptContexts();
-    
-    if (pNexusMemory) {
-        NEXUS_Memory_Free(pNexusMemory);
-        pNexusMemory = nullptr;
-        mNexusMemorySize = 0;
+        // Pending prefetch jobs must leave this session alone from now on.
+        *mAlive = false;
+
+        m_eKeyState = KEY_CLOSED;
+
+        mPendingChallenge.clear();
+
+        CleanLicenseStore(m_poAppContext);
+
+        CleanDecryptContexts();
+
+        if (pNexusMemory) {
+            NEXUS_Memory_Free(pNexusMemory);
+            pNexusMemory = nullptr;
+            mNexusMemorySize = 0;
+        }
+
+        previous = SwapCallback(nullptr);
+        m_fCommit = FALSE;
+        m_decryptInited = false;
     }
 
-    m_piCallback = nullptr;
-    m_fCommit = FALSE;
-    m_decryptInited = false;
+    if (previous != nullptr) {
+        mEnvironment.dispatcher->Revoke(previous);
+    }
 
     return CDMi_SUCCESS;
 }
@@ -715,6 +1206,10 @@ CDMi_RESULT MediaKeySession::Decrypt(
         const uint8_t* /* keyId */,
         bool initWithLast15)
 {
+    if (mEnvironment.storeMaintenance != nullptr) {
+        mEnvironment.storeMaintenance->Activity();
+    }
+
     SafeCriticalSection systemLock(drmAppContextMutex_);
     if (!m_oDecryptContext) {
         LOGGER(LERROR_, "Error: no decrypt context (yet?)\n");
@@ -856,131 +1351,19 @@ CDMi_RESULT MediaKeySession::ReleaseClearContent(
   return CDMi_SUCCESS;
 }
 
-#define MAX_TIME_CHALLENGE_RESPONSE_LENGTH (1024*64)
-#define MAX_URL_LENGTH (512)
-
-int MediaKeySession::InitSecureClock(DRM_APP_CONTEXT *pDrmAppCtx)
-{
-    int                   rc = 0;
-    DRM_DWORD             cbChallenge     = 0;
-    DRM_BYTE             *pbChallenge     = nullptr;
-    DRM_BYTE             *pbResponse      = nullptr;
-    char                 *pTimeChallengeURL = nullptr;
-    char                  secureTimeUrlStr[MAX_URL_LENGTH];
-    bool                  redirect = true;
-    int32_t               petRC=0;
-    uint32_t              petRespCode = 0;
-    uint32_t              startOffset;
-    uint32_t              length;
-    uint32_t              post_ret;
-    NEXUS_MemoryAllocationSettings allocSettings;
-    DRM_RESULT            drResponse = DRM_SUCCESS;
-    DRM_RESULT            dr = DRM_SUCCESS;
-
-    dr = Drm_SecureTime_GenerateChallenge( pDrmAppCtx,
-                                           &cbChallenge,
-                                           &pbChallenge );
-    ChkDR(dr);
-
-    NEXUS_Memory_GetDefaultAllocationSettings(&allocSettings);
-    rc = NEXUS_Memory_Allocate(MAX_URL_LENGTH, &allocSettings, (void **)(&pTimeChallengeURL ));
-    if(rc != NEXUS_SUCCESS)
-    {
-        LOGGER(LERROR_, " NEXUS_Memory_Allocate failed for time challenge response buffer, rc = %d", rc);
-        goto ErrorExit;
-    }
-
-    /* send the petition request to Microsoft with HTTP GET */
-    petRC = PRDY_HTTP_Client_GetForwardLinkUrl((char*)g_dstrHttpSecureTimeServerUrl.pszString,
-                                               &petRespCode,
-                                               (char**)&pTimeChallengeURL);
-
-    if( petRC != 0)
-    {
-        LOGGER(LERROR_, " Secure Time forward link petition request failed, rc = %d", petRC);
-        rc = petRC;
-        goto ErrorExit;
-    }
-
-    do
-    {
-        redirect = false;
-
-        /* we need to check if the Pettion responded with redirection */
-        if( petRespCode == 200)
-        {
-            redirect = false;
-        }
-        else if( petRespCode == 302 || petRespCode == 301)
-        {
-            redirect = true;
-            memset(secureTimeUrlStr, 0, MAX_URL_LENGTH);
-            strcpy(secureTimeUrlStr, pTimeChallengeURL);
-            memset(pTimeChallengeURL, 0, MAX_URL_LENGTH);
-
-            petRC = PRDY_HTTP_Client_GetSecureTimeUrl(secureTimeUrlStr,
-                                                      &petRespCode,
-                                                      (char**)&pTimeChallengeURL);
-
-            if( petRC != 0)
-            {
-                LOGGER(LERROR_, " Secure Time URL petition request failed, rc = %d", petRC);
-                rc = petRC;
-                goto ErrorExit;
-            }
-        }
-        else
-        {
-            LOGGER(LERROR_, "Secure Clock Petition responded with unsupported result, rc = %d, can't get the time challenge URL", petRespCode);
-            rc = -1;
-            goto ErrorExit;
-        }
-    } while (redirect);
-
-    NEXUS_Memory_GetDefaultAllocationSettings(&allocSettings);
-    rc = NEXUS_Memory_Allocate(MAX_TIME_CHALLENGE_RESPONSE_LENGTH, &allocSettings, (void **)(&pbResponse ));
-    if(rc != NEXUS_SUCCESS)
-    {
-        LOGGER(LERROR_, "NEXUS_Memory_Allocate failed for time challenge response buffer, rc = %d", rc);
-        goto ErrorExit;
-    }
-
-    BKNI_Memset(pbResponse, 0, MAX_TIME_CHALLENGE_RESPONSE_LENGTH);
-    post_ret = PRDY_HTTP_Client_SecureTimeChallengePost(pTimeChallengeURL,
-                                                        (char *)pbChallenge,
-                                                        1,
-                                                        150,
-                                                        (unsigned char**)&(pbResponse),
-                                                        &startOffset,
-                                                        &length);
-    if( post_ret != 0)
-    {
-        LOGGER(LERROR_, "Secure Time Challenge request failed, rc = %d", post_ret);
-        rc = post_ret;
-        goto ErrorExit;
-    }
-
-    drResponse = Drm_SecureTime_ProcessResponse(
-            pDrmAppCtx,
-            length,
-            (uint8_t *) pbResponse);
-    if ( drResponse != DRM_SUCCESS )
-    {
-        LOGGER(LERROR_, "Drm_SecureTime_ProcessResponse failed, drResponse = %x", (unsigned int)drResponse);
-        dr = drResponse;
-        ChkDR( drResponse);
+// A license that needs secure time can not be used before the secure clock is
+// set. Returns whether it is set now, so the failed step can be retried.
+// Must not be called with the DRM lock held.
+bool MediaKeySession::WaitForSecureClock(const DRM_RESULT dr) const
+{
+    bool retry = false;
 
+    if ((dr == DRM_E_SECURETIME_CLOCK_NOT_SET) && (mEnvironment.secureClock != nullptr)) {
+        LOGGER(LINFO_, "License needs the secure clock, waiting for it...");
+        retry = mEnvironment.secureClock->WaitReady(SECURE_CLOCK_WAIT_MS);
     }
-    LOGGER(LINFO_, "Initialized Playready Secure Clock success.");
-
-    /* NOW testing the system time */
 
-ErrorExit:
-    SAFE_OEM_FREE(pbChallenge);
-    SAFE_OEM_FREE(pTimeChallengeURL);
-    SAFE_OEM_FREE(pbResponse);
-
-    return rc;
+    return retry;
 }
 
 void MediaKeySession::CleanLicenseStore(DRM_APP_CONTEXT *pDrmAppCtx){
@@ -993,11 +1376,26 @@ void MediaKeySession::CleanLicenseStore(DRM_APP_CONTEXT *pDrmAppCtx){
         if (DRM_FAILED(dr) && (dr != DRM_E_NOMORE)) {
             LOGGER(LERROR_, "Error in Drm_StoreMgmt_DeleteInMemoryLicenses 0x%08lX", dr);
         }
+
+        // The store may have been recreated meanwhile, taking our licenses along.
+        LicenseStoreUsage& usage = *(mEnvironment.licenseStore);
+        usage.licenses -= std::min(usage.licenses, mInMemoryLicenses);
+        mInMemoryLicenses = 0;
     }
 }
 
 void MediaKeySession::CleanDecryptContexts()
 {
+    if ((mDecryptContextHits + mDecryptContextMisses) > 0) {
+        LOGGER(LINFO_, "Decrypt contexts: %u hits, %u misses, %u evictions",
+            mDecryptContextHits, mDecryptContextMisses, mDecryptContextEvictions);
+        mDecryptContextHits = 0;
+        mDecryptContextMisses = 0;
+        mDecryptContextEvictions = 0;
+    }
+
+    ReleaseDecryptContext();
+
     if (mDecryptContextMap.size() > 0){
         m_oDecryptContext = nullptr;
         // Close all decryptors that were created on this session
@@ -1010,13 +1408,26 @@ void MediaKeySession::CleanDecryptContexts()
         }
         mDecryptContextMap.clear();
     }
+}
 
-    if (m_oDecryptContext != nullptr) {
-        LOGGER(LINFO_, "Closing active decrypt context");
-        Drm_Reader_Close(m_oDecryptContext);
-        delete m_oDecryptContext;
-        m_oDecryptContext = nullptr;
+// The active decrypt context is either one of the map, closed along with it,
+// or the one allocated by the constructor or BindSession, which is ours to free.
+void MediaKeySession::ReleaseDecryptContext()
+{
+    if (m_oDecryptContext == nullptr) {
+        return;
     }
+
+    for (DecryptContextMap::const_iterator it = mDecryptContextMap.begin(); it != mDecryptContextMap.end(); ++it) {
+        if ((it->second) && (&(it->second->drmDecryptContext) == m_oDecryptContext)) {
+            return;
+        }
+    }
+
+    LOGGER(LINFO_, "Closing active decrypt context");
+    Drm_Reader_Close(m_oDecryptContext);
+    delete m_oDecryptContext;
+    m_oDecryptContext = nullptr;
 }
 
 }  // namespace CDMi
@@ -17,7 +17,15 @@
 #pragma once
 
 #include "cdmi.h"
+#include "BackgroundWorker.h"
+#include "CallbackDispatcher.h"
+#include "SecureClock.h"
+#include "StoreMaintenance.h"
+#include "Tuning.h"
 #include <core/core.h>
+#include <chrono>
+#include <map>
+#include <memory>
 #include <vector>
 
 #include <nexus_config.h>
@@ -46,6 +54,9 @@ enum LogLevel {
 const DRM_DWORD LICENSE_SIZE_BYTES = 512;  // max possible license size (ask the server team)
 const DRM_DWORD MAX_NUM_LICENSES = 200;    // max number of licenses (ask the RefApp team)
 
+// ~100 KB to start * 64 (2^6) ~= 6.4 MB, don't allocate more than ~6.4 MB
+#define DRM_MAXIMUM_APPCONTEXT_OPAQUE_BUFFER_SIZE ( 64 * MINIMUM_APPCONTEXT_OPAQUE_BUFFER_SIZE )
+
 #define LOGGER(lvl, fmt , ... )    \
         do{ \
             fprintf(stdout, "\033[1;%dm[%s:%d](%s){object=%p} " fmt "\n\033[0m", lvl, __FILE__, __LINE__, __FUNCTION__, this, ##__VA_ARGS__);    \
@@ -66,6 +77,92 @@ struct OutputProtection {
 };
 namespace CDMi {
 
+// License challenge and silent URL buffers, shared by all sessions and grown
+// to the largest challenge generated so far (including a terminating zero).
+// Only to be used with the DRM app context lock held.
+struct ChallengeBuffers {
+    ChallengeBuffers()
+        : challenge(1, 0)
+        , silentURL(1, 0)
+    {
+    }
+
+    std::vector<DRM_BYTE> challenge;
+    std::vector<DRM_CHAR> silentURL;
+};
+
+// Opaque buffer of the system wide DRM app context. Sessions grow it when a
+// bind reports it is too small. Only to be used with the DRM app context lock
+// held.
+struct OpaqueBuffer {
+    OpaqueBuffer()
+        : buffer(nullptr)
+        , size(0)
+    {
+    }
+
+    DRM_BYTE* buffer;
+    DRM_DWORD size;
+};
+
+// Use of the in-memory license store of the system wide DRM app context, as
+// far as the sessions can tell, PlayReady does not report it. Only to be used
+// with the DRM app context lock held.
+struct LicenseStoreUsage {
+    LicenseStoreUsage()
+        : capacity(0)
+        , licenses(0)
+        , peak(0)
+        , resizes(0)
+    {
+    }
+
+    // Bytes reserved for the store, PlayReady doubles it when it runs out.
+    DRM_DWORD capacity;
+    // Licenses the sessions hold at the moment, and the most held at once.
+    DRM_DWORD licenses;
+    DRM_DWORD peak;
+    // Times the store must have been grown since it was created.
+    uint32_t resizes;
+};
+
+// System wide facilities the PlayReady system hands to each of its sessions.
+struct SessionEnvironment {
+    SessionEnvironment()
+        : prefetchWorker(nullptr)
+        , maxDecryptContexts(0)
+        , dispatcher(nullptr)
+        , challengeBuffers(nullptr)
+        , opaqueBuffer(nullptr)
+        , tuning(nullptr)
+        , licenseStore(nullptr)
+        , sessionRecordPath()
+        , secureClock(nullptr)
+        , storeMaintenance(nullptr)
+    {
+    }
+
+    // Binds decrypt contexts for newly licensed keys ahead of SelectKeyId.
+    // Prefetching is disabled when not set.
+    BackgroundWorker* prefetchWorker;
+    // Maximum number of bound decrypt contexts per session, the least
+    // recently selected ones are closed beyond this. 0 means no limit.
+    uint32_t maxDecryptContexts;
+    // All session callbacks are delivered through this, never directly.
+    CallbackDispatcher* dispatcher;
+    ChallengeBuffers* challengeBuffers;
+    OpaqueBuffer* opaqueBuffer;
+    // Records the opaque buffer and license store high-water marks for the
+    // next start.
+    Tuning* tuning;
+    LicenseStoreUsage* licenseStore;
+    // Directory holding a record (the init data) of every persistent-license
+    // session, named after the session ID.
+    std::string sessionRecordPath;
+    SecureClock* secureClock;
+    // Told about DRM use and store growth, and cleans up a full store.
+    StoreMaintenance* storeMaintenance;
+};
 
 class MediaKeySession : public IMediaKeySession, public IMediaKeySessionExt {
 private:
@@ -92,8 +189,13 @@ public:
     {
         DRM_DECRYPT_CONTEXT drmDecryptContext;
         OutputProtection outputProtection;
+        // outputProtection serialized for the "properties" key message, built
+        // once when the license policy is evaluated on bind.
+        std::shared_ptr<const std::string> properties;
         IMediaKeySessionCallback* callback;
-        DecryptContext(IMediaKeySessionCallback* mcallback);
+        CallbackDispatcher* dispatcher;
+        uint64_t lastUse;
+        DecryptContext(IMediaKeySessionCallback* mcallback, CallbackDispatcher* mdispatcher);
     };
     typedef std::map<std::vector<uint8_t>, std::shared_ptr<DecryptContext> > DecryptContextMap;
 
@@ -102,11 +204,16 @@ public:
     MediaKeySession(
         const uint8_t *f_pbInitData, uint32_t f_cbInitData, 
         const uint8_t *f_pbCDMData, uint32_t f_cbCDMData, 
-        DRM_VOID *f_pOEMContext, DRM_APP_CONTEXT * poAppContext);
+        DRM_VOID *f_pOEMContext, DRM_APP_CONTEXT * poAppContext,
+        const bool persistent,
+        const SessionEnvironment& environment);
    
     ~MediaKeySession();
     bool playreadyGenerateKeyRequest();
     bool ready() const { return m_eKeyState == KEY_READY; }
+    // Names the persistent session Load() restores. Without it, Load() looks
+    // for the session by the init data.
+    void SessionToLoad(const std::string& sessionId) { mLoadSessionId = sessionId; }
 
 // MediaKeySession overrides
     virtual void Run(
@@ -154,11 +261,45 @@ public:
     virtual CDMi_RESULT CleanDecryptContext() override;
 
 private:
+    // What is kept of a "persistent-license" session, so it can be loaded
+    // again later.
+    struct SessionRecord {
+        std::string sessionId;
+        std::vector<uint8_t> initData;
+        // Keys licensed to the session, in PlayReady format.
+        std::vector<std::vector<uint8_t> > keyIds;
+    };
 
-    bool LoadRevocationList(const char *revListFile);
+
+    void SetCallback(IMediaKeySessionCallback *callback);
+    IMediaKeySessionCallback* SwapCallback(IMediaKeySessionCallback *callback);
 
     void CleanLicenseStore(DRM_APP_CONTEXT *pDrmAppCtx);
     void CleanDecryptContexts();
+    void ReleaseDecryptContext();
+
+    DRM_RESULT ProcessLicenseResponse(const uint8_t response[], const uint32_t responseLength, DRM_LICENSE_RESPONSE& licenseResponse, std::vector<DRM_LICENSE_ACK>& acks);
+    static inline const DRM_LICENSE_ACK* LicenseAcks(const DRM_LICENSE_RESPONSE& licenseResponse)
+    {
+        return (licenseResponse.m_pAcks != nullptr) ? licenseResponse.m_pAcks : licenseResponse.m_rgoAcks;
+    }
+    static bool StoreFull(const DRM_RESULT dr, const DRM_LICENSE_RESPONSE& licenseResponse);
+    static std::vector<std::vector<uint8_t> > LicensedKeyIds(const DRM_LICENSE_RESPONSE& licenseResponse);
+    void ReportUsableKeys(const DRM_LICENSE_RESPONSE& licenseResponse);
+    void ReportKeyStatus(const char status[], const std::vector<std::vector<uint8_t> >& keyIds);
+    bool WaitForSecureClock(const DRM_RESULT dr) const;
+    void AddInMemoryLicenses(const DRM_DWORD count);
+
+    DRM_RESULT BindSession();
+    DRM_RESULT ReaderBind(const DRM_CONST_STRING* rights[], const DRM_DWORD rightsCount, DRMPFNPOLICYCALLBACK policyCallback, const DRM_VOID* policyCallbackData, DRM_DECRYPT_CONTEXT* decryptContext);
+    DRM_RESULT GrowOpaqueBuffer();
+
+    DRM_RESULT ApplyInitData(const uint8_t initData[], const uint32_t initDataLength);
+    DRM_RESULT SelectSessionHeader();
+    std::string SessionRecordFile(const std::string& sessionId) const;
+    bool SaveSessionRecord() const;
+    bool FindSessionRecord(SessionRecord& record) const;
+    static bool ParseSessionRecord(const uint8_t data[], const size_t length, SessionRecord& record);
 
     static DRM_RESULT PolicyCallback(
             const DRM_VOID *f_pvOutputLevelsData,
@@ -167,7 +308,6 @@ private:
             const DRM_LID *f_pLID,
             const DRM_VOID *f_pv);
 
-    int InitSecureClock(DRM_APP_CONTEXT *pDrmAppCtx);
     inline void PrintBase64(const int32_t length, const uint8_t* data, const char id[])
     {
         std::string base64, hex;
@@ -187,13 +327,18 @@ private:
     }
     CDMi_RESULT SetKeyId(DRM_APP_CONTEXT *pDrmAppCtx, const uint8_t keyLength, const uint8_t keyId[]);
     CDMi_RESULT SelectDrmHeader(DRM_APP_CONTEXT *pDrmAppCtx, const uint32_t headerLength, const uint8_t header[]);
+    CDMi_RESULT SelectDecryptContext(const uint8_t keyLength, const uint8_t keyId[], DRM_RESULT& err);
+    DRM_RESULT BindDecryptContext(const std::vector<uint8_t>& keyId, IMediaKeySessionCallback* callback, std::shared_ptr<DecryptContext>& decryptContext);
+    void PrefetchDecryptContexts(const std::vector<std::vector<uint8_t> >& keyIds);
+    void PrefetchDecryptContext(const std::vector<uint8_t>& keyId);
+    void EvictDecryptContexts(const uint32_t freeSlots);
+    inline void TouchDecryptContext(DecryptContext& decryptContext)
+    {
+        decryptContext.lastUse = ++mDecryptContextClock;
+    }
 private:
     DRM_APP_CONTEXT *m_poAppContext;
     DRM_DECRYPT_CONTEXT *   m_oDecryptContext; 
-    DRM_BYTE *m_pbOpaqueBuffer;
-    DRM_DWORD m_cbOpaqueBuffer;
-
-    DRM_BYTE *m_pbRevocationBuffer;
 
     std::string m_customData;
 
@@ -204,12 +349,35 @@ private:
     DRM_VOID *m_pOEMContext;
 
     std::vector<uint8_t> mDrmHeader;
+    // Session of the "persistent-license" type: its licenses go to the HDS
+    // store and it can be loaded again later.
+    bool m_fPersistent;
     uint32_t m_SessionId;
     DRM_ID mBatchId;
+    // Licenses this session added to the in-memory license store.
+    DRM_DWORD mInMemoryLicenses;
 
     bool m_decryptInited;
 
     DecryptContextMap mDecryptContextMap;
+    uint64_t mDecryptContextClock;
+    uint32_t mDecryptContextHits;
+    uint32_t mDecryptContextMisses;
+    uint32_t mDecryptContextEvictions;
+
+    SessionEnvironment mEnvironment;
+    // KIDs listed in a v1 PSSH box of the init data, in PlayReady format.
+    std::vector<std::vector<uint8_t> > mInitDataKeyIds;
+    // Keys licensed to a "persistent-license" session, in PlayReady format.
+    std::vector<std::vector<uint8_t> > mSessionKeyIds;
+    std::string mLoadSessionId;
+    // Cleared (under drmAppContextMutex_) when the session closes, so queued
+    // prefetch jobs know the session is gone.
+    std::shared_ptr<bool> mAlive;
+    // Challenge generated by a GetChallengeDataExt sizing call, handed out by
+    // the call that passes the buffer, unless that comes too late.
+    std::vector<uint8_t> mPendingChallenge;
+    std::chrono::steady_clock::time_point mPendingChallengeTime;
 
     void *pNexusMemory;
     uint32_t mNexusMemorySize;
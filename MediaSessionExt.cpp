@@ -34,61 +34,33 @@ extern WPEFramework::Core::CriticalSection drmAppContextMutex_;
 namespace CDMi {
 const DRM_CONST_STRING  *g_rgpdstrRightsExt[1] = {&g_dstrWMDRM_RIGHT_PLAYBACK};
 
-struct CallbackInfo
-{
-    IMediaKeySessionCallback * _callback;
-    uint16_t _compressedVideo;
-    uint16_t _uncompressedVideo;
-    uint16_t _analogVideo;
-    uint16_t _compressedAudio;
-    uint16_t _uncompressedAudio;
-    uint32_t _maxDecodeWidth;
-    uint32_t _maxDecodeHeight;
-};
-
-static void * PlayLevelUpdateCallback(void * data)
-{
-    CallbackInfo * callbackInfo = static_cast<CallbackInfo *>(data);
+// A challenge generated by a sizing call that is not picked up within this
+// time is thrown away. Its nonce may be gone from the nonce store by then.
+static const uint32_t PENDING_CHALLENGE_TTL_MS = 60000;
 
+static std::shared_ptr<const std::string> SerializeOutputProtection(const OutputProtection& outputProtection)
+{
     std::stringstream keyMessage;
     keyMessage << "{";
-    keyMessage << "\"compressed-video\": " << callbackInfo->_compressedVideo << ",";
-    keyMessage << "\"uncompressed-video\": " << callbackInfo->_uncompressedVideo << ",";
-    keyMessage << "\"analog-video\": " << callbackInfo->_analogVideo << ",";
-    keyMessage << "\"compressed-audio\": " << callbackInfo->_compressedAudio << ",";
-    keyMessage << "\"uncompressed-audio\": " << callbackInfo->_uncompressedAudio << ",";
-    keyMessage << "\"max-decode-width\": " << callbackInfo->_maxDecodeWidth << ",";
-    keyMessage << "\"max-decode-height\": " << callbackInfo->_maxDecodeHeight;
+    keyMessage << "\"compressed-video\": " << outputProtection.compressedDigitalVideoLevel << ",";
+    keyMessage << "\"uncompressed-video\": " << outputProtection.uncompressedDigitalVideoLevel << ",";
+    keyMessage << "\"analog-video\": " << outputProtection.analogVideoLevel << ",";
+    keyMessage << "\"compressed-audio\": " << outputProtection.compressedDigitalAudioLevel << ",";
+    keyMessage << "\"uncompressed-audio\": " << outputProtection.uncompressedDigitalAudioLevel << ",";
+    keyMessage << "\"max-decode-width\": " << outputProtection.maxResDecodeWidth << ",";
+    keyMessage << "\"max-decode-height\": " << outputProtection.maxResDecodeHeight;
     keyMessage << "}";
 
-    std::string keyMessageStr = keyMessage.str();
-    const uint8_t * messageBytes = reinterpret_cast<const uint8_t *>(keyMessageStr.c_str());
-
-    char urlBuffer[64];
-    strcpy(urlBuffer, "properties");
-    callbackInfo->_callback->OnKeyMessage(messageBytes, keyMessageStr.length() + 1, urlBuffer);
-
-    delete callbackInfo;
-    return nullptr;
+    return std::make_shared<const std::string>(keyMessage.str());
 }
 
 void UpdateSession(const MediaKeySession::DecryptContext* decryptContext)
 {
-    if (decryptContext->callback != nullptr) {
-        CallbackInfo * callbackInfo = new CallbackInfo;
-        callbackInfo->_callback = const_cast<IMediaKeySessionCallback *>(decryptContext->callback);
-        callbackInfo->_compressedVideo = decryptContext->outputProtection.compressedDigitalVideoLevel;
-        callbackInfo->_uncompressedVideo = decryptContext->outputProtection.uncompressedDigitalVideoLevel;
-        callbackInfo->_analogVideo = decryptContext->outputProtection.analogVideoLevel;
-        callbackInfo->_compressedAudio = decryptContext->outputProtection.compressedDigitalAudioLevel;
-        callbackInfo->_uncompressedAudio = decryptContext->outputProtection.uncompressedDigitalAudioLevel;
-        callbackInfo->_maxDecodeWidth = decryptContext->outputProtection.maxResDecodeWidth;
-        callbackInfo->_maxDecodeHeight = decryptContext->outputProtection.maxResDecodeHeight;
-
-        // Run on a new thread, so we don't go too deep in the IPC callstack.
-        pthread_t threadId;
-        pthread_create(&threadId, nullptr, PlayLevelUpdateCallback, callbackInfo);
-    } 
+    if ((decryptContext->callback != nullptr) && (decryptContext->properties)) {
+        // Delivered from the dispatcher thread, so we don't go too deep in the
+        // IPC callstack.
+        decryptContext->dispatcher->Properties(decryptContext->callback, decryptContext->properties);
+    }
 }
 
 DRM_RESULT opencdm_output_levels_callback(
@@ -134,6 +106,8 @@ DRM_RESULT opencdm_output_levels_callback(
         }
     }
     
+    decryptContext->properties = SerializeOutputProtection(decryptContext->outputProtection);
+
     UpdateSession(decryptContext);
 
     // All done.
@@ -147,6 +121,11 @@ uint32_t MediaKeySession::GetSessionIdExt() const
 
 CDMi_RESULT MediaKeySession::SetDrmHeader(const uint8_t drmHeader[], uint32_t drmHeaderLength)
 {
+    SafeCriticalSection systemLock(drmAppContextMutex_);
+
+    // A challenge generated for the previous header is of no use anymore.
+    mPendingChallenge.clear();
+
     mDrmHeader.resize(drmHeaderLength);
     memcpy(&mDrmHeader[0], drmHeader, drmHeaderLength);
     return CDMi_SUCCESS;
@@ -154,9 +133,6 @@ CDMi_RESULT MediaKeySession::SetDrmHeader(const uint8_t drmHeader[], uint32_t dr
 
 CDMi_RESULT MediaKeySession::StoreLicenseData(const uint8_t licenseData[], uint32_t licenseDataSize, uint8_t * secureStopId)
 {
-    // open scope for DRM_APP_CONTEXT mutex
-    SafeCriticalSection systemLock(drmAppContextMutex_);
-
     //const std::string licStr(licenseData.begin(), licenseData.end());
     //LOGGER(LINFO_, "\n%s", licStr.c_str());
 
@@ -167,38 +143,28 @@ CDMi_RESULT MediaKeySession::StoreLicenseData(const uint8_t licenseData[], uint3
     // how many licenses are in the response data.
     //
     DRM_LICENSE_RESPONSE drmLicenseResponse;
-    // MUST zero the input DRM_LICENSE_RESPONSE struct!
-    ZEROMEM(&drmLicenseResponse, sizeof(DRM_LICENSE_RESPONSE));
+    std::vector<DRM_LICENSE_ACK> drmLicenseAcks;
     DRM_RESULT err;
-    // Non-persistent licenses (the kind in use) have no signature, so the
-    // LIC_RESPONSE_SIGNATURE_NOT_REQUIRED flag must be used.
-    err = Drm_LicenseAcq_ProcessResponse(
-            m_poAppContext,
-            DRM_PROCESS_LIC_RESPONSE_SIGNATURE_NOT_REQUIRED,
-            &licenseData[0],
-            (DRM_DWORD)licenseDataSize,
-            &drmLicenseResponse);
+    {
+        SafeCriticalSection systemLock(drmAppContextMutex_);
+        err = ProcessLicenseResponse(licenseData, licenseDataSize, drmLicenseResponse, drmLicenseAcks);
+    }
+    if (WaitForSecureClock(err) == true) {
+        SafeCriticalSection systemLock(drmAppContextMutex_);
+        err = ProcessLicenseResponse(licenseData, licenseDataSize, drmLicenseResponse, drmLicenseAcks);
+    }
+
+    // open scope for DRM_APP_CONTEXT mutex
+    SafeCriticalSection systemLock(drmAppContextMutex_);
+
+    const DRM_LICENSE_ACK* const licenseAcks = LicenseAcks(drmLicenseResponse);
 
     if((m_piCallback != nullptr) && DRM_SUCCEEDED(err)) {
-        for (uint8_t i = 0; i < drmLicenseResponse.m_cAcks; ++i) {
-            if (DRM_SUCCEEDED(drmLicenseResponse.m_rgoAcks[i].m_dwResult)) {
-                ToggleKeyIdFormat(DRM_ID_SIZE, drmLicenseResponse.m_rgoAcks[i].m_oKID.rgb);
-                m_piCallback->OnKeyStatusUpdate("KeyUsable", drmLicenseResponse.m_rgoAcks[i].m_oKID.rgb, DRM_ID_SIZE);
-            }
-        }
-        m_piCallback->OnKeyStatusesUpdated();
+        ReportUsableKeys(drmLicenseResponse);
     }
 
     // First, check the return code of Drm_LicenseAcq_ProcessResponse()
-    if (err ==  DRM_E_LICACQ_TOO_MANY_LICENSES) {
-        // This means the server response contained more licenses than
-        // DRM_MAX_LICENSE_ACK (usually 20). Should allocate space and retry.
-        // FIXME NRDLIB-4481: This will need to be implemented when we start
-        // using batch license requests.
-        LOGGER(LERROR_, "Drm_LicenseAcq_ProcessResponse too many licenses in response.");
-        return CDMi_S_FALSE;
-    }
-    else if (DRM_FAILED(err)) {
+    if (DRM_FAILED(err)) {
         LOGGER(LERROR_, "Drm_LicenseAcq_ProcessResponse failed (error: 0x%08X)", static_cast<unsigned int>(err));
         return CDMi_S_FALSE;
     }
@@ -210,28 +176,14 @@ CDMi_RESULT MediaKeySession::StoreLicenseData(const uint8_t licenseData[], uint3
     }
 
     // Finally, ensure that each license in the response was processed
-    // successfully.
+    // successfully. A full store was already cleaned up and retried by
+    // ProcessLicenseResponse.
     const DRM_DWORD nLicenses = drmLicenseResponse.m_cAcks;
-    for (uint32_t i=0; i < nLicenses; ++i)
+    for (DRM_DWORD i=0; i < nLicenses; ++i)
     {
         LOGGER(LINFO_, "Checking license %d", i);
-        if (DRM_FAILED(drmLicenseResponse.m_rgoAcks[i].m_dwResult)) {
-            // Special handling for DRM_E_DST_STORE_FULL. If this error is
-            // detected for any license, reset the DRM appcontext and return error.
-            if (drmLicenseResponse.m_rgoAcks[i].m_dwResult == DRM_E_DST_STORE_FULL) {
-                LOGGER(LINFO_, "Found DRM_E_DST_STORE_FULL error in license %d, reinitializing!", i);
-                
-                err = Drm_Reinitialize(m_poAppContext);
-                if (DRM_FAILED(err))
-                {
-                    LOGGER(LERROR_, "Error: Drm_Reinitialize returned (error: 0x%08X)", static_cast<unsigned int>(err));
-                    return CDMi_S_FALSE;
-                }
-
-            }
-            else {
-                LOGGER(LERROR_, "Error 0x%08lX found in license %d", (unsigned long)drmLicenseResponse.m_rgoAcks[i].m_dwResult, i);
-            }
+        if (DRM_FAILED(licenseAcks[i].m_dwResult)) {
+            LOGGER(LERROR_, "Error 0x%08lX found in license %d", (unsigned long)licenseAcks[i].m_dwResult, i);
             return CDMi_S_FALSE;
         }
     }
@@ -269,25 +221,40 @@ CDMi_RESULT MediaKeySession::StoreLicenseData(const uint8_t licenseData[], uint3
 
     // KID and LID
     LOGGER(LINFO_, "Found %d license%s in server response for :", nLicenses, (nLicenses > 1) ? "s" : "");
-    for (uint32_t i=0; i < nLicenses; ++i)
+    for (DRM_DWORD i=0; i < nLicenses; ++i)
     {
-        const DRM_LICENSE_ACK * const licAck = &drmLicenseResponse.m_rgoAcks[i];
+        const DRM_LICENSE_ACK * const licAck = &licenseAcks[i];
         LOGGER(LINFO_, "KID/LID[%d]:", i);
         PrintBase64(sizeof(licAck->m_oLID.rgb), licAck->m_oLID.rgb, "LID");
         PrintBase64(sizeof(licAck->m_oKID.rgb), licAck->m_oKID.rgb, "KID");
     }
 
+    PrefetchDecryptContexts(LicensedKeyIds(drmLicenseResponse));
+
     return CDMi_SUCCESS;
 }
 
 CDMi_RESULT MediaKeySession::SelectKeyId(const uint8_t keyLength, const uint8_t keyId[])
+{
+    DRM_RESULT err = DRM_SUCCESS;
+
+    // A license that needs secure time does not bind before the secure clock
+    // is set. As in Update(), wait for it without the DRM lock and retry.
+    CDMi_RESULT result = SelectDecryptContext(keyLength, keyId, err);
+    if ((result != CDMi_SUCCESS) && (WaitForSecureClock(err) == true)) {
+        result = SelectDecryptContext(keyLength, keyId, err);
+    }
+
+    return result;
+}
+
+CDMi_RESULT MediaKeySession::SelectDecryptContext(const uint8_t keyLength, const uint8_t keyId[], DRM_RESULT& err)
 {
     // open scope for DRM_APP_CONTEXT mutex
     SafeCriticalSection systemLock(drmAppContextMutex_);
     ASSERT(m_poAppContext != nullptr);
     ASSERT(keyLength == DRM_ID_SIZE);
     
-    DRM_RESULT err;
     uint8_t keyParam[keyLength];
     CDMi_RESULT result = CDMi_SUCCESS;
     // Seems like we no longer have to worry about invalid app context, make sure with this ASSERT.
@@ -302,55 +269,32 @@ CDMi_RESULT MediaKeySession::SelectKeyId(const uint8_t keyLength, const uint8_t
     // switch from CENC to PlayReady format
     if ((index != mDecryptContextMap.end()) && (index->second.get())) {
 
-        PrintBase64(sizeof(keyIdVec), &keyIdVec[0], 
+        PrintBase64(keyIdVec.size(), &keyIdVec[0], 
                         "Found existing decrypt context for keyId");
+        ++mDecryptContextHits;
+        TouchDecryptContext(*(index->second));
+        ReleaseDecryptContext();
         m_oDecryptContext = &(index->second->drmDecryptContext);
         UpdateSession(index->second.get());
     }
     else {
-        if (SelectDrmHeader(m_poAppContext, mDrmHeader.size(), &mDrmHeader[0]) != CDMi_SUCCESS){
-        return CDMi_S_FALSE;
-        }
+        ++mDecryptContextMisses;
 
-        if (SetKeyId(m_poAppContext, sizeof(keyParam), keyParam) != CDMi_SUCCESS){
-            return CDMi_S_FALSE;
-        }
-
-        std::shared_ptr<DecryptContext> newDecryptContext(new DecryptContext(m_piCallback));
-
-        LOGGER(LINFO_, "Drm_Reader_Bind");
-        err = Drm_Reader_Bind(
-                m_poAppContext,
-                g_rgpdstrRightsExt,
-                DRM_NO_OF(g_rgpdstrRightsExt),
-                &opencdm_output_levels_callback, 
-                static_cast<const void*>(newDecryptContext.get()),
-                &(newDecryptContext->drmDecryptContext));
-        if (DRM_FAILED(err))
-        {
-            LOGGER(LERROR_, "Error: Drm_Reader_Bind (error: 0x%08X)", static_cast<unsigned int>(err));
-            return CDMi_S_FALSE;
-        }
+        // Make room first, the bind needs a free key slot in the TEE.
+        EvictDecryptContexts(1);
 
-        // Commit all secure store transactions to the DRM store file. For the
-        // Netflix use case, Drm_Reader_Commit only needs to be called after
-        // Drm_Reader_Bind.
-        LOGGER(LINFO_,"Drm_Reader_Commit");
-        err = Drm_Reader_Commit(m_poAppContext, &opencdm_output_levels_callback, static_cast<const void*>(newDecryptContext.get()));
-        if (DRM_FAILED(err))
-        {
-            LOGGER(LERROR_, "Error: Drm_Reader_Commit (error: 0x%08X)", static_cast<unsigned int>(err));
+        std::shared_ptr<DecryptContext> newDecryptContext;
+        err = BindDecryptContext(keyIdVec, m_piCallback, newDecryptContext);
+        if (DRM_FAILED(err)) {
             return CDMi_S_FALSE;
         }
 
         // Save the new decryption context to our member map, and make it the
         // active one.
-        if (index != mDecryptContextMap.end()) {
-            index->second = newDecryptContext;
-        } else {
-            mDecryptContextMap.insert(std::make_pair(keyIdVec, newDecryptContext));
-        }
+        TouchDecryptContext(*newDecryptContext);
+        mDecryptContextMap[keyIdVec] = newDecryptContext;
         
+        ReleaseDecryptContext();
         m_oDecryptContext =  &(newDecryptContext->drmDecryptContext);  
     }
     
@@ -363,8 +307,143 @@ CDMi_RESULT MediaKeySession::SelectKeyId(const uint8_t keyLength, const uint8_t
     return result;
 }
 
+DRM_RESULT MediaKeySession::BindDecryptContext(const std::vector<uint8_t>& keyId, IMediaKeySessionCallback* callback, std::shared_ptr<DecryptContext>& decryptContext)
+{
+    DRM_RESULT err;
+
+    if (SelectDrmHeader(m_poAppContext, mDrmHeader.size(), &mDrmHeader[0]) != CDMi_SUCCESS){
+        return DRM_E_FAIL;
+    }
+
+    if (SetKeyId(m_poAppContext, keyId.size(), &keyId[0]) != CDMi_SUCCESS){
+        return DRM_E_FAIL;
+    }
+
+    std::shared_ptr<DecryptContext> newDecryptContext(new DecryptContext(callback, mEnvironment.dispatcher));
+
+    LOGGER(LINFO_, "Drm_Reader_Bind");
+    err = ReaderBind(
+            g_rgpdstrRightsExt,
+            DRM_NO_OF(g_rgpdstrRightsExt),
+            &opencdm_output_levels_callback,
+            static_cast<const void*>(newDecryptContext.get()),
+            &(newDecryptContext->drmDecryptContext));
+    if (DRM_FAILED(err))
+    {
+        LOGGER(LERROR_, "Error: Drm_Reader_Bind (error: 0x%08X)", static_cast<unsigned int>(err));
+        return err;
+    }
+
+    // Commit all secure store transactions to the DRM store file. For the
+    // Netflix use case, Drm_Reader_Commit only needs to be called after
+    // Drm_Reader_Bind. It acts on the last bind of the app context, so it
+    // has to follow right after, under the same lock.
+    LOGGER(LINFO_,"Drm_Reader_Commit");
+    err = Drm_Reader_Commit(m_poAppContext, &opencdm_output_levels_callback, static_cast<const void*>(newDecryptContext.get()));
+    if (DRM_FAILED(err))
+    {
+        LOGGER(LERROR_, "Error: Drm_Reader_Commit (error: 0x%08X)", static_cast<unsigned int>(err));
+        Drm_Reader_Close(&(newDecryptContext->drmDecryptContext));
+        return err;
+    }
+
+    decryptContext = newDecryptContext;
+    return err;
+}
+
+void MediaKeySession::PrefetchDecryptContexts(const std::vector<std::vector<uint8_t> >& keyIds)
+{
+    if (mEnvironment.prefetchWorker == nullptr) {
+        return;
+    }
+
+    // One job per key, so the app context lock is released in between and
+    // the playback path never waits for more than a single bind.
+    std::shared_ptr<bool> alive(mAlive);
+    for (std::vector<std::vector<uint8_t> >::const_iterator index = keyIds.begin(); index != keyIds.end(); ++index) {
+        if (mDecryptContextMap.find(*index) != mDecryptContextMap.end()) {
+            continue;
+        }
+
+        const std::vector<uint8_t> keyId(*index);
+        mEnvironment.prefetchWorker->Submit([this, alive, keyId]() {
+            SafeCriticalSection systemLock(drmAppContextMutex_);
+            if (*alive == true) {
+                PrefetchDecryptContext(keyId);
+            }
+        });
+    }
+}
+
+void MediaKeySession::PrefetchDecryptContext(const std::vector<uint8_t>& keyId)
+{
+    // Must be called with drmAppContextMutex_ taken.
+    if (mDecryptContextMap.find(keyId) != mDecryptContextMap.end()) {
+        return;
+    }
+
+    // Speculative binds only use free slots, they never push out a key that
+    // was actually selected.
+    if ((mEnvironment.maxDecryptContexts != 0) && (mDecryptContextMap.size() >= mEnvironment.maxDecryptContexts)) {
+        PrintBase64(keyId.size(), &keyId[0], "No free decrypt context to prefetch keyId");
+        return;
+    }
+
+    // Bind without a session callback: the output protection levels of a key
+    // are announced when SelectKeyId makes it the active one, not before.
+    // Only keys licensed by a response get here.
+    std::shared_ptr<DecryptContext> newDecryptContext;
+    if (DRM_FAILED(BindDecryptContext(keyId, nullptr, newDecryptContext))) {
+        PrintBase64(keyId.size(), &keyId[0], "Could not prefetch decrypt context for keyId");
+        return;
+    }
+
+    newDecryptContext->callback = m_piCallback;
+    TouchDecryptContext(*newDecryptContext);
+    mDecryptContextMap.insert(std::make_pair(keyId, newDecryptContext));
+    PrintBase64(keyId.size(), &keyId[0], "Prefetched decrypt context for keyId");
+}
+
+void MediaKeySession::EvictDecryptContexts(const uint32_t freeSlots)
+{
+    const uint32_t limit = mEnvironment.maxDecryptContexts;
+    if (limit == 0) {
+        return;
+    }
+
+    while ((mDecryptContextMap.size() + freeSlots) > limit) {
+        // Least recently selected, the active context is never a candidate.
+        DecryptContextMap::iterator coldest = mDecryptContextMap.end();
+        for (DecryptContextMap::iterator it = mDecryptContextMap.begin(); it != mDecryptContextMap.end(); ++it) {
+            if (!it->second) {
+                coldest = it;
+                break;
+            }
+            if ((&(it->second->drmDecryptContext) != m_oDecryptContext) &&
+                ((coldest == mDecryptContextMap.end()) || (it->second->lastUse < coldest->second->lastUse))) {
+                coldest = it;
+            }
+        }
+
+        if (coldest == mDecryptContextMap.end()) {
+            break;
+        }
+
+        PrintBase64(DRM_ID_SIZE, &coldest->first[0], "Evicting decrypt context for keyId");
+        if (coldest->second) {
+            Drm_Reader_Close(&(coldest->second->drmDecryptContext));
+        }
+        mDecryptContextMap.erase(coldest);
+        ++mDecryptContextEvictions;
+    }
+}
+
 CDMi_RESULT MediaKeySession::CancelChallengeDataExt()
 {
+    SafeCriticalSection systemLock(drmAppContextMutex_);
+
+    mPendingChallenge.clear();
+
     return CDMi_SUCCESS;
 }
 
@@ -387,47 +466,92 @@ CDMi_RESULT MediaKeySession::GetChallengeDataExt(uint8_t * challenge, uint32_t &
         return CDMi_S_FALSE;
     }
 
-    DRM_RESULT err;
+    // Callers first ask for the size and then pass a buffer. Generating the
+    // challenge is expensive and every challenge takes a slot in the nonce
+    // store, so it is generated once, on the first call, and kept until it
+    // has been copied out.
+    if ((mPendingChallenge.empty() == false) &&
+        ((std::chrono::steady_clock::now() - mPendingChallengeTime) > std::chrono::milliseconds(PENDING_CHALLENGE_TTL_MS))) {
+        LOGGER(LINFO_, "Pending challenge expired, generating a new one");
+        mPendingChallenge.clear();
+    }
 
-    // Seems like we no longer have to worry about invalid app context, make sure with this ASSERT.
-    ASSERT(m_poAppContext != nullptr);
+    if (mPendingChallenge.empty() == true) {
+        DRM_RESULT err;
 
-    // Set this session's DMR header in the PR3 app context.
-     if (SelectDrmHeader(m_poAppContext, mDrmHeader.size(), &mDrmHeader[0]) != CDMi_SUCCESS){
-        return CDMi_S_FALSE;
-    }
+        // Seems like we no longer have to worry about invalid app context, make sure with this ASSERT.
+        ASSERT(m_poAppContext != nullptr);
 
-    // PlayReady doesn't like valid pointer + size 0
-    DRM_BYTE* passedChallenge = static_cast<DRM_BYTE*>(challenge);
-    if (challengeSize == 0) {
-        passedChallenge = nullptr;
-    }
-
-    // Find the size of the challenge.
-    err = Drm_LicenseAcq_GenerateChallenge(m_poAppContext,
-                                            g_rgpdstrRightsExt,
-                                            DRM_NO_OF(g_rgpdstrRightsExt),
-                                            nullptr,
-                                            nullptr,
-                                            0,
-                                            nullptr,
-                                            nullptr,
-                                            nullptr,
-                                            nullptr,
-                                            passedChallenge, 
-                                            &challengeSize,
-                                            nullptr);
-
-    if ((err != DRM_E_BUFFERTOOSMALL) && (DRM_FAILED(err))){
-        LOGGER(LERROR_, "Error: Drm_LicenseAcq_GenerateChallenge (error: 0x%08X)", static_cast<unsigned int>(err));
-        return CDMi_S_FALSE;
+        // Set this session's DMR header in the PR3 app context.
+        if (SelectDrmHeader(m_poAppContext, mDrmHeader.size(), &mDrmHeader[0]) != CDMi_SUCCESS){
+            return CDMi_S_FALSE;
+        }
+
+        // PlayReady doesn't like valid pointer + size 0, so the first go on
+        // an empty buffer only asks for the size.
+        ChallengeBuffers& buffers = *(mEnvironment.challengeBuffers);
+        DRM_DWORD cbChallenge = buffers.challenge.size() - 1;
+
+        err = Drm_LicenseAcq_GenerateChallenge(m_poAppContext,
+                                                g_rgpdstrRightsExt,
+                                                DRM_NO_OF(g_rgpdstrRightsExt),
+                                                nullptr,
+                                                nullptr,
+                                                0,
+                                                nullptr,
+                                                nullptr,
+                                                nullptr,
+                                                nullptr,
+                                                (cbChallenge > 0) ? &buffers.challenge[0] : nullptr,
+                                                &cbChallenge,
+                                                nullptr);
+
+        if (err == DRM_E_BUFFERTOOSMALL) {
+            if (buffers.challenge.size() <= cbChallenge) {
+                buffers.challenge.resize(cbChallenge + 1);
+            }
+
+            cbChallenge = buffers.challenge.size() - 1;
+            err = Drm_LicenseAcq_GenerateChallenge(m_poAppContext,
+                                                    g_rgpdstrRightsExt,
+                                                    DRM_NO_OF(g_rgpdstrRightsExt),
+                                                    nullptr,
+                                                    nullptr,
+                                                    0,
+                                                    nullptr,
+                                                    nullptr,
+                                                    nullptr,
+                                                    nullptr,
+                                                    &buffers.challenge[0],
+                                                    &cbChallenge,
+                                                    nullptr);
+        }
+
+        if (DRM_FAILED(err)){
+            LOGGER(LERROR_, "Error: Drm_LicenseAcq_GenerateChallenge (error: 0x%08X)", static_cast<unsigned int>(err));
+            return CDMi_S_FALSE;
+        }
+
+        mPendingChallenge.assign(&buffers.challenge[0], &buffers.challenge[0] + cbChallenge);
+        mPendingChallengeTime = std::chrono::steady_clock::now();
     }
 
-    if ((passedChallenge != nullptr) && (err == DRM_E_BUFFERTOOSMALL)){
-        LOGGER(LERROR_, "Error: Drm_LicenseAcq_GenerateChallenge (error: 0x%08X)", static_cast<unsigned int>(err));
-        return CDMi_OUT_OF_MEMORY ;
+    if ((challenge == nullptr) || (challengeSize < mPendingChallenge.size())) {
+        // PlayReady doesn't like valid pointer + size 0, so neither does this.
+        const bool sizing = ((challenge == nullptr) || (challengeSize == 0));
+
+        challengeSize = mPendingChallenge.size();
+        if (sizing == false) {
+            LOGGER(LERROR_, "Error: challenge buffer too small, %u bytes needed", challengeSize);
+            return CDMi_OUT_OF_MEMORY;
+        }
+        return CDMi_SUCCESS;
     }
 
+    ::memcpy(challenge, &mPendingChallenge[0], mPendingChallenge.size());
+    challengeSize = mPendingChallenge.size();
+    mPendingChallenge.clear();
+
     return CDMi_SUCCESS;
 }
 
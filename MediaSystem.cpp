@@ -16,22 +16,31 @@
 
 #include "cdmi.h"
 #include "MediaSession.h"
+#include "SecureStops.h"
+#include "StoreHash.h"
+#include "RevocationList.h"
+#include "SecureClock.h"
+#include "StoreCache.h"
+#include "StoreMaintenance.h"
 
 #include <core/core.h>
-#include <cryptalgo/cryptalgo.h>
 #include <plugins/plugins.h>
 
 #include <drmconstants.h>
 #include <drmversionconstants.h>
 #include <oemcommon.h>
 #include <drm_data.h>
-#include <prdy_http.h>
 #include <drmsecuretime.h>
 #include <drmsecuretimeconstants.h>
 
 //TODO: mirgrate this to Core
 #include <openssl/sha.h>
 
+#include <chrono>
+#include <future>
+#include <limits>
+#include <map>
+
 using namespace WPEFramework;
 
 using SafeCriticalSection = Core::SafeSyncType<WPEFramework::Core::CriticalSection>;
@@ -55,45 +64,55 @@ static DRM_WCHAR* createDrmWchar(std::string const& s) {
     return w;
 }
 
-bool calcFileSha256 (const std::string& filePath, uint8_t hash[], uint32_t hashLength )
-{
-    bool result(false); 
+namespace CDMi {
 
-    ASSERT(filePath.empty() == false);
+static const char *DRM_DEFAULT_REVOCATION_LIST_FILE="/tmp/revpackage.xml";
 
-    Core::DataElementFile dataBuffer(filePath, Core::File::USER_READ);
+// Every bound decrypt context holds a key slot in the TEE. Live streams with
+// key rotation keep selecting new keys, so by default only this many stay
+// bound per session (0 in the config lifts the limit).
+static const uint32_t DEFAULT_MAX_DECRYPT_CONTEXTS = 32;
 
-    if ( dataBuffer.IsValid() == false ) {
-        TRACE_L1("Failed to open %s", filePath.c_str());
-    } else {
-        WPEFramework::Crypto::SHA256 calculator; 
-        ASSERT(hashLength == calculator.Length);
-        
-        if (hashLength == calculator.Length) {
-            calculator.Input(dataBuffer.Buffer(), dataBuffer.Size());
+// Session callbacks queued for delivery, beyond which new output protection
+// properties are merged or dropped. Key statuses and errors are always queued.
+static const uint32_t CALLBACK_DISPATCHER_CAPACITY = 64;
 
-            const uint8_t* fileHash = calculator.Result();
-            
-            ::memcpy(hash, fileHash, calculator.Length);
+// OCDM license type of "persistent-license" sessions.
+static const int32_t PERSISTENT_LICENSE_TYPE = 2;
 
-            result = true;
-        } else {
-            TRACE_L1("Output hash buffer has a incorrect size(%d), need %d bytes", hashLength, calculator.Length);
-        }
-    }
+// Init data type of a "persistent-license" session created to be loaded: the
+// init data is the ID of the session to load, not a PlayReady header.
+static const char SESSION_ID_INIT_DATA_TYPE[] = "sessionid";
 
-    return result;
-}
+// A secure stop challenge is signed in the TEE. Reporting asks for it twice
+// (size, then data) and the server may be retried, so a generated challenge
+// is handed out again until committed or this old.
+static const uint32_t SECURE_STOP_CHALLENGE_TIMEOUT_S = 60;
 
-namespace CDMi {
+// Size the DRM store file may grow to, in bytes, and the percentages of it
+// at which a cleanup starts and may stop, unless configured otherwise.
+static const uint32_t DEFAULT_STORE_CAPACITY = 4 * 1024 * 1024;
+static const uint32_t DEFAULT_STORE_HIGH_WATERMARK = 80;
+static const uint32_t DEFAULT_STORE_LOW_WATERMARK = 60;
 
-static const char *DRM_DEFAULT_REVOCATION_LIST_FILE="/tmp/revpackage.xml";
+// Seconds between write backs of a DRM store kept on a RAM file system,
+// unless configured otherwise.
+static const uint32_t DEFAULT_STORE_FLUSH_INTERVAL_S = 300;
+
+// Initial size of the in-memory license store, unless configured otherwise.
+static const uint32_t DEFAULT_LICENSE_STORE_SIZE = MAX_NUM_LICENSES * LICENSE_SIZE_BYTES;
 
-class PlayReady : public IMediaKeys, public IMediaKeysExt {
+class PlayReady : public IMediaKeys, public IMediaKeysExt, public IMediaKeysSecureStops {
 private:
     PlayReady (const PlayReady&) = delete;
     PlayReady& operator= (const PlayReady&) = delete;
 
+    struct SecureStopChallenge {
+        std::vector<uint8_t> data;
+        std::chrono::steady_clock::time_point generated;
+    };
+    typedef std::map<std::vector<uint8_t>, SecureStopChallenge> SecureStopChallengeMap;
+
     class Config : public Core::JSON::Container {
     public:
         Config(const Config&) = delete;
@@ -101,8 +120,28 @@ private:
         Config()
             : Core::JSON::Container()
             , MeteringCertificate()
+            , PrefetchKeys(true)
+            , MaxDecryptContexts(DEFAULT_MAX_DECRYPT_CONTEXTS)
+            , LicenseStoreSize(DEFAULT_LICENSE_STORE_SIZE)
+            , LicenseStoreAutoSize(true)
+            , SecureTimeServer()
+            , StoreCapacity(DEFAULT_STORE_CAPACITY)
+            , StoreHighWatermark(DEFAULT_STORE_HIGH_WATERMARK)
+            , StoreLowWatermark(DEFAULT_STORE_LOW_WATERMARK)
+            , StoreCache()
+            , StoreFlushInterval(DEFAULT_STORE_FLUSH_INTERVAL_S)
         {
             Add(_T("metering"), &MeteringCertificate);
+            Add(_T("prefetchkeys"), &PrefetchKeys);
+            Add(_T("maxdecryptcontexts"), &MaxDecryptContexts);
+            Add(_T("licensestoresize"), &LicenseStoreSize);
+            Add(_T("licensestoreautosize"), &LicenseStoreAutoSize);
+            Add(_T("securetimeserver"), &SecureTimeServer);
+            Add(_T("storecapacity"), &StoreCapacity);
+            Add(_T("storehighwatermark"), &StoreHighWatermark);
+            Add(_T("storelowwatermark"), &StoreLowWatermark);
+            Add(_T("storecache"), &StoreCache);
+            Add(_T("storeflushinterval"), &StoreFlushInterval);
         }
         ~Config()
         {
@@ -110,79 +149,190 @@ private:
 
     public:
         Core::JSON::String MeteringCertificate;
+        Core::JSON::Boolean PrefetchKeys;
+        Core::JSON::DecUInt32 MaxDecryptContexts;
+        Core::JSON::DecUInt32 LicenseStoreSize;
+        Core::JSON::Boolean LicenseStoreAutoSize;
+        Core::JSON::String SecureTimeServer;
+        Core::JSON::DecUInt32 StoreCapacity;
+        Core::JSON::DecUInt32 StoreHighWatermark;
+        Core::JSON::DecUInt32 StoreLowWatermark;
+        Core::JSON::String StoreCache;
+        Core::JSON::DecUInt32 StoreFlushInterval;
     };
 
 public:
     PlayReady() 
         : m_drmOemContext(nullptr)
         , m_nxAllocResults() 
+        , m_nexusJoined(false)
         , m_drmDirectory()
         , m_drmStore()
-        , m_pbOpaqueBuffer(nullptr)
+        , m_opaqueBuffer()
         , m_pbRevocationBuffer(nullptr)
         , m_poAppContext(nullptr)
         , m_readDir()
         , m_storeLocation()
+        , m_persistentStore()
         , m_meteringCertificate(nullptr)
         , m_meteringCertificateSize(0)
+        , m_backgroundWorker()
+        , m_callbackDispatcher(CALLBACK_DISPATCHER_CAPACITY)
+        , m_challengeBuffers()
+        , m_tuning()
+        , m_licenseStoreSize(DEFAULT_LICENSE_STORE_SIZE)
+        , m_licenseStoreAutoSize(true)
+        , m_licenseStoreUsage()
+        , m_secureStopChallenges()
+        , m_secureStopReport()
+        , m_secureStopReportCount(0)
+        , m_secureStopReportTime()
+        , m_storeHash()
+        , m_revocationList()
+        , m_secureClock()
+        , m_storeMaintenance()
+        , m_storeCache()
+        , m_sessionEnvironment()
+        , m_initialized()
     {
-        NxClient_JoinSettings joinSettings;
-        NxClient_AllocSettings nxAllocSettings;
-        NEXUS_Error rc;
-        DRM_RESULT dr = DRM_SUCCESS;
-
-        NxClient_GetDefaultJoinSettings(&joinSettings);
-        strncpy(joinSettings.name, "playready3x", NXCLIENT_MAX_NAME);
-        joinSettings.ignoreStandbyRequest = true;
-        rc = NxClient_Join(&joinSettings);
-        if (rc) {
-            LOGGER(LERROR_, "Couldnt join nxserver [rc=0x%08X]", rc);
-            goto ErrorExit;
-        }
-
-        NxClient_GetDefaultAllocSettings(&nxAllocSettings);
-        rc = NxClient_Alloc(&nxAllocSettings, &m_nxAllocResults);       
-
-        if (rc) {
-            LOGGER(LERROR_, "NxClient_Alloc failed nxserver [rc=0x%08X]", rc);
-            goto ErrorExit;
-        }
-    ErrorExit:
-        if (DRM_FAILED(dr))
-        {
-            LOGGER(LERROR_, "Playready Initialize failed (error: 0x%08X)", static_cast<unsigned int>(dr));
-        }
+        m_sessionEnvironment.dispatcher = &m_callbackDispatcher;
+        m_sessionEnvironment.challengeBuffers = &m_challengeBuffers;
+        m_sessionEnvironment.opaqueBuffer = &m_opaqueBuffer;
+        m_sessionEnvironment.tuning = &m_tuning;
+        m_sessionEnvironment.licenseStore = &m_licenseStoreUsage;
+        m_sessionEnvironment.secureClock = &m_secureClock;
+        m_sessionEnvironment.storeMaintenance = &m_storeMaintenance;
     }
 
     ~PlayReady(void) {
+        WaitInitialized();
+
         if (m_meteringCertificate != nullptr) {
             delete [] m_meteringCertificate;
             m_meteringCertificate = nullptr;
         }
         ASSERT(m_poAppContext.get() == nullptr);
-        NxClient_Free(&m_nxAllocResults);
-        NxClient_Uninit();
+        if (m_nexusJoined == true) {
+            NxClient_Free(&m_nxAllocResults);
+            NxClient_Uninit();
+        }
     }
 
     void Initialize(const WPEFramework::PluginHost::IShell * shell, const std::string& configline)
     {
         string persistentPath = shell->PersistentPath() + string("playready/");
+
+        Config config;
+        config.FromString(configline);
+
+        // With a store cache the DRM works on a copy of the store in there
+        // (tmpfs), which is written back to the persistent path.
+        std::string cachePath(config.StoreCache.Value());
+        if ((cachePath.empty() == false) && (cachePath.back() != '/')) {
+            cachePath += '/';
+        }
+
         m_readDir = persistentPath;
-        m_storeLocation = persistentPath + "drmstore";
+        m_persistentStore = persistentPath + "drmstore";
+        m_storeLocation = (cachePath.empty() == true) ? m_persistentStore : cachePath + "drmstore";
+        m_sessionEnvironment.sessionRecordPath = persistentPath + "sessions/";
+        m_storeHash.FileName(m_storeLocation);
+        // The record of the stored revocation package goes with the store
+        // it describes, a lost working store is a lost record.
+        m_revocationList.Configure(DRM_DEFAULT_REVOCATION_LIST_FILE, m_storeLocation + ".revocation");
+        m_storeCache.Configure(m_persistentStore, m_storeLocation, config.StoreFlushInterval.Value(), drmAppContextMutex_);
 
         LOGGER(LINFO_,  "m_readDir: %s", m_readDir.c_str());
         LOGGER(LINFO_,  "m_storeLocation: %s", m_storeLocation.c_str());
         
         WPEFramework::Core::SystemInfo::SetEnvironment(_T("HOME"), persistentPath);  
 
-        Config config;
-        config.FromString(configline);
+        const std::string meteringCertificate((config.MeteringCertificate.IsSet() == true) ? config.MeteringCertificate.Value() : std::string());
+
+        // Decrypt contexts for the other keys of a license are bound in the
+        // background, so a key rotation does not stall playback on a bind.
+        m_sessionEnvironment.prefetchWorker = (config.PrefetchKeys.Value() == true) ? &m_backgroundWorker : nullptr;
+        m_sessionEnvironment.maxDecryptContexts = config.MaxDecryptContexts.Value();
+
+        // Without history (or with auto sizing off) the in-memory license
+        // store starts at this size, see CreateSystemExt().
+        m_licenseStoreSize = config.LicenseStoreSize.Value();
+        m_licenseStoreAutoSize = config.LicenseStoreAutoSize.Value();
+
+        // Forward link to the time server, for a local stand-in.
+        m_secureClock.Server(config.SecureTimeServer.Value());
+        m_secureClock.CacheFile(m_persistentStore + ".securetime");
+
+        // Expired licenses are cleaned up while the DRM is idle, once the store
+        // grows past the high watermark, instead of all at once at shutdown.
+        m_storeMaintenance.Configure(m_storeLocation, config.StoreCapacity.Value(),
+            config.StoreHighWatermark.Value(), config.StoreLowWatermark.Value());
+
+        // Joining Nexus and opening the DRM store take long enough to hold up
+        // the OCDM start, so that runs in the background. Every call that
+        // needs it waits for it first, see WaitInitialized().
+        m_initialized = std::async(std::launch::async, [this, meteringCertificate]() {
+            // Independent of each other, only the DRM store needs all of them.
+            std::future<void> certificate = std::async(std::launch::async, [this, &meteringCertificate]() {
+                LoadMeteringCertificate(meteringCertificate);
+            });
+            std::future<void> revocation = std::async(std::launch::async, [this]() {
+                if (DRM_REVOCATION_IsRevocationSupported()) {
+                    m_revocationList.Prepare();
+                }
+            });
 
-        if (config.MeteringCertificate.IsSet() == true) {
-            Core::DataElementFile dataBuffer(config.MeteringCertificate.Value(), Core::File::USER_READ | Core::File::GROUP_READ);
+            JoinNexus();
+
+            certificate.wait();
+            revocation.wait();
+
+            InitializeSystem();
+        }).share();
+    }
+
+    void WaitInitialized() const
+    {
+        if (m_initialized.valid() == true) {
+            m_initialized.wait();
+        }
+    }
+
+    bool JoinNexus()
+    {
+        NxClient_JoinSettings joinSettings;
+        NxClient_AllocSettings nxAllocSettings;
+        NEXUS_Error rc;
+
+        NxClient_GetDefaultJoinSettings(&joinSettings);
+        strncpy(joinSettings.name, "playready3x", NXCLIENT_MAX_NAME);
+        joinSettings.ignoreStandbyRequest = true;
+        rc = NxClient_Join(&joinSettings);
+        if (rc) {
+            LOGGER(LERROR_, "Couldnt join nxserver [rc=0x%08X]", rc);
+            return false;
+        }
+
+        NxClient_GetDefaultAllocSettings(&nxAllocSettings);
+        rc = NxClient_Alloc(&nxAllocSettings, &m_nxAllocResults);
+        if (rc) {
+            LOGGER(LERROR_, "NxClient_Alloc failed nxserver [rc=0x%08X]", rc);
+            NxClient_Uninit();
+            return false;
+        }
+
+        m_nexusJoined = true;
+
+        return true;
+    }
+
+    void LoadMeteringCertificate(const std::string& fileName)
+    {
+        if (fileName.empty() == false) {
+            Core::DataElementFile dataBuffer(fileName, Core::File::USER_READ | Core::File::GROUP_READ);
             
             if(dataBuffer.IsValid() == false) {
-                TRACE_L1(_T("Failed to open %s"), config.MeteringCertificate.Value().c_str());
+                TRACE_L1(_T("Failed to open %s"), fileName.c_str());
             } else {
                 m_meteringCertificateSize = dataBuffer.Size();
                 m_meteringCertificate     = new DRM_BYTE[m_meteringCertificateSize];
@@ -190,8 +340,6 @@ public:
                 ::memcpy(m_meteringCertificate, dataBuffer.Buffer(), dataBuffer.Size());
             }
         }
-
-        InitializeSystem();      
     }
 
     void InitializeSystem(){
@@ -202,6 +350,14 @@ public:
         }
 
         WPEFramework::Core::Directory(m_readDir.c_str()).CreatePath();
+        WPEFramework::Core::Directory(m_sessionEnvironment.sessionRecordPath.c_str()).CreatePath();
+
+        if (m_storeCache.IsEnabled() == true) {
+            const std::string cachePath(m_storeLocation.substr(0, m_storeLocation.rfind('/') + 1));
+
+            WPEFramework::Core::Directory(cachePath.c_str()).CreatePath();
+            m_storeCache.Restore();
+        }
         
         NEXUS_ClientConfiguration platformConfig;
         OEM_Settings oemSettings;
@@ -240,26 +396,43 @@ public:
 
     void Deinitialize(const WPEFramework::PluginHost::IShell * shell)
     {
+        WaitInitialized();
+
+        m_backgroundWorker.Stop();
+        m_callbackDispatcher.Stop();
+        m_storeHash.Stop();
+
         DeinitializeSystem();
     }
 
     void DeinitializeSystem() { 
         LOGGER(LINFO_, "Deinitialize PlayReady System, Build: %s", __TIMESTAMP__ );
+
+        m_secureClock.Stop();
+        m_storeMaintenance.Stop();
+        m_storeCache.Stop();
+
         if(m_poAppContext.get()) {
-            // Deletes all expired licenses from the license store and perform maintenance
-            DRM_RESULT dr = Drm_StoreMgmt_CleanupStore(m_poAppContext.get(),
-                                            DRM_STORE_CLEANUP_ALL,
-                                            nullptr, 0, nullptr);
-            if(DRM_FAILED(dr))
-            {
-                LOGGER(LERROR_,  "Warning, Drm_StoreMgmt_CleanupStore returned 0x%08lX", dr);
-            }
+            LOGGER(LINFO_, "In-memory license store: %u licenses at most, %u resizes",
+                static_cast<unsigned int>(m_licenseStoreUsage.peak), m_licenseStoreUsage.resizes);
 
             // Uninitialize drm context
             Drm_Uninitialize(m_poAppContext.get());
             m_poAppContext.reset();
         }
 
+        // The store is closed, write back what the last interval changed.
+        if (m_storeCache.Flush() == false) {
+            LOGGER(LERROR_, "Error writing back the DRM store to %s", m_persistentStore.c_str());
+        }
+
+        m_secureStopChallenges.clear();
+        m_secureStopReport.clear();
+        m_secureStopReportCount = 0;
+
+        SAFE_OEM_FREE(m_opaqueBuffer.buffer);
+        m_opaqueBuffer.size = 0;
+
         Drm_Platform_Uninitialize(m_drmOemContext);
     }
 
@@ -271,24 +444,48 @@ public:
         const uint8_t *f_pbCDMData, uint32_t f_cbCDMData, 
         IMediaKeySession **f_ppiMediaKeySession) {
 
-        // ToDo: This needs to be solved a bit nicer... 
+        WaitInitialized();
+
         // Since the OCDM server is not aware of the location of the store but exposes a "delete store" API,
-        // we need to check somewhere if it's deleted and recover it. Sadly the only way to recover is to
-        // reinitialize the system. ¯\_(ツ)_/¯ 
+        // we need to check somewhere if it's deleted and recover it. The store is reopened on the
+        // existing app context, only if that fails the system is reinitialized.
         //
         // For now I think this seems to be the most logical place... 
 
+        m_storeMaintenance.Activity();
+
         Core::File file(m_storeLocation);
-        if(file.Exists() == false){
+        if((file.Exists() == false) && (RecreateStore() == false)){
             InitializeSystem();
         }
 
-        *f_ppiMediaKeySession = new CDMi::MediaKeySession(
-            f_pbInitData, f_cbInitData, 
+        // A revocation package updated since is stored in the background, so
+        // the session does not wait for it.
+        if ((m_pbRevocationBuffer != nullptr) && (m_revocationList.Modified() == true)) {
+            m_backgroundWorker.Submit([this]() {
+                m_revocationList.Load([this](uint8_t package[], const uint32_t length) {
+                    return (StoreRevocationPackage(package, length)); });
+            });
+        }
+
+        const bool persistent = (licenseType == PERSISTENT_LICENSE_TYPE);
+        const bool sessionId = ((persistent == true) && (f_pwszInitDataType != nullptr) &&
+            (strcmp(f_pwszInitDataType, SESSION_ID_INIT_DATA_TYPE) == 0));
+
+        CDMi::MediaKeySession* session = new CDMi::MediaKeySession(
+            (sessionId == false ? f_pbInitData : nullptr), (sessionId == false ? f_cbInitData : 0),
             f_pbCDMData, f_cbCDMData, 
-            m_drmOemContext, m_poAppContext.get()
+            m_drmOemContext, m_poAppContext.get(),
+            persistent,
+            m_sessionEnvironment
             );
 
+        if ((sessionId == true) && (f_pbInitData != nullptr)) {
+            session->SessionToLoad(std::string(reinterpret_cast<const char*>(f_pbInitData), f_cbInitData));
+        }
+
+        *f_ppiMediaKeySession = session;
+
         return CDMi_SUCCESS; 
     }
 
@@ -300,13 +497,22 @@ public:
     }
 
     CDMi_RESULT DestroyMediaKeySession(IMediaKeySession *f_piMediaKeySession) {
-        SafeCriticalSection systemLock(drmAppContextMutex_);
+        WaitInitialized();
+
         MediaKeySession * mediaKeySession = dynamic_cast<MediaKeySession *>(f_piMediaKeySession);
         ASSERT((mediaKeySession != nullptr) && "Expected a locally allocated MediaKeySession");
 
+        // Closing the session takes the DRM lock itself, and must be able to
+        // wait for callback deliveries without it.
         delete f_piMediaKeySession;
         f_piMediaKeySession= nullptr;
 
+        SafeCriticalSection systemLock(drmAppContextMutex_);
+
+        // Licenses and the secure stop of the session have been written.
+        m_storeHash.Changed();
+        m_storeMaintenance.Changed();
+
         return CDMi_SUCCESS;
     }
 
@@ -364,6 +570,8 @@ public:
 
     CDMi_RESULT GetSecureStopIds(uint8_t ids[], uint16_t idsLength, uint32_t & count)
     {
+        WaitInitialized();
+
         SafeCriticalSection lock(drmAppContextMutex_);
 
         CDMi_RESULT cr = CDMi_SUCCESS;
@@ -398,290 +606,308 @@ public:
         return cr;
     }
 
+    // Without a session ID, the challenges of all pending secure stops are
+    // returned at once, packed as by IMediaKeysSecureStops::GetSecureStops().
+    // As many as fit in rawSize are, the others follow in the next report.
     CDMi_RESULT GetSecureStop(
             const uint8_t sessionID[],
             uint32_t sessionIDLength,
             uint8_t * rawData,
             uint16_t & rawSize)
     {
-        SafeCriticalSection lock(drmAppContextMutex_);
+        WaitInitialized();
 
-        CDMi_RESULT cr = CDMi_SUCCESS;
+        if (sessionIDLength == 0) {
+            uint32_t challengesLength = rawSize;
+            uint32_t count = 0;
 
-        // Get the secure stop challenge
-        DRM_ID ssSessionDrmId;
-        ASSERT(sizeof(ssSessionDrmId.rgb) >= sessionIDLength);
-        memcpy(ssSessionDrmId.rgb, sessionID, sessionIDLength);
+            const CDMi_RESULT cr = ReportSecureStops(rawData, challengesLength, count,
+                std::numeric_limits<uint16_t>::max());
 
-        DRM_DWORD ssChallengeSize;
-        DRM_BYTE *ssChallenge;
+            rawSize = static_cast<uint16_t>(challengesLength);
+            return (cr);
+        }
 
-        DRM_RESULT dr = Drm_SecureStop_GenerateChallenge(
-                m_poAppContext.get(),
-                &ssSessionDrmId,
-                m_meteringCertificateSize, //playready3MeteringCertSize,
-                m_meteringCertificate,     //playready3MeteringCert,
-                0, nullptr, // no custom data
-                &ssChallengeSize,
-                &ssChallenge);
+        SafeCriticalSection lock(drmAppContextMutex_);
+
+        CDMi_RESULT cr = CDMi_SUCCESS;
+
+        const SecureStopChallenge* challenge = GenerateSecureStopChallenge(std::vector<uint8_t>(sessionID, sessionID + sessionIDLength));
 
-        if (dr != DRM_SUCCESS) {
-            LOGGER(LERROR_, "Error in Drm_SecureStop_GenerateChallenge (error: 0x%08X)", static_cast<unsigned int>(dr));
+        if (challenge == nullptr) {
             cr = CDMi_S_FALSE;
         } else {
-            if((rawData != nullptr) && (rawSize >= ssChallengeSize)){
-                memcpy(rawData, ssChallenge, ssChallengeSize);
-            } 
-            rawSize = ssChallengeSize; 
+            if((rawData != nullptr) && (rawSize >= challenge->data.size())){
+                memcpy(rawData, challenge->data.data(), challenge->data.size());
+            } else if (rawData != nullptr) {
+                // Not a sizing call, the caller must know nothing was copied.
+                cr = CDMi_OUT_OF_MEMORY;
+            }
+            rawSize = challenge->data.size();
         }
 
         return cr;
     }
 
+    // Without a session ID, serverResponse holds the packed responses to a
+    // report of all pending secure stops, see GetSecureStop().
     CDMi_RESULT CommitSecureStop(
             const uint8_t sessionID[],
             uint32_t sessionIDLength,
             const uint8_t serverResponse[],
             uint32_t serverResponseLength) override
     {
+        WaitInitialized();
+
+        if (sessionIDLength == 0) {
+            uint32_t committed = 0;
+
+            return (CommitSecureStops(serverResponse, serverResponseLength, committed));
+        }
+
         SafeCriticalSection lock(drmAppContextMutex_);
 
         CDMi_RESULT cr = CDMi_SUCCESS;
 
-        if (sessionIDLength == 0) {
-            LOGGER(LERROR_, "Error: empty session id");
-            cr = CDMi_S_FALSE;
-        }
         if (serverResponseLength  == 0) {
             cr = CDMi_S_FALSE;
         }
 
         if (cr == CDMi_SUCCESS){
-            DRM_ID sessionDrmId;
-            ASSERT(sizeof(sessionDrmId.rgb) >= sessionIDLength);
-            memcpy(sessionDrmId.rgb, sessionID, sessionIDLength);
-
-            DRM_DWORD customDataSizeBytes = 0;
-            DRM_CHAR *pCustomData = NULL;
-            
-            DRM_RESULT dr;
-            dr = Drm_SecureStop_ProcessResponse(
-                m_poAppContext.get(),
-                &sessionDrmId,
-                m_meteringCertificateSize, //playready3MeteringCertSize,
-                m_meteringCertificate,     //playready3MeteringCert,
-                serverResponseLength,
-                serverResponse,
-                &customDataSizeBytes,
-                &pCustomData);
-            if (dr == DRM_SUCCESS)
-            {
-                LOGGER(LINFO_, "secure stop commit successful");
-                if (pCustomData && customDataSizeBytes)
-                {
-                    // We currently don't use custom data from the server. Just log here.
-                    std::string customDataStr(pCustomData, customDataSizeBytes);
-                    LOGGER(LINFO_, "custom data = \"%s\"", customDataStr.c_str());
-                }
-            }
-            else
-            {
-                LOGGER(LERROR_, "Drm_SecureStop_ProcessResponse returned 0x%lx", static_cast<unsigned long>(dr));
-            }
-
-            SAFE_OEM_FREE(pCustomData);
+            ProcessSecureStopResponse(std::vector<uint8_t>(sessionID, sessionID + sessionIDLength), serverResponse, serverResponseLength);
         }
 
         return cr;
     }
 
-    bool LoadRevocationList(const char *revListFile)
+    CDMi_RESULT GetSecureStops(uint8_t challenges[], uint32_t& challengesLength, uint32_t& count) override
     {
-        DRM_RESULT dr = DRM_SUCCESS;
-        FILE    * fRev;
-        uint8_t * revBuf = nullptr;
-        size_t    fileSize = 0;
-        uint32_t  currSize = 0;
+        WaitInitialized();
 
-        assert(revListFile != nullptr);
+        return (ReportSecureStops(challenges, challengesLength, count, std::numeric_limits<uint32_t>::max()));
+    }
 
-        fRev = fopen(revListFile, "rb");
-        if( fRev == nullptr)
-        {
-            return true;
-        }
+    // Hands out whole records only, as many as fit in maxLength.
+    CDMi_RESULT ReportSecureStops(uint8_t challenges[], uint32_t& challengesLength, uint32_t& count, const uint32_t maxLength)
+    {
+        SafeCriticalSection lock(drmAppContextMutex_);
 
-        /* get the size of the file */
-        fseek(fRev, 0, SEEK_END);
-        fileSize = ftell(fRev);
-        fseek(fRev, 0, SEEK_SET);
+        CDMi_RESULT cr = CDMi_SUCCESS;
 
-        revBuf = (uint8_t *)BKNI_Malloc(fileSize);
-        if( revBuf == nullptr)
-        {
-            goto ErrorExit;
+        const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+        // A report prepared by the sizing call is handed out as is, the
+        // store is not enumerated again.
+        if ((m_secureStopReport.empty() == false)
+            && ((now - m_secureStopReportTime) >= std::chrono::seconds(SECURE_STOP_CHALLENGE_TIMEOUT_S))) {
+            m_secureStopReport.clear();
         }
 
-        BKNI_Memset(revBuf, 0x00, fileSize);
+        if (m_secureStopReport.empty() == true) {
+            DRM_ID *ssSessionIds = nullptr;
+            DRM_DWORD sessions = 0;
 
-        for(;;) {
-            uint8_t buf[512];
-            int rc = fread(buf, 1, sizeof(buf), fRev);
-            if(rc<=0) {
-                break;
+            m_secureStopReportCount = 0;
+            m_secureStopReportTime = now;
+
+            DRM_RESULT dr = Drm_SecureStop_EnumerateSessions(
+                    m_poAppContext.get(),
+                    m_meteringCertificateSize, //playready3MeteringCertSize,
+                    m_meteringCertificate,     //playready3MeteringCert,
+                    &sessions,
+                    &ssSessionIds);
+
+            if (dr != DRM_SUCCESS && dr != DRM_E_NOMORE) {
+                LOGGER(LERROR_, "Error in Drm_SecureStop_EnumerateSessions (error: 0x%08X)", static_cast<unsigned int>(dr));
+                cr = CDMi_S_FALSE;
+                sessions = 0;
             }
-            BKNI_Memcpy(revBuf+currSize, buf, rc);
-            currSize += rc;
-        }
 
-        ChkDR( Drm_Revocation_StorePackage(
-                m_poAppContext.get(),
-                ( DRM_CHAR * )revBuf,
-                fileSize ) );
+            for (DRM_DWORD i = 0; i < sessions; ++i) {
+                const std::vector<uint8_t> id(ssSessionIds[i].rgb, ssSessionIds[i].rgb + DRM_ID_SIZE);
+                const SecureStopChallenge* challenge = GenerateSecureStopChallenge(id);
+
+                // One that fails is left out, the others still get reported.
+                if (challenge != nullptr) {
+                    const uint32_t length = challenge->data.size();
+                    const uint8_t header[] = {
+                        static_cast<uint8_t>(length >> 24), static_cast<uint8_t>(length >> 16),
+                        static_cast<uint8_t>(length >> 8), static_cast<uint8_t>(length) };
+
+                    m_secureStopReport.insert(m_secureStopReport.end(), id.begin(), id.end());
+                    m_secureStopReport.insert(m_secureStopReport.end(), header, header + sizeof(header));
+                    m_secureStopReport.insert(m_secureStopReport.end(), challenge->data.begin(), challenge->data.end());
+                    m_secureStopReportCount++;
+                }
+            }
 
-        if( revBuf != nullptr)
-            BKNI_Free(revBuf);
+            SAFE_OEM_FREE(ssSessionIds);
 
-        return true;
+            if (m_secureStopReportCount) {
+                LOGGER(LINFO_, "Reporting %u pending secure stop%s", m_secureStopReportCount, (m_secureStopReportCount > 1) ? "s" : "");
+            }
+        }
 
-    ErrorExit:
-        if( revBuf != nullptr)
-            BKNI_Free(revBuf);
+        if (cr == CDMi_SUCCESS) {
+            // The records left out are still pending, so the next report
+            // has them again.
+            uint32_t length = 0;
+
+            count = 0;
+            while (length < m_secureStopReport.size()) {
+                const uint8_t* header = &m_secureStopReport[length + IMediaKeysSecureStops::SECURE_STOP_ID_SIZE];
+                const uint32_t recordLength = IMediaKeysSecureStops::SECURE_STOP_HEADER_SIZE +
+                    ((header[0] << 24) | (header[1] << 16) | (header[2] << 8) | header[3]);
+
+                if ((maxLength - length) < recordLength) {
+                    LOGGER(LWARNING_, "Reporting %u of %u pending secure stops, the others do not fit in %u bytes",
+                        count, m_secureStopReportCount, maxLength);
+                    break;
+                }
 
-        return false;
-    }
+                length += recordLength;
+                count++;
+            }
 
-    #define MAX_TIME_CHALLENGE_RESPONSE_LENGTH (1024*64)
-    #define MAX_URL_LENGTH (512)
+            if ((challenges != nullptr) && (challengesLength >= length)) {
+                memcpy(challenges, m_secureStopReport.data(), length);
+                m_secureStopReport.clear();
+            } else if (challenges != nullptr) {
+                cr = CDMi_OUT_OF_MEMORY;
+            }
+            challengesLength = length;
+        }
+
+        return cr;
+    }
 
-    int InitSecureClock(DRM_APP_CONTEXT *pDrmAppCtx)
+    CDMi_RESULT CommitSecureStops(const uint8_t responses[], const uint32_t responsesLength, uint32_t& committed) override
     {
-        int                   rc = 0;
-        DRM_DWORD             cbChallenge     = 0;
-        DRM_BYTE             *pbChallenge     = nullptr;
-        DRM_BYTE             *pbResponse      = nullptr;
-        char                 *pTimeChallengeURL = nullptr;
-        char                  secureTimeUrlStr[MAX_URL_LENGTH];
-        bool                  redirect = true;
-        int32_t               petRC=0;
-        uint32_t              petRespCode = 0;
-        uint32_t              startOffset;
-        uint32_t              length;
-        uint32_t              post_ret;
-        NEXUS_MemoryAllocationSettings allocSettings;
-        DRM_RESULT            drResponse = DRM_SUCCESS;
-        DRM_RESULT            dr = DRM_SUCCESS;
-
-        dr = Drm_SecureTime_GenerateChallenge( pDrmAppCtx,
-                                            &cbChallenge,
-                                            &pbChallenge );
-        ChkDR(dr);
-
-        NEXUS_Memory_GetDefaultAllocationSettings(&allocSettings);
-        rc = NEXUS_Memory_Allocate(MAX_URL_LENGTH, &allocSettings, (void **)(&pTimeChallengeURL ));
-        if(rc != NEXUS_SUCCESS)
-        {
-            LOGGER(LERROR_, " NEXUS_Memory_Allocate failed for time challenge response buffer, rc = %d", rc);
-            goto ErrorExit;
-        }
+        WaitInitialized();
 
-        /* send the petition request to Microsoft with HTTP GET */
-        petRC = PRDY_HTTP_Client_GetForwardLinkUrl((char*)g_dstrHttpSecureTimeServerUrl.pszString,
-                                                &petRespCode,
-                                                (char**)&pTimeChallengeURL);
+        SafeCriticalSection lock(drmAppContextMutex_);
 
-        if( petRC != 0)
-        {
-            LOGGER(LERROR_, " Secure Time forward link petition request failed, rc = %d", petRC);
-            rc = petRC;
-            goto ErrorExit;
-        }
+        const uint32_t headerSize = IMediaKeysSecureStops::SECURE_STOP_HEADER_SIZE;
+        bool failed = false;
+        uint32_t offset = 0;
 
-        do
-        {
-            redirect = false;
+        committed = 0;
 
-            /* we need to check if the Pettion responded with redirection */
-            if( petRespCode == 200)
-            {
-                redirect = false;
+        // A response that is rejected does not stop the rest of the batch.
+        while (offset < responsesLength) {
+            const uint8_t* record = &responses[offset];
+            const uint32_t remaining = responsesLength - offset;
+
+            if (remaining < headerSize) {
+                LOGGER(LERROR_, "Truncated secure stop response at offset %u", offset);
+                failed = true;
+                break;
             }
-            else if( petRespCode == 302 || petRespCode == 301)
-            {
-                redirect = true;
-                memset(secureTimeUrlStr, 0, MAX_URL_LENGTH);
-                strcpy(secureTimeUrlStr, pTimeChallengeURL);
-                memset(pTimeChallengeURL, 0, MAX_URL_LENGTH);
 
-                petRC = PRDY_HTTP_Client_GetSecureTimeUrl(secureTimeUrlStr,
-                                                        &petRespCode,
-                                                        (char**)&pTimeChallengeURL);
+            const uint8_t* header = &record[IMediaKeysSecureStops::SECURE_STOP_ID_SIZE];
+            const uint32_t length = (header[0] << 24) | (header[1] << 16) | (header[2] << 8) | header[3];
 
-                if( petRC != 0)
-                {
-                    LOGGER(LERROR_, " Secure Time URL petition request failed, rc = %d", petRC);
-                    rc = petRC;
-                    goto ErrorExit;
-                }
+            if (length > (remaining - headerSize)) {
+                LOGGER(LERROR_, "Truncated secure stop response at offset %u", offset);
+                failed = true;
+                break;
             }
-            else
-            {
-                LOGGER(LERROR_, "Secure Clock Petition responded with unsupported result, rc = %d, can't get the time challenge URL", petRespCode);
-                rc = -1;
-                goto ErrorExit;
+
+            const std::vector<uint8_t> id(record, record + IMediaKeysSecureStops::SECURE_STOP_ID_SIZE);
+
+            if ((length != 0) && (ProcessSecureStopResponse(id, &record[headerSize], length) == true)) {
+                committed++;
+            } else {
+                failed = true;
             }
-        } while (redirect);
 
-        NEXUS_Memory_GetDefaultAllocationSettings(&allocSettings);
-        rc = NEXUS_Memory_Allocate(MAX_TIME_CHALLENGE_RESPONSE_LENGTH, &allocSettings, (void **)(&pbResponse ));
-        if(rc != NEXUS_SUCCESS)
-        {
-            LOGGER(LERROR_, "NEXUS_Memory_Allocate failed for time challenge response buffer, rc = %d", rc);
-            goto ErrorExit;
+            offset += headerSize + length;
         }
 
-        BKNI_Memset(pbResponse, 0, MAX_TIME_CHALLENGE_RESPONSE_LENGTH);
-        post_ret = PRDY_HTTP_Client_SecureTimeChallengePost(pTimeChallengeURL,
-                                                            (char *)pbChallenge,
-                                                            1,
-                                                            150,
-                                                            (unsigned char**)&(pbResponse),
-                                                            &startOffset,
-                                                            &length);
-        if( post_ret != 0)
-        {
-            LOGGER(LERROR_, "Secure Time Challenge request failed, rc = %d", post_ret);
-            rc = post_ret;
-            goto ErrorExit;
-        }
+        return (failed ? CDMi_S_FALSE : CDMi_SUCCESS);
+    }
+
+    // Creates the deleted DRM store anew on the app context that is already
+    // there, without going through the platform initialization again.
+    // Must not be called with the DRM lock held: the secure clock may be
+    // restarted, which waits for its thread, and that one takes the lock.
+    bool RecreateStore()
+    {
+        DRM_RESULT dr = DRM_SUCCESS;
+        DRMFILETIME ftSystemTime;
+        DRM_SECURETIME_CLOCK_TYPE eClockType;
+        DRM_DWORD dwEncryptionMode = OEM_TEE_DECRYPTION_MODE_HANDLE;
+        bool clockNotSet = false;
 
-        drResponse = Drm_SecureTime_ProcessResponse(
-                pDrmAppCtx,
-                length,
-                (uint8_t *) pbResponse);
-        if ( drResponse != DRM_SUCCESS )
         {
-            LOGGER(LERROR_, "Drm_SecureTime_ProcessResponse failed, drResponse = %x", (unsigned int)drResponse);
-            dr = drResponse;
-            ChkDR( drResponse);
+            SafeCriticalSection lock(drmAppContextMutex_);
+
+            if (m_poAppContext.get() == nullptr) {
+                return false;
+            }
+
+            LOGGER(LINFO_, "Recreating the DRM store %s", m_storeLocation.c_str());
+
+            // A new store has none of the revocation data stored in the old one.
+            m_revocationList.Forget();
+
+            // Closes the store and opens it again, which creates it.
+            ChkDR(Drm_Reinitialize(m_poAppContext.get()));
+
+            ChkDR(Drm_Content_SetProperty(
+                    m_poAppContext.get(),
+                    DRM_CSP_DECRYPTION_OUTPUT_MODE,
+                    (const DRM_BYTE*)&dwEncryptionMode,
+                    sizeof( DRM_DWORD ) ) );
 
+            clockNotSet = (Drm_SecureTime_GetValue(m_poAppContext.get(), &ftSystemTime, &eClockType) == DRM_E_SECURETIME_CLOCK_NOT_SET);
         }
-        LOGGER(LINFO_, "Initialized Playready Secure Clock success.");
 
-        /* NOW testing the system time */
+        // Not under the DRM lock either: the package is mapped and hashed
+        // first, only storing it takes the lock. Content that needs no
+        // revocation data plays without it, so a failure is not fatal.
+        if ((m_pbRevocationBuffer != nullptr) && (m_revocationList.Load([this](uint8_t package[], const uint32_t length) {
+                return (StoreRevocationPackage(package, length)); }) == false)) {
+            LOGGER(LWARNING_, "Error in loading the revocation package %s, continuing without it", DRM_DEFAULT_REVOCATION_LIST_FILE);
+        }
 
-    ErrorExit:
-        SAFE_OEM_FREE(pbChallenge);
+        m_storeHash.Changed();
 
-        if (pTimeChallengeURL != nullptr) {
-            NEXUS_Memory_Free(pTimeChallengeURL);
+        // The DRM lock is released by now: a running clock setup is stopped
+        // first, and that one may be waiting for the lock.
+        if ((clockNotSet == true) && (m_secureClock.IsReady() == false)) {
+            LOGGER(LINFO_, "Secure Clock not set, setting it up in the background");
+            m_secureClock.Start(m_poAppContext.get(), drmAppContextMutex_);
         }
 
-        if (pbResponse != nullptr) {
-            NEXUS_Memory_Free(pbResponse);
+    ErrorExit:
+        if (DRM_FAILED(dr)) {
+            LOGGER(LERROR_, "Error in recreating the DRM store, 0x%08X", static_cast<unsigned int>(dr));
         }
 
-        return rc;
+        return (DRM_SUCCEEDED(dr));
+    }
+
+    bool StoreRevocationPackage(uint8_t package[], const uint32_t length)
+    {
+        SafeCriticalSection lock(drmAppContextMutex_);
+
+        DRM_RESULT dr = DRM_E_FAIL;
+
+        if (m_poAppContext.get() != nullptr) {
+            dr = Drm_Revocation_StorePackage(
+                    m_poAppContext.get(),
+                    reinterpret_cast<DRM_CHAR *>(package),
+                    length);
+
+            if (DRM_FAILED(dr)) {
+                LOGGER(LERROR_,  "Error in Drm_Revocation_StorePackage 0x%08X", static_cast<unsigned int>(dr));
+            } else {
+                LOGGER(LINFO_,  "Revocation package stored (%u bytes)", length);
+            }
+        }
+
+        return (DRM_SUCCEEDED(dr));
     }
 
     CDMi_RESULT CreateSystemExt()
@@ -710,17 +936,27 @@ public:
         m_poAppContext.reset(new DRM_APP_CONTEXT);
         memset(m_poAppContext.get(), 0, sizeof(DRM_APP_CONTEXT));
 
-        m_pbOpaqueBuffer = (DRM_BYTE *)Oem_MemAlloc(MINIMUM_APPCONTEXT_OPAQUE_BUFFER_SIZE);
-        m_cbOpaqueBuffer = MINIMUM_APPCONTEXT_OPAQUE_BUFFER_SIZE;
+        // Start with the opaque buffer as big as it had to grow before, so
+        // binds don't go through the resize steps again.
+        m_tuning.Load(m_persistentStore + ".tuning");
+        m_opaqueBuffer.size = std::min<DRM_DWORD>(std::max<DRM_DWORD>(m_tuning.OpaqueBufferSize(), MINIMUM_APPCONTEXT_OPAQUE_BUFFER_SIZE),
+                                                  DRM_MAXIMUM_APPCONTEXT_OPAQUE_BUFFER_SIZE);
+        m_opaqueBuffer.buffer = (DRM_BYTE *)Oem_MemAlloc(m_opaqueBuffer.size);
+        LOGGER(LINFO_, "Opaque buffer size: %u bytes", static_cast<unsigned int>(m_opaqueBuffer.size));
         
+        // A new store has none of the revocation data stored in an old one.
+        if (Core::File(m_storeLocation).Exists() == false) {
+            m_revocationList.Forget();
+        }
+
         // Store store location
         dstrHDSPath.pwszString =  createDrmWchar(m_storeLocation);
         dstrHDSPath.cchString = m_storeLocation.length();
 
         dr  = Drm_Initialize(m_poAppContext.get(), 
                             m_drmOemContext,
-                            m_pbOpaqueBuffer,
-                            m_cbOpaqueBuffer,
+                            m_opaqueBuffer.buffer,
+                            m_opaqueBuffer.size,
                             &dstrHDSPath);
 
         if(DRM_FAILED(dr)) {
@@ -731,12 +967,10 @@ public:
             dr = Drm_SecureTime_GetValue( m_poAppContext.get(), &ftSystemTime, &eClockType  );
             if( (dr == DRM_E_SECURETIME_CLOCK_NOT_SET) || (dr == DRM_E_TEE_PROVISIONING_REQUIRED) )
             {
-                /* setup the Playready secure clock */
-                if(InitSecureClock(m_poAppContext.get()) != 0)
-                {
-                    LOGGER(LERROR_, "Failed to initiize Secure Clock, quitting...");
-                    goto ErrorExit;
-                }
+                /* setup the Playready secure clock, content that needs it waits for it */
+                LOGGER(LINFO_, "Secure Clock not set, setting it up in the background");
+                m_secureClock.Start(m_poAppContext.get(), drmAppContextMutex_);
+                dr = DRM_SUCCESS;
             }
             else if (dr == DRM_E_CLK_NOT_SUPPORTED)  /* Secure Clock not supported, try the Anti-Rollback Clock */
             {
@@ -775,8 +1009,20 @@ public:
         // Specify the initial size of the in-memory license store. The store will
         // grow above this size if required during usage, using a memory-doubling
         // algorithm. So it is more efficient, but not required, to get the size
-        // correct from the beginning.
-        dr = Drm_ResizeInMemoryLicenseStore(m_poAppContext.get(), MAX_NUM_LICENSES * LICENSE_SIZE_BYTES);
+        // correct from the beginning. With auto sizing it is what the most
+        // licenses ever held at once took, plus a quarter.
+        if ((m_licenseStoreAutoSize == true) && (m_tuning.LicenseStorePeak() > 0)) {
+            const DRM_DWORD peak = m_tuning.LicenseStorePeak();
+            m_licenseStoreUsage.capacity = (peak + (peak / 4) + 1) * LICENSE_SIZE_BYTES;
+        } else {
+            m_licenseStoreUsage.capacity = m_licenseStoreSize;
+        }
+        m_licenseStoreUsage.licenses = 0;
+        m_licenseStoreUsage.resizes = 0;
+        LOGGER(LINFO_, "In-memory license store size: %u bytes (peak %u licenses)",
+            static_cast<unsigned int>(m_licenseStoreUsage.capacity), m_tuning.LicenseStorePeak());
+
+        dr = Drm_ResizeInMemoryLicenseStore(m_poAppContext.get(), m_licenseStoreUsage.capacity);
         if (DRM_FAILED(dr)) {
             LOGGER(LERROR_,  "Error in Drm_ResizeInMemoryLicenseStore 0x%08lX", dr);
             goto ErrorExit;
@@ -790,10 +1036,12 @@ public:
                                         m_pbRevocationBuffer,
                                         REVOCATION_BUFFER_SIZE));
 
-            if( !LoadRevocationList(DRM_DEFAULT_REVOCATION_LIST_FILE))
+            // Content that needs no revocation data plays without it, so a
+            // failure is not fatal.
+            if (m_revocationList.Load([this](uint8_t package[], const uint32_t length) {
+                    return (StoreRevocationPackage(package, length)); }) == false)
             {
-                LOGGER(LERROR_,  "Error in Drm_Revocation_SetBuffer 0x%08lX", dr);
-                goto ErrorExit;
+                LOGGER(LWARNING_,  "Error in loading the revocation package %s, continuing without it", DRM_DEFAULT_REVOCATION_LIST_FILE);
             }
         }
 
@@ -809,6 +1057,10 @@ public:
             m_poAppContext.reset();
             cr =  CDMi_S_FALSE;
             LOGGER(LERROR_,  "Error in creating system ext,  0x%08lX", dr);
+        } else {
+            m_storeHash.Changed();
+            m_storeMaintenance.Start(m_poAppContext.get(), drmAppContextMutex_);
+            m_storeCache.Start();
         }
 
         return cr;
@@ -822,6 +1074,8 @@ public:
 
     CDMi_RESULT DeleteSecureStore() override
     {
+        WaitInitialized();
+
         SafeCriticalSection lock(drmAppContextMutex_);
         
         // As a linux reference implementation, we are cheating a bit by just using
@@ -831,6 +1085,9 @@ public:
         if (remove(m_storeLocation.c_str()) != 0) {
             LOGGER(LINFO_, "Error removing DRM store file");
         }
+        m_storeCache.Remove();
+
+        m_storeHash.Changed();
 
         return CDMi_SUCCESS;
     }
@@ -847,37 +1104,161 @@ public:
             uint8_t secureStoreHash[],
             uint32_t secureStoreHashLength) override
     {
-        SafeCriticalSection lock(drmAppContextMutex_);
+        WaitInitialized();
 
-        if (calcFileSha256(m_storeLocation, secureStoreHash, secureStoreHashLength) == false)
-        {
-            LOGGER(LERROR_, "Error: calcFileSha256 failed");
-            return CDMi_S_FALSE;
+        // Mostly answered from the cache, without waiting for the DRM lock.
+        // Only a store that is being written while it is hashed needs the
+        // lock to get a stable hash.
+        if (m_storeHash.Get(secureStoreHash, secureStoreHashLength) == false) {
+            SafeCriticalSection lock(drmAppContextMutex_);
+
+            if (m_storeHash.Get(secureStoreHash, secureStoreHashLength) == false)
+            {
+                LOGGER(LERROR_, "Error: hashing the secure store failed");
+                return CDMi_S_FALSE;
+            }
         }
 
         return CDMi_SUCCESS;
     }
 
 private:
+    // Returns the cached challenge of the secure stop, signing a new one if
+    // there is none or it timed out. Call with the DRM lock held.
+    const SecureStopChallenge* GenerateSecureStopChallenge(const std::vector<uint8_t>& sessionID)
+    {
+        const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+        SecureStopChallengeMap::iterator entry = m_secureStopChallenges.find(sessionID);
+
+        if ((entry != m_secureStopChallenges.end())
+            && ((now - entry->second.generated) >= std::chrono::seconds(SECURE_STOP_CHALLENGE_TIMEOUT_S))) {
+            m_secureStopChallenges.erase(entry);
+            entry = m_secureStopChallenges.end();
+        }
+
+        if (entry == m_secureStopChallenges.end()) {
+            // Get the secure stop challenge
+            DRM_ID ssSessionDrmId;
+            ASSERT(sizeof(ssSessionDrmId.rgb) >= sessionID.size());
+            ZEROMEM(ssSessionDrmId.rgb, sizeof(ssSessionDrmId.rgb));
+            memcpy(ssSessionDrmId.rgb, sessionID.data(), std::min(sessionID.size(), sizeof(ssSessionDrmId.rgb)));
+
+            DRM_DWORD ssChallengeSize = 0;
+            DRM_BYTE *ssChallenge = nullptr;
+
+            DRM_RESULT dr = Drm_SecureStop_GenerateChallenge(
+                    m_poAppContext.get(),
+                    &ssSessionDrmId,
+                    m_meteringCertificateSize, //playready3MeteringCertSize,
+                    m_meteringCertificate,     //playready3MeteringCert,
+                    0, nullptr, // no custom data
+                    &ssChallengeSize,
+                    &ssChallenge);
+
+            if (dr != DRM_SUCCESS) {
+                LOGGER(LERROR_, "Error in Drm_SecureStop_GenerateChallenge (error: 0x%08X)", static_cast<unsigned int>(dr));
+            } else {
+                SecureStopChallenge& challenge(m_secureStopChallenges[sessionID]);
+                challenge.data.assign(ssChallenge, ssChallenge + ssChallengeSize);
+                challenge.generated = now;
+                entry = m_secureStopChallenges.find(sessionID);
+            }
+
+            SAFE_OEM_FREE(ssChallenge);
+        }
+
+        return ((entry != m_secureStopChallenges.end()) ? &(entry->second) : nullptr);
+    }
+
+    // Call with the DRM lock held.
+    bool ProcessSecureStopResponse(const std::vector<uint8_t>& sessionID, const uint8_t serverResponse[], const uint32_t serverResponseLength)
+    {
+        // Whatever the outcome, a next report needs a fresh challenge.
+        m_secureStopChallenges.erase(sessionID);
+        m_secureStopReport.clear();
+
+        DRM_ID sessionDrmId;
+        ASSERT(sizeof(sessionDrmId.rgb) >= sessionID.size());
+        ZEROMEM(sessionDrmId.rgb, sizeof(sessionDrmId.rgb));
+        memcpy(sessionDrmId.rgb, sessionID.data(), std::min(sessionID.size(), sizeof(sessionDrmId.rgb)));
+
+        DRM_DWORD customDataSizeBytes = 0;
+        DRM_CHAR *pCustomData = NULL;
+        
+        DRM_RESULT dr;
+        dr = Drm_SecureStop_ProcessResponse(
+            m_poAppContext.get(),
+            &sessionDrmId,
+            m_meteringCertificateSize, //playready3MeteringCertSize,
+            m_meteringCertificate,     //playready3MeteringCert,
+            serverResponseLength,
+            serverResponse,
+            &customDataSizeBytes,
+            &pCustomData);
+        if (dr == DRM_SUCCESS)
+        {
+            LOGGER(LINFO_, "secure stop commit successful");
+            if (pCustomData && customDataSizeBytes)
+            {
+                // We currently don't use custom data from the server. Just log here.
+                std::string customDataStr(pCustomData, customDataSizeBytes);
+                LOGGER(LINFO_, "custom data = \"%s\"", customDataStr.c_str());
+            }
+        }
+        else
+        {
+            LOGGER(LERROR_, "Drm_SecureStop_ProcessResponse returned 0x%lx", static_cast<unsigned long>(dr));
+        }
+
+        SAFE_OEM_FREE(pCustomData);
+
+        if (dr == DRM_SUCCESS) {
+            m_storeHash.Changed();
+        }
+
+        return (dr == DRM_SUCCESS);
+    }
+
     DRM_WCHAR* drmdir_;
 
     DRM_VOID *m_drmOemContext;
     NxClient_AllocResults m_nxAllocResults;
+    bool m_nexusJoined;
 
     DRM_WCHAR* m_drmDirectory;
     DRM_CONST_STRING m_drmStore;
 
-    DRM_BYTE *m_pbOpaqueBuffer;
-    DRM_DWORD m_cbOpaqueBuffer;
+    OpaqueBuffer m_opaqueBuffer;
 
     DRM_BYTE *m_pbRevocationBuffer ;
     std::unique_ptr<DRM_APP_CONTEXT> m_poAppContext;
 
     std::string m_readDir;
     std::string m_storeLocation;
+    std::string m_persistentStore;
 
     DRM_BYTE* m_meteringCertificate;
     uint32_t m_meteringCertificateSize;
+
+    BackgroundWorker m_backgroundWorker;
+    CallbackDispatcher m_callbackDispatcher;
+    ChallengeBuffers m_challengeBuffers;
+    Tuning m_tuning;
+    DRM_DWORD m_licenseStoreSize;
+    bool m_licenseStoreAutoSize;
+    LicenseStoreUsage m_licenseStoreUsage;
+    SecureStopChallengeMap m_secureStopChallenges;
+    std::vector<uint8_t> m_secureStopReport;
+    uint32_t m_secureStopReportCount;
+    std::chrono::steady_clock::time_point m_secureStopReportTime;
+    StoreHash m_storeHash;
+    RevocationList m_revocationList;
+    SecureClock m_secureClock;
+    StoreMaintenance m_storeMaintenance;
+    StoreCache m_storeCache;
+    SessionEnvironment m_sessionEnvironment;
+    std::shared_future<void> m_initialized;
 };
 
 static SystemFactoryType<PlayReady> g_instance({"video/x-h264", "audio/mpeg"});
@@ -0,0 +1,221 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "RevocationList.h"
+#include "FileUtils.h"
+
+#include <core/core.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace WPEFramework;
+
+namespace CDMi {
+
+RevocationList::RevocationList()
+    : _lock()
+    , _packageFile()
+    , _recordFile()
+    , _key()
+    , _loaded(false)
+    , _storedHash()
+    , _stored(false)
+    , _preparedKey()
+    , _preparedHash()
+    , _prepared(false)
+{
+}
+
+RevocationList::~RevocationList()
+{
+}
+
+void RevocationList::Configure(const std::string& packageFile, const std::string& recordFile)
+{
+    std::unique_lock<std::mutex> lock(_lock);
+
+    _packageFile = packageFile;
+    _recordFile = recordFile;
+    _loaded = false;
+    _stored = false;
+
+    Core::DataElementFile dataBuffer(_recordFile, Core::File::USER_READ);
+
+    if ((dataBuffer.IsValid() == true) && (dataBuffer.Size() == HashLength)) {
+        ::memcpy(_storedHash, dataBuffer.Buffer(), HashLength);
+        _stored = true;
+    }
+}
+
+void RevocationList::Forget()
+{
+    std::unique_lock<std::mutex> lock(_lock);
+
+    _loaded = false;
+    _stored = false;
+
+    ::remove(_recordFile.c_str());
+}
+
+bool RevocationList::Modified()
+{
+    std::unique_lock<std::mutex> lock(_lock);
+
+    return ((_loaded == false) || (Same(Stat(_packageFile), _key) == false));
+}
+
+bool RevocationList::Load(const Store& store)
+{
+    std::unique_lock<std::mutex> lock(_lock);
+
+    bool result = true;
+    const std::string packageFile(_packageFile);
+    const Key key = Stat(packageFile);
+
+    // A package that Prepare() found to be unchanged is not mapped again.
+    const bool prepared = ((_prepared == true) && (Same(key, _preparedKey) == true)
+        && (_stored == true) && (::memcmp(_preparedHash, _storedHash, HashLength) == 0));
+
+    if (prepared == true) {
+        TRACE_L1("Revocation package %s unchanged, not stored again", packageFile.c_str());
+    } else if ((key.exists == true) && (key.size != 0)) {
+        // Not locked while mapping, hashing and storing: store takes the DRM
+        // lock, which may be held by someone waiting for this one.
+        lock.unlock();
+
+        const int fd = ::open(packageFile.c_str(), O_RDONLY | O_CLOEXEC);
+        const size_t size = static_cast<size_t>(key.size);
+        uint8_t hash[HashLength];
+
+        if ((fd < 0) || (HashFile(fd, key.size, hash) == false)) {
+            TRACE_L1("Failed to hash %s", packageFile.c_str());
+            result = false;
+        } else {
+            lock.lock();
+            const bool unchanged = ((_stored == true) && (::memcmp(hash, _storedHash, HashLength) == 0));
+            lock.unlock();
+
+            // Private and writable: PlayReady may decode the package in place,
+            // that must not end up in the file.
+            void* package = (unchanged == true) ? MAP_FAILED : ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+
+            if (unchanged == true) {
+                TRACE_L1("Revocation package %s unchanged, not stored again", packageFile.c_str());
+            } else if (package == MAP_FAILED) {
+                TRACE_L1("Failed to map %s", packageFile.c_str());
+                result = false;
+            } else {
+                if (store(static_cast<uint8_t*>(package), static_cast<uint32_t>(size)) == false) {
+                    result = false;
+                } else {
+                    lock.lock();
+                    ::memcpy(_storedHash, hash, HashLength);
+                    _stored = true;
+                    Save();
+                    lock.unlock();
+                }
+
+                ::munmap(package, size);
+            }
+        }
+
+        if (fd >= 0) {
+            ::close(fd);
+        }
+
+        lock.lock();
+    }
+
+    if (result == true) {
+        _key = key;
+        _loaded = true;
+    }
+
+    return result;
+}
+
+void RevocationList::Prepare()
+{
+    std::unique_lock<std::mutex> lock(_lock);
+
+    const std::string packageFile(_packageFile);
+    const Key key = Stat(packageFile);
+
+    if ((key.exists == true) && (key.size != 0)) {
+        uint8_t hash[HashLength];
+
+        lock.unlock();
+        const bool hashed = Hash(packageFile, key, hash);
+        lock.lock();
+
+        if (hashed == true) {
+            _preparedKey = key;
+            ::memcpy(_preparedHash, hash, HashLength);
+            _prepared = true;
+        }
+    }
+}
+
+// Call with _lock held.
+void RevocationList::Save() const
+{
+    ReplaceFile(_recordFile, _storedHash, HashLength);
+}
+
+/* static */ bool RevocationList::Hash(const std::string& fileName, const Key& key, uint8_t hash[HashLength])
+{
+    const int fd = ::open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+    const bool result = ((fd >= 0) && (HashFile(fd, key.size, hash) == true));
+
+    if (fd >= 0) {
+        ::close(fd);
+    }
+
+    return result;
+}
+
+/* static */ RevocationList::Key RevocationList::Stat(const std::string& fileName)
+{
+    Key key;
+    struct stat info;
+
+    ::memset(&key, 0, sizeof(key));
+
+    if (::stat(fileName.c_str(), &info) == 0) {
+        key.exists = true;
+        key.inode = info.st_ino;
+        key.size = info.st_size;
+        key.modified = info.st_mtim;
+    }
+
+    return key;
+}
+
+/* static */ bool RevocationList::Same(const Key& lhs, const Key& rhs)
+{
+    return ((lhs.exists == rhs.exists) && (lhs.inode == rhs.inode) && (lhs.size == rhs.size)
+        && (lhs.modified.tv_sec == rhs.modified.tv_sec) && (lhs.modified.tv_nsec == rhs.modified.tv_nsec));
+}
+
+} // namespace CDMi
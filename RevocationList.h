@@ -0,0 +1,97 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include "FileUtils.h"
+
+#include <functional>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <sys/stat.h>
+
+namespace CDMi {
+
+// The revocation package file, handed to the DRM store only when its
+// content changed. The hash of the package that was stored last is kept in
+// a record file next to the store, so an unchanged package is not stored
+// again on every start either.
+class RevocationList {
+public:
+    static constexpr uint32_t HashLength = SHA256_LENGTH;
+
+    // Stores the package in the DRM store; the package may be modified.
+    typedef std::function<bool(uint8_t package[], const uint32_t length)> Store;
+
+    RevocationList(const RevocationList&) = delete;
+    RevocationList& operator=(const RevocationList&) = delete;
+
+    RevocationList();
+    ~RevocationList();
+
+    void Configure(const std::string& packageFile, const std::string& recordFile);
+
+    // The DRM store was created anew and holds no revocation data yet.
+    void Forget();
+
+    // Whether the package file changed since it was last loaded. Only a
+    // stat(), cheap enough for the OCDM call path.
+    bool Modified();
+
+    // Hands the package to store if its content differs from what was stored
+    // last. The file is mapped and hashed before store is called, so store
+    // only needs the DRM lock for the store itself. A missing package file
+    // is not an error.
+    bool Load(const Store& store);
+
+    // Hashes the package ahead of Load(), e.g. while the DRM store is not
+    // open yet. Load() of an unchanged package then does not map it again.
+    void Prepare();
+
+private:
+    struct Key {
+        bool exists;
+        ino_t inode;
+        off_t size;
+        struct timespec modified;
+    };
+
+    void Save() const;
+
+    static bool Hash(const std::string& fileName, const Key& key, uint8_t hash[HashLength]);
+
+    static Key Stat(const std::string& fileName);
+    static bool Same(const Key& lhs, const Key& rhs);
+
+private:
+    std::mutex _lock;
+    std::string _packageFile;
+    std::string _recordFile;
+    Key _key;
+    bool _loaded;
+    uint8_t _storedHash[HashLength];
+    bool _stored;
+    Key _preparedKey;
+    uint8_t _preparedHash[HashLength];
+    bool _prepared;
+};
+
+} // namespace CDMi
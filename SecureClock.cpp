@@ -0,0 +1,448 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "SecureClock.h"
+#include "FileUtils.h"
+#include "MediaSession.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <time.h>
+
+#include <drmsecuretime.h>
+#include <drmsecuretimeconstants.h>
+#include <prdy_http.h>
+
+using namespace WPEFramework;
+
+using SafeCriticalSection = Core::SafeSyncType<Core::CriticalSection>;
+
+namespace CDMi {
+
+#define MAX_TIME_CHALLENGE_RESPONSE_LENGTH (1024*64)
+#define MAX_URL_LENGTH (512)
+
+// A failed setup is retried after this many seconds, doubling up to the
+// maximum for every failure in a row.
+static const uint32_t SECURE_CLOCK_RETRY_MIN_S = 2;
+static const uint32_t SECURE_CLOCK_RETRY_MAX_S = 300;
+
+// Time the challenge POST may take, in seconds.
+static const uint32_t SECURE_CLOCK_POST_TIMEOUT_S = 150;
+
+// Redirects followed from the forward link to the time server.
+static const uint32_t SECURE_CLOCK_MAX_REDIRECTS = 5;
+
+// The time server URL the forward link resolved to is used directly for
+// this long, in seconds, saving the petition round trips.
+static const uint64_t SECURE_TIME_URL_TTL_S = 24 * 60 * 60;
+
+namespace {
+
+// The Broadcom prdy_http client, which wants its buffers from Nexus memory.
+class PrdyHttpClient : public SecureClock::IHttpClient {
+public:
+    PrdyHttpClient(const PrdyHttpClient&) = delete;
+    PrdyHttpClient& operator=(const PrdyHttpClient&) = delete;
+
+    PrdyHttpClient()
+    {
+    }
+    ~PrdyHttpClient() override
+    {
+    }
+
+    int32_t GetForwardLinkUrl(const std::string& url, uint32_t& status, std::string& location) override
+    {
+        return (Petition(PRDY_HTTP_Client_GetForwardLinkUrl, url, status, location));
+    }
+    int32_t GetSecureTimeUrl(const std::string& url, uint32_t& status, std::string& location) override
+    {
+        return (Petition(PRDY_HTTP_Client_GetSecureTimeUrl, url, status, location));
+    }
+    int32_t PostChallenge(const std::string& url, const std::vector<uint8_t>& challenge, std::vector<uint8_t>& response) override
+    {
+        NEXUS_MemoryAllocationSettings allocSettings;
+        DRM_BYTE* pbResponse = nullptr;
+        uint32_t startOffset = 0;
+        uint32_t length = 0;
+        std::vector<char> urlString(url.begin(), url.end());
+        std::vector<char> challengeString(challenge.begin(), challenge.end());
+
+        urlString.push_back('\0');
+        challengeString.push_back('\0');
+
+        NEXUS_Memory_GetDefaultAllocationSettings(&allocSettings);
+        int32_t rc = NEXUS_Memory_Allocate(MAX_TIME_CHALLENGE_RESPONSE_LENGTH, &allocSettings, (void **)(&pbResponse));
+        if (rc == NEXUS_SUCCESS) {
+            BKNI_Memset(pbResponse, 0, MAX_TIME_CHALLENGE_RESPONSE_LENGTH);
+
+            rc = PRDY_HTTP_Client_SecureTimeChallengePost(&urlString[0],
+                                                          &challengeString[0],
+                                                          1,
+                                                          SECURE_CLOCK_POST_TIMEOUT_S,
+                                                          (unsigned char**)&(pbResponse),
+                                                          &startOffset,
+                                                          &length);
+            if (rc == 0) {
+                response.assign(pbResponse, pbResponse + std::min<uint32_t>(length, MAX_TIME_CHALLENGE_RESPONSE_LENGTH));
+            }
+
+            NEXUS_Memory_Free(pbResponse);
+        }
+
+        return rc;
+    }
+
+private:
+    typedef int32_t (*PetitionRequest)(char* url, uint32_t* status, char** location);
+
+    int32_t Petition(PetitionRequest request, const std::string& url, uint32_t& status, std::string& location)
+    {
+        NEXUS_MemoryAllocationSettings allocSettings;
+        char* pLocation = nullptr;
+        char urlString[MAX_URL_LENGTH];
+
+        if (url.size() >= sizeof(urlString)) {
+            return -1;
+        }
+        memset(urlString, 0, sizeof(urlString));
+        memcpy(urlString, url.c_str(), url.size());
+
+        NEXUS_Memory_GetDefaultAllocationSettings(&allocSettings);
+        int32_t rc = NEXUS_Memory_Allocate(MAX_URL_LENGTH, &allocSettings, (void **)(&pLocation));
+        if (rc == NEXUS_SUCCESS) {
+            memset(pLocation, 0, MAX_URL_LENGTH);
+
+            rc = request(urlString, &status, &pLocation);
+            if (rc == 0) {
+                location.assign(pLocation, strnlen(pLocation, MAX_URL_LENGTH));
+            }
+
+            NEXUS_Memory_Free(pLocation);
+        }
+
+        return rc;
+    }
+};
+
+PrdyHttpClient g_prdyHttpClient;
+
+class UrlCacheData : public Core::JSON::Container {
+public:
+    UrlCacheData(const UrlCacheData&) = delete;
+    UrlCacheData& operator=(const UrlCacheData&) = delete;
+    UrlCacheData()
+        : Core::JSON::Container()
+        , Server()
+        , Url()
+        , Resolved(0)
+    {
+        Add(_T("server"), &Server);
+        Add(_T("url"), &Url);
+        Add(_T("resolved"), &Resolved);
+    }
+    ~UrlCacheData()
+    {
+    }
+
+public:
+    Core::JSON::String Server;
+    Core::JSON::String Url;
+    Core::JSON::DecUInt64 Resolved;
+};
+
+} // namespace
+
+SecureClock::SecureClock()
+    : _lock()
+    , _signal()
+    , _client(&g_prdyHttpClient)
+    , _server(reinterpret_cast<const char*>(g_dstrHttpSecureTimeServerUrl.pszString), g_dstrHttpSecureTimeServerUrl.cchString)
+    , _cacheFile()
+    , _appContext(nullptr)
+    , _drmLock(nullptr)
+    , _thread()
+    , _running(false)
+    , _ready(true)
+    , _attempts(0)
+{
+}
+
+SecureClock::~SecureClock()
+{
+    Stop();
+}
+
+void SecureClock::HttpClient(IHttpClient* client)
+{
+    std::unique_lock<std::mutex> lock(_lock);
+
+    _client = (client != nullptr) ? client : &g_prdyHttpClient;
+}
+
+void SecureClock::Server(const std::string& forwardLink)
+{
+    std::unique_lock<std::mutex> lock(_lock);
+
+    if (forwardLink.empty() == false) {
+        _server = forwardLink;
+    } else {
+        _server.assign(reinterpret_cast<const char*>(g_dstrHttpSecureTimeServerUrl.pszString), g_dstrHttpSecureTimeServerUrl.cchString);
+    }
+}
+
+void SecureClock::CacheFile(const std::string& fileName)
+{
+    std::unique_lock<std::mutex> lock(_lock);
+
+    _cacheFile = fileName;
+}
+
+void SecureClock::Start(DRM_APP_CONTEXT* appContext, WPEFramework::Core::CriticalSection& drmLock)
+{
+    Stop();
+
+    std::unique_lock<std::mutex> lock(_lock);
+
+    _appContext = appContext;
+    _drmLock = &drmLock;
+    _running = true;
+    _ready = false;
+    _attempts = 0;
+    _thread = std::thread(&SecureClock::Process, this);
+}
+
+void SecureClock::Stop()
+{
+    std::unique_lock<std::mutex> lock(_lock);
+
+    _running = false;
+    _signal.notify_all();
+
+    if (_thread.joinable() == true) {
+        std::thread thread(std::move(_thread));
+        lock.unlock();
+
+        thread.join();
+
+        lock.lock();
+    }
+
+    _appContext = nullptr;
+    _drmLock = nullptr;
+}
+
+bool SecureClock::IsReady() const
+{
+    std::unique_lock<std::mutex> lock(_lock);
+
+    return (_ready);
+}
+
+bool SecureClock::WaitReady(const uint32_t waitTime) const
+{
+    std::unique_lock<std::mutex> lock(_lock);
+
+    _signal.wait_for(lock, std::chrono::milliseconds(waitTime), [this]() { return ((_ready == true) || (_running == false)); });
+
+    return (_ready);
+}
+
+void SecureClock::Process()
+{
+    std::unique_lock<std::mutex> lock(_lock);
+
+    uint32_t retry = SECURE_CLOCK_RETRY_MIN_S;
+
+    while ((_running == true) && (_ready == false)) {
+        const std::string server(_server);
+        const std::string cacheFile(_cacheFile);
+
+        _attempts++;
+
+        lock.unlock();
+        const bool set = Setup(server, cacheFile);
+        lock.lock();
+
+        if (set == true) {
+            _ready = true;
+            _signal.notify_all();
+        } else if (_running == true) {
+            LOGGER(LWARNING_, "Secure clock setup attempt %u failed, retrying in %u s", _attempts, retry);
+            _signal.wait_for(lock, std::chrono::seconds(retry), [this]() { return (_running == false); });
+            retry = std::min(retry * 2, SECURE_CLOCK_RETRY_MAX_S);
+        }
+    }
+}
+
+// Only the DRM calls are made with the DRM lock held, not the HTTP requests.
+bool SecureClock::Setup(const std::string& server, const std::string& cacheFile)
+{
+    DRM_RESULT dr = DRM_SUCCESS;
+    std::vector<uint8_t> challenge;
+    std::vector<uint8_t> response;
+    std::string url;
+
+    {
+        SafeCriticalSection drmLock(*_drmLock);
+
+        DRM_DWORD cbChallenge = 0;
+        DRM_BYTE* pbChallenge = nullptr;
+
+        dr = Drm_SecureTime_GenerateChallenge(_appContext, &cbChallenge, &pbChallenge);
+        if (DRM_SUCCEEDED(dr)) {
+            challenge.assign(pbChallenge, pbChallenge + cbChallenge);
+        } else {
+            LOGGER(LERROR_, "Error in Drm_SecureTime_GenerateChallenge (error: 0x%08X)", static_cast<unsigned int>(dr));
+        }
+        SAFE_OEM_FREE(pbChallenge);
+    }
+
+    if (DRM_FAILED(dr)) {
+        return false;
+    }
+
+    // The time server the forward link resolved to before is tried first,
+    // a full resolution is the fallback.
+    bool cached = CachedUrl(cacheFile, server, url);
+
+    if ((cached == false) && (ResolveUrl(server, url) == false)) {
+        return false;
+    }
+
+    int32_t rc = _client->PostChallenge(url, challenge, response);
+    if ((rc != 0) && (cached == true)) {
+        LOGGER(LWARNING_, "Secure Time Challenge request to cached %s failed, rc = %d, resolving again", url.c_str(), rc);
+
+        ::remove(cacheFile.c_str());
+        cached = false;
+
+        if (ResolveUrl(server, url) == false) {
+            return false;
+        }
+
+        response.clear();
+        rc = _client->PostChallenge(url, challenge, response);
+    }
+    if (rc != 0) {
+        LOGGER(LERROR_, "Secure Time Challenge request failed, rc = %d", rc);
+        return false;
+    }
+
+    if (cached == false) {
+        CacheUrl(cacheFile, server, url);
+    }
+
+    {
+        SafeCriticalSection drmLock(*_drmLock);
+
+        dr = Drm_SecureTime_ProcessResponse(_appContext, response.size(), response.data());
+    }
+
+    if (dr != DRM_SUCCESS) {
+        LOGGER(LERROR_, "Drm_SecureTime_ProcessResponse failed, drResponse = %x", (unsigned int)dr);
+        return false;
+    }
+
+    LOGGER(LINFO_, "Initialized Playready Secure Clock success.");
+
+    return true;
+}
+
+/* static */ bool SecureClock::CachedUrl(const std::string& cacheFile, const std::string& server, std::string& url)
+{
+    bool result = false;
+
+    if (cacheFile.empty() == false) {
+        Core::DataElementFile dataBuffer(cacheFile, Core::File::USER_READ);
+
+        if (dataBuffer.IsValid() == true) {
+            UrlCacheData data;
+            data.FromString(std::string(reinterpret_cast<const char*>(dataBuffer.Buffer()), static_cast<size_t>(dataBuffer.Size())));
+
+            const uint64_t now = static_cast<uint64_t>(time(nullptr));
+            const uint64_t resolved = data.Resolved.Value();
+
+            // A clock that went back since counts as expired too.
+            if ((data.Server.Value() == server) && (data.Url.Value().empty() == false)
+                && (resolved <= now) && ((now - resolved) < SECURE_TIME_URL_TTL_S)) {
+                url = data.Url.Value();
+                result = true;
+            }
+        }
+    }
+
+    return result;
+}
+
+/* static */ void SecureClock::CacheUrl(const std::string& cacheFile, const std::string& server, const std::string& url)
+{
+    if (cacheFile.empty() == false) {
+        UrlCacheData data;
+        data.Server = server;
+        data.Url = url;
+        data.Resolved = static_cast<uint64_t>(time(nullptr));
+
+        std::string text;
+        data.ToString(text);
+
+        ReplaceFile(cacheFile, reinterpret_cast<const uint8_t*>(text.c_str()), text.length());
+    }
+}
+
+// Follows the forward link, and its redirects, to the time server URL.
+bool SecureClock::ResolveUrl(const std::string& server, std::string& url)
+{
+    uint32_t status = 0;
+    uint32_t redirects = 0;
+    std::string location;
+
+    /* send the petition request to Microsoft with HTTP GET */
+    int32_t rc = _client->GetForwardLinkUrl(server, status, location);
+    if (rc != 0) {
+        LOGGER(LERROR_, " Secure Time forward link petition request failed, rc = %d", rc);
+        return false;
+    }
+
+    /* we need to check if the Pettion responded with redirection */
+    while (((status == 302) || (status == 301)) && (redirects++ < SECURE_CLOCK_MAX_REDIRECTS)) {
+        const std::string redirect(location);
+
+        location.clear();
+        rc = _client->GetSecureTimeUrl(redirect, status, location);
+        if (rc != 0) {
+            LOGGER(LERROR_, " Secure Time URL petition request failed, rc = %d", rc);
+            return false;
+        }
+    }
+
+    if (status != 200) {
+        LOGGER(LERROR_, "Secure Clock Petition responded with unsupported result, rc = %d, can't get the time challenge URL", status);
+        return false;
+    }
+
+    url = location;
+
+    return true;
+}
+
+} // namespace CDMi
@@ -0,0 +1,105 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <core/core.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <drmmanager.h>
+
+namespace CDMi {
+
+// Sets the PlayReady secure clock from the Microsoft time server on a thread
+// of its own, retrying with backoff until it succeeds. Nothing waits for it
+// unless it needs secure time; see WaitReady().
+class SecureClock {
+public:
+    // The HTTP requests of the secure clock setup. Replaceable, e.g. by a
+    // local stand-in for testing.
+    struct IHttpClient {
+        virtual ~IHttpClient() {}
+
+        // GET on the forward link. status is the HTTP status, location the
+        // URL it redirects to (or the time server URL with a 200).
+        virtual int32_t GetForwardLinkUrl(const std::string& url, uint32_t& status, std::string& location) = 0;
+        // As above, for following a redirect.
+        virtual int32_t GetSecureTimeUrl(const std::string& url, uint32_t& status, std::string& location) = 0;
+        // POSTs the time challenge, response receives the time server's answer.
+        virtual int32_t PostChallenge(const std::string& url, const std::vector<uint8_t>& challenge, std::vector<uint8_t>& response) = 0;
+    };
+
+    SecureClock(const SecureClock&) = delete;
+    SecureClock& operator=(const SecureClock&) = delete;
+
+    SecureClock();
+    ~SecureClock();
+
+    // Not owned. Defaults to the prdy_http client; set before Start().
+    void HttpClient(IHttpClient* client);
+    // Forward link to the time server, the PlayReady one if empty.
+    void Server(const std::string& forwardLink);
+    // Where the time server URL the forward link resolved to is kept, so
+    // that later setups (also after a restart) can skip the petition.
+    void CacheFile(const std::string& fileName);
+
+    // Sets up the clock of appContext, which must outlive the next Stop().
+    // Every use of appContext is done with lock held. Like Stop(), must not
+    // be called with lock held.
+    void Start(DRM_APP_CONTEXT* appContext, WPEFramework::Core::CriticalSection& lock);
+    // Gives up on a setup in progress, waits for a request in flight. Must not
+    // be called with the DRM lock held, the setup may be waiting for it.
+    void Stop();
+
+    // The clock is set; also true if it never needed a setup.
+    bool IsReady() const;
+    // Waits up to waitTime milliseconds for the clock to be set. Must not be
+    // called with the DRM lock held, the setup needs it.
+    bool WaitReady(const uint32_t waitTime) const;
+
+private:
+    void Process();
+    bool Setup(const std::string& server, const std::string& cacheFile);
+    bool ResolveUrl(const std::string& server, std::string& url);
+
+    static bool CachedUrl(const std::string& cacheFile, const std::string& server, std::string& url);
+    static void CacheUrl(const std::string& cacheFile, const std::string& server, const std::string& url);
+
+private:
+    mutable std::mutex _lock;
+    mutable std::condition_variable _signal;
+    IHttpClient* _client;
+    std::string _server;
+    std::string _cacheFile;
+    DRM_APP_CONTEXT* _appContext;
+    WPEFramework::Core::CriticalSection* _drmLock;
+    std::thread _thread;
+    bool _running;
+    bool _ready;
+    uint32_t _attempts;
+};
+
+} // namespace CDMi
@@ -0,0 +1,59 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include "cdmi.h"
+
+#include <stdint.h>
+
+namespace CDMi {
+
+// Reports all pending secure stops in one go, instead of one
+// GetSecureStopIds() plus a GetSecureStop() and CommitSecureStop() per ID,
+// each of which takes the DRM lock and scans the store again.
+// Implemented next to IMediaKeysExt, obtain it with a dynamic_cast from the
+// IMediaKeys instance. OCDM clients get at it through the IMediaKeysExt
+// secure stop calls: GetSecureStop() and CommitSecureStop() without a
+// session ID report and commit all pending secure stops in this format.
+//
+// Secure stops are passed packed, one record after the other:
+//   session ID  SECURE_STOP_ID_SIZE bytes
+//   length      4 bytes, big endian
+//   data        length bytes (the challenge, or the server response)
+struct IMediaKeysSecureStops {
+    static constexpr uint32_t SECURE_STOP_ID_SIZE = 16;
+    static constexpr uint32_t SECURE_STOP_HEADER_SIZE = SECURE_STOP_ID_SIZE + 4;
+
+    virtual ~IMediaKeysSecureStops() {}
+
+    // Packs the challenges of all pending secure stops into challenges.
+    // challengesLength is the size of the buffer on input and the size of
+    // the packed challenges on output. Without a buffer, or with one too
+    // small (CDMi_OUT_OF_MEMORY), only the size is returned; the challenges
+    // are kept for the next call.
+    virtual CDMi_RESULT GetSecureStops(uint8_t challenges[], uint32_t& challengesLength, uint32_t& count) = 0;
+
+    // Commits the packed server responses, committed receives how many were
+    // accepted. Fails if any of them was not.
+    virtual CDMi_RESULT CommitSecureStops(const uint8_t responses[], const uint32_t responsesLength, uint32_t& committed) = 0;
+};
+
+} // namespace CDMi
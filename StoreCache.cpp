@@ -0,0 +1,252 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "StoreCache.h"
+#include "FileUtils.h"
+#include "MediaSession.h"
+
+#include <chrono>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+using namespace WPEFramework;
+
+using SafeCriticalSection = Core::SafeSyncType<Core::CriticalSection>;
+
+namespace CDMi {
+
+StoreCache::StoreCache()
+    : _lock()
+    , _flushLock()
+    , _signal()
+    , _persistentFile()
+    , _workingFile()
+    , _flushInterval(0)
+    , _drmLock(nullptr)
+    , _thread()
+    , _running(false)
+    , _flushed()
+    , _valid(false)
+    , _generation(0)
+{
+}
+
+StoreCache::~StoreCache()
+{
+    Stop();
+}
+
+void StoreCache::Configure(const std::string& persistentFile, const std::string& workingFile, const uint32_t flushInterval,
+                           Core::CriticalSection& drmLock)
+{
+    std::unique_lock<std::mutex> lock(_lock);
+
+    _persistentFile = persistentFile;
+    _workingFile = workingFile;
+    _flushInterval = flushInterval;
+    _drmLock = &drmLock;
+    _valid = false;
+}
+
+bool StoreCache::IsEnabled() const
+{
+    return ((_workingFile.empty() == false) && (_workingFile != _persistentFile));
+}
+
+bool StoreCache::Restore()
+{
+    if (IsEnabled() == false) {
+        return true;
+    }
+
+    std::unique_lock<std::mutex> flushLock(_flushLock);
+
+    struct stat working;
+    struct stat persistent;
+    const bool haveWorking = (::stat(_workingFile.c_str(), &working) == 0);
+    const bool havePersistent = (::stat(_persistentFile.c_str(), &persistent) == 0);
+    bool result = true;
+
+    if ((havePersistent == true) && ((haveWorking == false)
+        || (working.st_mtim.tv_sec < persistent.st_mtim.tv_sec)
+        || ((working.st_mtim.tv_sec == persistent.st_mtim.tv_sec) && (working.st_mtim.tv_nsec < persistent.st_mtim.tv_nsec)))) {
+        std::vector<uint8_t> data;
+        Key key;
+
+        result = ((Read(_persistentFile, data, key) == true) && (ReplaceFile(_workingFile, data.data(), data.size()) == true));
+
+        if (result == false) {
+            LOGGER(LERROR_, "Failed to copy the DRM store %s to %s", _persistentFile.c_str(), _workingFile.c_str());
+        } else {
+            LOGGER(LINFO_, "DRM store copied to %s, %u bytes", _workingFile.c_str(), static_cast<unsigned int>(data.size()));
+        }
+    }
+
+    // Whatever the working file is now, it has not been written back.
+    std::unique_lock<std::mutex> lock(_lock);
+    _valid = false;
+
+    return result;
+}
+
+void StoreCache::Start()
+{
+    Stop();
+
+    std::unique_lock<std::mutex> lock(_lock);
+
+    if ((IsEnabled() == true) && (_flushInterval > 0)) {
+        _running = true;
+        _thread = std::thread(&StoreCache::Process, this);
+    }
+}
+
+void StoreCache::Stop()
+{
+    std::unique_lock<std::mutex> lock(_lock);
+
+    _running = false;
+    _signal.notify_all();
+
+    if (_thread.joinable() == true) {
+        std::thread thread(std::move(_thread));
+        lock.unlock();
+
+        thread.join();
+
+        lock.lock();
+    }
+}
+
+// The snapshot is taken with the DRM lock held, so the store is not in the
+// middle of a write, but only written to flash after it is released.
+bool StoreCache::Flush()
+{
+    if (IsEnabled() == false) {
+        return true;
+    }
+
+    std::unique_lock<std::mutex> flushLock(_flushLock);
+
+    std::vector<uint8_t> snapshot;
+    Key key;
+    uint32_t generation;
+    bool unchanged;
+
+    {
+        SafeCriticalSection drmLock(*_drmLock);
+
+        if (Read(_workingFile, snapshot, key) == false) {
+            // No store (yet), nothing to write back.
+            return true;
+        }
+
+        std::unique_lock<std::mutex> lock(_lock);
+        unchanged = ((_valid == true) && (_flushed.size == key.size)
+            && (_flushed.modified.tv_sec == key.modified.tv_sec) && (_flushed.modified.tv_nsec == key.modified.tv_nsec));
+        generation = _generation;
+    }
+
+    if (unchanged == true) {
+        return true;
+    }
+
+    bool result = WriteNewFile(_persistentFile, snapshot.data(), snapshot.size());
+
+    std::unique_lock<std::mutex> lock(_lock);
+
+    // A store deleted in the meantime must not come back.
+    if (generation != _generation) {
+        DiscardNewFile(_persistentFile);
+        result = true;
+    } else if ((result == true) && (CommitNewFile(_persistentFile) == true)) {
+        _flushed = key;
+        _valid = true;
+        TRACE_L1("DRM store written back, %u bytes", static_cast<unsigned int>(snapshot.size()));
+    } else {
+        result = false;
+    }
+
+    return result;
+}
+
+void StoreCache::Remove()
+{
+    if (IsEnabled() == true) {
+        std::unique_lock<std::mutex> lock(_lock);
+
+        ::remove(_persistentFile.c_str());
+        _generation++;
+        _valid = false;
+    }
+}
+
+void StoreCache::Process()
+{
+    std::unique_lock<std::mutex> lock(_lock);
+
+    while (_running == true) {
+        _signal.wait_for(lock, std::chrono::seconds(_flushInterval), [this]() { return (_running == false); });
+
+        if (_running == true) {
+            lock.unlock();
+            const bool flushed = Flush();
+            lock.lock();
+
+            if (flushed == false) {
+                LOGGER(LERROR_, "Failed to write back the DRM store to %s", _persistentFile.c_str());
+            }
+        }
+    }
+}
+
+/* static */ bool StoreCache::Read(const std::string& fileName, std::vector<uint8_t>& data, Key& key)
+{
+    bool result = false;
+    const int fd = ::open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat info;
+
+    if ((fd >= 0) && (::fstat(fd, &info) == 0)) {
+        ssize_t count = 0;
+        size_t offset = 0;
+
+        data.resize(info.st_size);
+
+        while ((offset < data.size()) && ((count = ::read(fd, &data[offset], data.size() - offset)) > 0)) {
+            offset += count;
+        }
+
+        if (offset == data.size()) {
+            key.size = info.st_size;
+            key.modified = info.st_mtim;
+            result = true;
+        }
+    }
+
+    if (fd >= 0) {
+        ::close(fd);
+    }
+
+    return result;
+}
+
+} // namespace CDMi
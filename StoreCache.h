@@ -0,0 +1,96 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <core/core.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <vector>
+
+namespace CDMi {
+
+// Keeps the working copy of the DRM store on a RAM backed file system, so
+// commits do not wait for (and wear out) flash. The copy is written back to
+// the persistent store on a schedule and at shutdown, as a snapshot that
+// replaces the persistent file atomically; a crash loses at most the changes
+// since the last write back.
+class StoreCache {
+public:
+    StoreCache(const StoreCache&) = delete;
+    StoreCache& operator=(const StoreCache&) = delete;
+
+    StoreCache();
+    ~StoreCache();
+
+    // Caching is off if workingFile is the persistentFile. drmLock guards
+    // every write to the working file.
+    void Configure(const std::string& persistentFile, const std::string& workingFile, const uint32_t flushInterval,
+                   WPEFramework::Core::CriticalSection& drmLock);
+
+    bool IsEnabled() const;
+
+    // Copies the persistent store to the working file, unless that is at
+    // least as recent (e.g. after a restart without a reboot). Call before
+    // the store is opened.
+    bool Restore();
+
+    // Writes back every flushInterval seconds, while the working file
+    // changed.
+    void Start();
+    void Stop();
+
+    // Writes back now, if the working file changed since the last time.
+    bool Flush();
+
+    // The store was deleted, delete the persistent one as well.
+    void Remove();
+
+private:
+    struct Key {
+        off_t size;
+        struct timespec modified;
+    };
+
+    void Process();
+
+    static bool Read(const std::string& fileName, std::vector<uint8_t>& data, Key& key);
+
+private:
+    std::mutex _lock;
+    std::mutex _flushLock;
+    std::condition_variable _signal;
+    std::string _persistentFile;
+    std::string _workingFile;
+    uint32_t _flushInterval;
+    WPEFramework::Core::CriticalSection* _drmLock;
+    std::thread _thread;
+    bool _running;
+    Key _flushed;
+    bool _valid;
+    uint32_t _generation;
+};
+
+} // namespace CDMi
@@ -0,0 +1,167 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "StoreHash.h"
+#include "FileUtils.h"
+
+#include <core/core.h>
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+using namespace WPEFramework;
+
+namespace CDMi {
+
+StoreHash::StoreHash()
+    : _lock()
+    , _fileName()
+    , _key()
+    , _hash()
+    , _valid(false)
+    , _worker()
+{
+}
+
+StoreHash::~StoreHash()
+{
+    Stop();
+}
+
+void StoreHash::FileName(const std::string& fileName)
+{
+    std::unique_lock<std::mutex> lock(_lock);
+
+    _fileName = fileName;
+    _valid = false;
+}
+
+bool StoreHash::Get(uint8_t hash[], const uint32_t hashLength)
+{
+    ASSERT(hashLength == Length);
+
+    bool result = false;
+
+    if (hashLength == Length) {
+        std::unique_lock<std::mutex> lock(_lock);
+
+        if (Update() == true) {
+            ::memcpy(hash, _hash, Length);
+            result = true;
+        }
+    } else {
+        TRACE_L1("Output hash buffer has a incorrect size(%d), need %d bytes", hashLength, Length);
+    }
+
+    return result;
+}
+
+void StoreHash::Changed()
+{
+    _worker.Submit([this]() {
+        std::unique_lock<std::mutex> lock(_lock);
+        Update();
+    });
+}
+
+void StoreHash::Stop()
+{
+    _worker.Stop();
+}
+
+// Call with _lock held.
+bool StoreHash::Update()
+{
+    Key current;
+
+    if (Stat(_fileName, current) == false) {
+        _valid = false;
+    } else if ((_valid == false) || (Same(current, _key) == false)) {
+        _valid = Calculate(_fileName, _hash, _key);
+    }
+
+    return _valid;
+}
+
+/* static */ bool StoreHash::Stat(const std::string& fileName, Key& key)
+{
+    struct stat info;
+
+    if (::stat(fileName.c_str(), &info) != 0) {
+        return false;
+    }
+
+    key.device = info.st_dev;
+    key.inode = info.st_ino;
+    key.size = info.st_size;
+    key.modified = info.st_mtim;
+
+    return true;
+}
+
+/* static */ bool StoreHash::Same(const Key& lhs, const Key& rhs)
+{
+    return ((lhs.device == rhs.device) && (lhs.inode == rhs.inode) && (lhs.size == rhs.size)
+        && (lhs.modified.tv_sec == rhs.modified.tv_sec) && (lhs.modified.tv_nsec == rhs.modified.tv_nsec));
+}
+
+/* static */ bool StoreHash::Calculate(const std::string& fileName, uint8_t hash[], Key& key)
+{
+    bool result = false;
+
+    ASSERT(fileName.empty() == false);
+
+    const int fd = ::open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0) {
+        TRACE_L1("Failed to open %s", fileName.c_str());
+    } else {
+        struct stat before;
+        struct stat after;
+
+        if (::fstat(fd, &before) == 0) {
+            const bool complete = HashFile(fd, before.st_size, hash);
+
+            if (complete == false) {
+                TRACE_L1("Failed to read %s", fileName.c_str());
+            }
+
+            // PlayReady may have written the store while it was hashed.
+            if ((complete == true) && (::fstat(fd, &after) == 0)
+                && (after.st_size == before.st_size)
+                && (after.st_mtim.tv_sec == before.st_mtim.tv_sec) && (after.st_mtim.tv_nsec == before.st_mtim.tv_nsec)) {
+
+                key.device = before.st_dev;
+                key.inode = before.st_ino;
+                key.size = before.st_size;
+                key.modified = before.st_mtim;
+
+                result = true;
+            }
+        }
+
+        ::close(fd);
+    }
+
+    return result;
+}
+
+} // namespace CDMi
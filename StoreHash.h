@@ -0,0 +1,83 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include "FileUtils.h"
+
+#include "BackgroundWorker.h"
+
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <sys/stat.h>
+
+namespace CDMi {
+
+// SHA-256 of the DRM store file, cached for as long as the file keeps its
+// inode, size and modification time. The file is hashed without the DRM
+// lock; a hash during which the file changed is not trusted.
+class StoreHash {
+public:
+    static constexpr uint32_t Length = SHA256_LENGTH;
+
+    StoreHash(const StoreHash&) = delete;
+    StoreHash& operator=(const StoreHash&) = delete;
+
+    StoreHash();
+    ~StoreHash();
+
+    void FileName(const std::string& fileName);
+
+    // Copies the hash of the file as it is now into hash, hashing it only if
+    // it changed since the last time. Fails if the file can not be read, or
+    // keeps changing while it is hashed (hold the DRM lock and retry then).
+    bool Get(uint8_t hash[], const uint32_t hashLength);
+
+    // The store was (probably) written, hash it again in the background so
+    // that the next Get() does not have to.
+    void Changed();
+
+    void Stop();
+
+private:
+    struct Key {
+        dev_t device;
+        ino_t inode;
+        off_t size;
+        struct timespec modified;
+    };
+
+    bool Update();
+
+    static bool Stat(const std::string& fileName, Key& key);
+    static bool Same(const Key& lhs, const Key& rhs);
+    static bool Calculate(const std::string& fileName, uint8_t hash[], Key& key);
+
+private:
+    std::mutex _lock;
+    std::string _fileName;
+    Key _key;
+    uint8_t _hash[Length];
+    bool _valid;
+    BackgroundWorker _worker;
+};
+
+} // namespace CDMi
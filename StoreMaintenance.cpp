@@ -0,0 +1,255 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "StoreMaintenance.h"
+#include "MediaSession.h"
+
+#include <algorithm>
+#include <sys/stat.h>
+
+using namespace WPEFramework;
+
+using SafeCriticalSection = Core::SafeSyncType<Core::CriticalSection>;
+
+namespace CDMi {
+
+// The DRM must not have been used for this long before the store is cleaned
+// up, in milliseconds.
+static const uint32_t STORE_MAINTENANCE_IDLE_MS = 5000;
+
+// A cleanup step holds the DRM lock for at most this long, in milliseconds,
+// and the next step follows after the interval.
+static const uint32_t STORE_MAINTENANCE_BUDGET_MS = 50;
+static const uint32_t STORE_MAINTENANCE_INTERVAL_MS = 1000;
+
+// A cleanup pass can not be resumed, every step starts it over. So each step
+// that ran out of time gets twice the budget of the one before, and after
+// this many the pass may take as long as it needs, as long as the DRM is not
+// wanted.
+static const uint32_t STORE_MAINTENANCE_BOUNDED_STEPS = 4;
+
+// Steps given up before the cleanup is, until the store grows again.
+static const uint32_t STORE_MAINTENANCE_MAX_STEPS = 16;
+
+// Licenses visited between checks of the time budget.
+static const DRM_DWORD STORE_MAINTENANCE_CHECK_INTERVAL = 8;
+
+static int64_t Now()
+{
+    return (std::chrono::steady_clock::now().time_since_epoch().count());
+}
+
+StoreMaintenance::StoreMaintenance()
+    : _lock()
+    , _signal()
+    , _storeFile()
+    , _high(0)
+    , _low(0)
+    , _cleanSize(0)
+    , _appContext(nullptr)
+    , _drmLock(nullptr)
+    , _thread()
+    , _lastActivity(Now())
+    , _running(false)
+    , _pending(false)
+    , _active(false)
+    , _steps(0)
+{
+}
+
+StoreMaintenance::~StoreMaintenance()
+{
+    Stop();
+}
+
+void StoreMaintenance::Configure(const std::string& storeFile, const uint32_t capacity, const uint32_t highWatermark, const uint32_t lowWatermark)
+{
+    std::unique_lock<std::mutex> lock(_lock);
+
+    _storeFile = storeFile;
+    _high = (static_cast<off_t>(capacity) * highWatermark) / 100;
+    _low = (static_cast<off_t>(capacity) * std::min(lowWatermark, highWatermark)) / 100;
+}
+
+void StoreMaintenance::Start(DRM_APP_CONTEXT* appContext, Core::CriticalSection& drmLock)
+{
+    Stop();
+
+    std::unique_lock<std::mutex> lock(_lock);
+
+    _appContext = appContext;
+    _drmLock = &drmLock;
+    _running = true;
+    _pending = false;
+    _active = true;
+    _steps = 0;
+    _cleanSize = 0;
+    _thread = std::thread(&StoreMaintenance::Process, this);
+}
+
+void StoreMaintenance::Stop()
+{
+    std::unique_lock<std::mutex> lock(_lock);
+
+    _running = false;
+    _signal.notify_all();
+
+    if (_thread.joinable() == true) {
+        std::thread thread(std::move(_thread));
+        lock.unlock();
+
+        thread.join();
+
+        lock.lock();
+    }
+
+    _appContext = nullptr;
+    _drmLock = nullptr;
+}
+
+void StoreMaintenance::Activity()
+{
+    _lastActivity.store(Now(), std::memory_order_relaxed);
+}
+
+void StoreMaintenance::Changed()
+{
+    std::unique_lock<std::mutex> lock(_lock);
+
+    _pending = true;
+    _signal.notify_all();
+}
+
+DRM_RESULT StoreMaintenance::Cleanup(DRM_APP_CONTEXT* appContext)
+{
+    LOGGER(LINFO_, "Cleaning up the full DRM store");
+
+    const DRM_RESULT dr = Drm_StoreMgmt_CleanupStore(appContext, DRM_STORE_CLEANUP_ALL, nullptr, 0, nullptr);
+
+    if (DRM_FAILED(dr)) {
+        LOGGER(LERROR_, "Error in Drm_StoreMgmt_CleanupStore (error: 0x%08X)", static_cast<unsigned int>(dr));
+    }
+
+    return dr;
+}
+
+void StoreMaintenance::Process()
+{
+    std::unique_lock<std::mutex> lock(_lock);
+
+    const std::chrono::steady_clock::duration idle = std::chrono::milliseconds(STORE_MAINTENANCE_IDLE_MS);
+
+    while (_running == true) {
+        if (_pending == true) {
+            const off_t size = Size();
+
+            _pending = false;
+
+            // The store file does not necessarily shrink by a cleanup, so it
+            // has to have grown since the last one, too.
+            if ((_active == false) && (_high > 0) && (size >= _high) && (size > _cleanSize)) {
+                LOGGER(LINFO_, "DRM store at %ld bytes, cleanup scheduled", static_cast<long>(size));
+                _active = true;
+            }
+        }
+
+        if (_active == false) {
+            _signal.wait(lock, [this]() { return ((_running == false) || (_pending == true)); });
+            continue;
+        }
+
+        const std::chrono::steady_clock::duration quiet =
+            std::chrono::steady_clock::duration(Now() - _lastActivity.load(std::memory_order_relaxed));
+
+        if (quiet < idle) {
+            _signal.wait_for(lock, idle - quiet, [this]() { return (_running == false); });
+            continue;
+        }
+
+        lock.unlock();
+        const bool completed = Step(_steps);
+        lock.lock();
+
+        if (completed == true) {
+            _active = false;
+            _steps = 0;
+            _cleanSize = Size();
+            LOGGER(LINFO_, "DRM store cleaned up, %ld bytes", static_cast<long>(_cleanSize));
+        } else if ((_low > 0) && (Size() <= _low)) {
+            _active = false;
+            _steps = 0;
+        } else if (++_steps >= STORE_MAINTENANCE_MAX_STEPS) {
+            // The DRM keeps being used halfway the pass, try again once the
+            // store grew further.
+            _active = false;
+            _steps = 0;
+            _cleanSize = Size();
+            LOGGER(LWARNING_, "DRM store cleanup given up at %ld bytes", static_cast<long>(_cleanSize));
+        } else {
+            _signal.wait_for(lock, std::chrono::milliseconds(STORE_MAINTENANCE_INTERVAL_MS), [this]() { return (_running == false); });
+        }
+    }
+}
+
+// One cleanup pass over the store, given up once it takes longer than the
+// budget of the step or the DRM is wanted. Returns whether the pass completed.
+bool StoreMaintenance::Step(const uint32_t step)
+{
+    SafeCriticalSection drmLock(*_drmLock);
+
+    Budget budget;
+    budget.started = Now();
+    budget.deadline = (step >= STORE_MAINTENANCE_BOUNDED_STEPS) ? 0 :
+        budget.started + std::chrono::steady_clock::duration(std::chrono::milliseconds(STORE_MAINTENANCE_BUDGET_MS << step)).count();
+    budget.activity = &_lastActivity;
+    budget.exceeded = false;
+
+    const DRM_RESULT dr = Drm_StoreMgmt_CleanupStore(_appContext, DRM_STORE_CLEANUP_ALL, &budget,
+                                                     STORE_MAINTENANCE_CHECK_INTERVAL, Progress);
+
+    if ((DRM_FAILED(dr)) && (budget.exceeded == false)) {
+        // Not retried before the store changes again.
+        LOGGER(LERROR_, "Error in Drm_StoreMgmt_CleanupStore (error: 0x%08X)", static_cast<unsigned int>(dr));
+    }
+
+    return (budget.exceeded == false);
+}
+
+off_t StoreMaintenance::Size() const
+{
+    struct stat info;
+
+    return ((::stat(_storeFile.c_str(), &info) == 0) ? info.st_size : 0);
+}
+
+/* static */ DRM_RESULT DRM_CALL StoreMaintenance::Progress(const DRM_VOID* data, DRM_DWORD /* done */, DRM_DWORD /* total */)
+{
+    Budget* budget = const_cast<Budget*>(static_cast<const Budget*>(data));
+    const int64_t now = Now();
+
+    if (((budget->deadline != 0) && (now >= budget->deadline)) || (budget->activity->load(std::memory_order_relaxed) > budget->started)) {
+        budget->exceeded = true;
+        return (DRM_E_FAIL);
+    }
+
+    return (DRM_SUCCESS);
+}
+
+} // namespace CDMi
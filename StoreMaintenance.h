@@ -0,0 +1,105 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <core/core.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <sys/types.h>
+#include <thread>
+
+#include <drmmanager.h>
+
+namespace CDMi {
+
+// Keeps the DRM (HDS) store from filling up. Once the store file grows past
+// the high watermark, expired licenses are cleaned up on a thread of its own
+// until it is back under the low watermark. Cleanup only runs while the DRM
+// has not been used for a while, and gives the DRM lock back after a time
+// budget, so playback is not held up by it. The budget grows with every step
+// given up, and the cleanup is given up itself after too many.
+class StoreMaintenance {
+public:
+    StoreMaintenance(const StoreMaintenance&) = delete;
+    StoreMaintenance& operator=(const StoreMaintenance&) = delete;
+
+    StoreMaintenance();
+    ~StoreMaintenance();
+
+    // Watermarks are percentages of capacity, in bytes of the store file.
+    void Configure(const std::string& storeFile, const uint32_t capacity, const uint32_t highWatermark, const uint32_t lowWatermark);
+
+    // Maintains the store of appContext, which must outlive the next Stop().
+    // Every use of appContext is done with lock held. The first idle period
+    // after a start is used for a cleanup regardless of the watermarks.
+    void Start(DRM_APP_CONTEXT* appContext, WPEFramework::Core::CriticalSection& lock);
+    // Waits for a cleanup step in progress to give up.
+    void Stop();
+
+    // The DRM is in use, maintenance waits until it was idle for a while.
+    // Cheap enough for the decrypt path.
+    void Activity();
+    // The store (probably) grew, check it against the watermarks.
+    void Changed();
+
+    // Cleans up the whole store at once, for when it is full already. Call
+    // with the DRM lock held.
+    DRM_RESULT Cleanup(DRM_APP_CONTEXT* appContext);
+
+private:
+    // Steady clock ticks, like _lastActivity. A deadline of 0 means none.
+    struct Budget {
+        int64_t started;
+        int64_t deadline;
+        const std::atomic<int64_t>* activity;
+        bool exceeded;
+    };
+
+    void Process();
+    bool Step(const uint32_t step);
+    off_t Size() const;
+
+    static DRM_RESULT DRM_CALL Progress(const DRM_VOID* data, DRM_DWORD done, DRM_DWORD total);
+
+private:
+    std::mutex _lock;
+    std::condition_variable _signal;
+    std::string _storeFile;
+    off_t _high;
+    off_t _low;
+    off_t _cleanSize;
+    DRM_APP_CONTEXT* _appContext;
+    WPEFramework::Core::CriticalSection* _drmLock;
+    std::thread _thread;
+    std::atomic<int64_t> _lastActivity;
+    bool _running;
+    bool _pending;
+    bool _active;
+    // Steps of the current cleanup given up so far.
+    uint32_t _steps;
+};
+
+} // namespace CDMi
@@ -0,0 +1,136 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "Tuning.h"
+#include "FileUtils.h"
+
+#include <core/core.h>
+
+using namespace WPEFramework;
+
+namespace CDMi {
+
+namespace {
+
+class TuningData : public Core::JSON::Container {
+public:
+    TuningData(const TuningData&) = delete;
+    TuningData& operator=(const TuningData&) = delete;
+    TuningData()
+        : Core::JSON::Container()
+        , OpaqueBufferSize(0)
+        , LicenseStorePeak(0)
+    {
+        Add(_T("opaquebuffersize"), &OpaqueBufferSize);
+        Add(_T("licensestorepeak"), &LicenseStorePeak);
+    }
+    ~TuningData()
+    {
+    }
+
+public:
+    Core::JSON::DecUInt32 OpaqueBufferSize;
+    Core::JSON::DecUInt32 LicenseStorePeak;
+};
+
+} // namespace
+
+Tuning::Tuning()
+    : _fileName()
+    , _opaqueBufferSize(0)
+    , _licenseStorePeak(0)
+    , _savedOpaqueBufferSize(0)
+    , _savedLicenseStorePeak(0)
+    , _measured(false)
+{
+}
+
+Tuning::~Tuning()
+{
+}
+
+void Tuning::Load(const std::string& fileName)
+{
+    _fileName = fileName;
+    _opaqueBufferSize = 0;
+    _licenseStorePeak = 0;
+    _measured = false;
+
+    Core::DataElementFile dataBuffer(_fileName, Core::File::USER_READ);
+
+    if (dataBuffer.IsValid() == false) {
+        TRACE_L1(_T("No tuning recorded in %s"), _fileName.c_str());
+    } else {
+        TuningData data;
+        data.FromString(std::string(reinterpret_cast<const char*>(dataBuffer.Buffer()), static_cast<size_t>(dataBuffer.Size())));
+
+        _opaqueBufferSize = data.OpaqueBufferSize.Value();
+        _licenseStorePeak = data.LicenseStorePeak.Value();
+    }
+
+    // The opaque buffer only ever grows, but unless this run holds as many
+    // licenses again, the next start reserves less for them. Written once
+    // this run measured something.
+    _savedOpaqueBufferSize = _opaqueBufferSize;
+    _savedLicenseStorePeak = _licenseStorePeak - (_licenseStorePeak / 4);
+}
+
+void Tuning::OpaqueBufferSize(const uint32_t size)
+{
+    Record(_savedOpaqueBufferSize, size);
+}
+
+void Tuning::LicenseStorePeak(const uint32_t licenses)
+{
+    Record(_savedLicenseStorePeak, licenses);
+}
+
+void Tuning::Record(uint32_t& value, const uint32_t newValue)
+{
+    // The first measurement also saves the decay.
+    bool changed = ((_measured == false) && (_savedLicenseStorePeak != _licenseStorePeak));
+
+    _measured = true;
+
+    if (newValue > value) {
+        value = newValue;
+        changed = true;
+    }
+
+    if (changed == true) {
+        Save();
+    }
+}
+
+void Tuning::Save() const
+{
+    if (_fileName.empty() == false) {
+        TuningData data;
+        data.OpaqueBufferSize = _savedOpaqueBufferSize;
+        data.LicenseStorePeak = _savedLicenseStorePeak;
+
+        std::string text;
+        data.ToString(text);
+
+        ReplaceFile(_fileName, reinterpret_cast<const uint8_t*>(text.c_str()), text.length());
+    }
+}
+
+} // namespace CDMi
@@ -0,0 +1,80 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+namespace CDMi {
+
+// Sizes the DRM system learned it needs at runtime, kept in a small JSON file
+// next to the store so that the next start can allocate them up front instead
+// of growing step by step again. The opaque buffer size is a high-water mark.
+// The license store peak is that of the current run, or what the earlier runs
+// recorded decayed by a quarter if that is more, so one heavy title does not
+// make every later start over-reserve. The file is only written when a run
+// measures something.
+// Not thread safe, only to be used with the DRM app context lock held.
+class Tuning {
+public:
+    Tuning(const Tuning&) = delete;
+    Tuning& operator=(const Tuning&) = delete;
+
+    Tuning();
+    ~Tuning();
+
+    // Reads the values recorded in fileName, which is also where they are
+    // saved from now on. A missing or unreadable file leaves all values 0.
+    void Load(const std::string& fileName);
+
+    // Largest opaque buffer the DRM app context needed, as recorded when
+    // loaded.
+    uint32_t OpaqueBufferSize() const
+    {
+        return _opaqueBufferSize;
+    }
+    // Records the opaque buffer size reached in this run.
+    void OpaqueBufferSize(const uint32_t size);
+
+    // Most licenses the in-memory license store held at once, as recorded
+    // when loaded.
+    uint32_t LicenseStorePeak() const
+    {
+        return _licenseStorePeak;
+    }
+    // Records the number of licenses held at once in this run.
+    void LicenseStorePeak(const uint32_t licenses);
+
+private:
+    void Record(uint32_t& value, const uint32_t newValue);
+    void Save() const;
+
+private:
+    std::string _fileName;
+    uint32_t _opaqueBufferSize;
+    uint32_t _licenseStorePeak;
+    // What is saved for the next start.
+    uint32_t _savedOpaqueBufferSize;
+    uint32_t _savedLicenseStorePeak;
+    bool _measured;
+};
+
+} // namespace CDMi
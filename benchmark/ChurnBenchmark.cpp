@@ -0,0 +1,302 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// Session churn, as in a channel-zap storm: sessions are created, licensed,
+// used for a few decrypts and destroyed again, by a number of concurrent
+// players at a given rate. Reports the time of each phase and what the churn
+// leaves behind: resident memory, Nexus heap, threads and decrypt contexts.
+
+#include "Harness.h"
+#include "Report.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace CDMi;
+
+namespace {
+
+const char USAGE[] =
+    "Usage: PlayReadyChurnBenchmark [options]\n"
+    "  --concurrency=LIST  concurrent players, e.g. 1,4,8\n"
+    "  --rate=LIST         sessions per second over all players, 0 for as fast as possible\n"
+    "  --decrypts=N        decrypts per session (default 4)\n"
+    "  --sample=BYTES      size of the decrypted samples (default 16384)";
+
+const uint32_t DEFAULT_CYCLES = 200;
+const uint32_t QUICK_CYCLES = 20;
+const uint32_t DEFAULT_DECRYPTS = 4;
+const uint32_t DEFAULT_SAMPLE_SIZE = 16 * 1024;
+const uint32_t KEYS_PER_SESSION = 2;
+
+// Time for the callback dispatcher and prefetch jobs of the last sessions to
+// drain before what is left is counted as leaked.
+const uint32_t SETTLE_TIME_MS = 200;
+
+enum Phase {
+    CREATE,
+    RUN,
+    UPDATE,
+    DECRYPT,
+    DESTROY,
+    PHASES
+};
+
+const char* const PHASE_NAMES[PHASES] = { "create", "run", "update", "decrypt", "destroy" };
+
+struct Case {
+    uint32_t concurrency;
+    uint32_t rate;
+    uint32_t cycles;
+    uint32_t decrypts;
+    uint32_t sampleSize;
+};
+
+struct Player {
+    Player()
+        : phases()
+        , cycles()
+        , failures(0)
+    {
+    }
+
+    Benchmark::Latencies phases[PHASES];
+    Benchmark::Latencies cycles;
+    uint32_t failures;
+};
+
+// One zap: a session for another channel (key IDs), from creation to
+// destruction. Returns false if the session did not get usable keys, it is
+// destroyed without decrypting then.
+bool Zap(Benchmark::System& system, const Case& test, const uint8_t channel, std::vector<uint8_t>& sample, Player& player)
+{
+    const std::vector<FakePlayReady::KeyId> keyIds(Benchmark::KeyIds(KEYS_PER_SESSION, channel));
+    const std::vector<uint8_t> initData(FakePlayReady::BuildPssh(keyIds, true));
+    Benchmark::Callback callback;
+    bool succeeded = true;
+
+    const uint64_t begin = Benchmark::NowNs();
+    MediaKeySession* session = system.CreateSession(initData);
+    const uint64_t created = Benchmark::NowNs();
+
+    session->Run(&callback);
+    const std::vector<uint8_t> challenge(callback.Challenge(5000));
+    const uint64_t ran = Benchmark::NowNs();
+
+    // The license server is not part of the plugin, it is left out.
+    const std::vector<uint8_t> response(FakePlayReady::LicenseResponse(challenge.data(), challenge.size()));
+
+    const uint64_t updating = Benchmark::NowNs();
+    session->Update(response.data(), response.size());
+    const uint64_t updated = Benchmark::NowNs();
+
+    succeeded = ((challenge.empty() == false) && (session->ready() == true));
+
+    for (uint32_t i = 0; (i < test.decrypts) && (succeeded == true); i++) {
+        uint8_t iv[8] = { 0, 0, 0, 0, 0, 0, 0, static_cast<uint8_t>(i) };
+        uint32_t outputSize = 0;
+        uint8_t* output = nullptr;
+        succeeded = (session->Decrypt(nullptr, 0, nullptr, 0, iv, sizeof(iv), sample.data(), sample.size(),
+            &outputSize, &output, keyIds[0].size(), keyIds[0].data(), false) == CDMi_SUCCESS);
+    }
+    const uint64_t decrypted = Benchmark::NowNs();
+
+    session->Close();
+    system.DestroySession(session);
+    const uint64_t destroyed = Benchmark::NowNs();
+
+    player.phases[CREATE].Add(created - begin);
+    player.phases[RUN].Add(ran - created);
+    player.phases[UPDATE].Add(updated - updating);
+    player.phases[DECRYPT].Add(decrypted - updated);
+    player.phases[DESTROY].Add(destroyed - decrypted);
+    player.cycles.Add((destroyed - begin) - (updating - ran));
+
+    return (succeeded);
+}
+
+void Zapping(Benchmark::System& system, const Case& test, const uint32_t index, Player& player)
+{
+    std::vector<uint8_t> sample(test.sampleSize, 0x5A);
+    const std::chrono::steady_clock::time_point start(std::chrono::steady_clock::now());
+    const std::chrono::nanoseconds interval((test.rate == 0) ? 0 : (1000000000ULL * test.concurrency) / test.rate);
+
+    for (uint32_t cycle = 0; cycle < test.cycles; cycle++) {
+        if (test.rate != 0) {
+            std::this_thread::sleep_until(start + (interval * cycle));
+        }
+
+        // Every player zaps through channels of its own.
+        const uint8_t channel = static_cast<uint8_t>((index * 16) + (cycle % 16));
+        if (Zap(system, test, channel, sample, player) == false) {
+            player.failures++;
+        }
+    }
+}
+
+void Run(Benchmark::System& system, const Case& test, Benchmark::Report& report)
+{
+    std::vector<Player> players(test.concurrency);
+
+    const uint32_t threadsBefore = Benchmark::Threads();
+    const uint64_t residentBefore = Benchmark::Resident();
+    FakeNexus_HeapUsage nexusBefore;
+    FakeNexus_GetHeapUsage(&nexusBefore);
+    const uint32_t contextsBefore = FakePlayReady::GetStatistics().openDecryptContexts;
+    Benchmark::ResetPeakResident();
+
+    const uint64_t begin = Benchmark::NowNs();
+    std::vector<std::thread> threads;
+    for (uint32_t i = 0; i < test.concurrency; i++) {
+        threads.emplace_back(Zapping, std::ref(system), std::cref(test), i, std::ref(players[i]));
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    const uint64_t elapsed = Benchmark::NowNs() - begin;
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(SETTLE_TIME_MS));
+
+    const uint64_t peakResident = Benchmark::PeakResident();
+    const uint64_t residentAfter = Benchmark::Resident();
+    FakeNexus_HeapUsage nexusAfter;
+    FakeNexus_GetHeapUsage(&nexusAfter);
+    const uint32_t contextsAfter = FakePlayReady::GetStatistics().openDecryptContexts;
+    const uint32_t threadsAfter = Benchmark::Threads();
+
+    Benchmark::Latencies phases[PHASES];
+    Benchmark::Latencies cycles;
+    uint32_t failures = 0;
+    for (const Player& player : players) {
+        for (uint32_t phase = 0; phase < PHASES; phase++) {
+            phases[phase].Merge(player.phases[phase]);
+        }
+        cycles.Merge(player.cycles);
+        failures += player.failures;
+    }
+
+    // Counted rather than fatal: concurrent sessions on the one app context
+    // are part of what is measured.
+    if (failures > 0) {
+        fprintf(stderr, "%u of %zu sessions did not get usable keys\n", failures, cycles.Count());
+    }
+
+    report.Parameter("concurrency", test.concurrency);
+    report.Parameter("rate", test.rate);
+    report.Parameter("decrypts", test.decrypts);
+    report.Value("failed_sessions", failures, Benchmark::Metric::LOWER_IS_BETTER, 0);
+    report.Value("sessions_per_s", cycles.Count() / (elapsed / 1e9), Benchmark::Metric::HIGHER_IS_BETTER);
+    report.Value("cycle_p50_us", cycles.Percentile(50) / 1000.0, Benchmark::Metric::LOWER_IS_BETTER, 10);
+    report.Value("cycle_p99_us", cycles.Percentile(99) / 1000.0, Benchmark::Metric::LOWER_IS_BETTER, 10);
+    for (uint32_t phase = 0; phase < PHASES; phase++) {
+        const std::string name(PHASE_NAMES[phase]);
+        report.Value(name + "_p50_us", phases[phase].Percentile(50) / 1000.0, Benchmark::Metric::LOWER_IS_BETTER, 5);
+        report.Value(name + "_p99_us", phases[phase].Percentile(99) / 1000.0, Benchmark::Metric::LOWER_IS_BETTER, 5);
+    }
+    report.Value("peak_rss_kib", static_cast<double>(peakResident), Benchmark::Metric::LOWER_IS_BETTER, 1024);
+    report.Value("rss_growth_kib", static_cast<double>(residentAfter) - static_cast<double>(residentBefore),
+        Benchmark::Metric::LOWER_IS_BETTER, 1024);
+    report.Value("nexus_peak_kib", nexusAfter.peakBytes / 1024.0, Benchmark::Metric::LOWER_IS_BETTER, 64);
+    report.Value("nexus_leaked_kib", (static_cast<double>(nexusAfter.currentBytes) - static_cast<double>(nexusBefore.currentBytes)) / 1024.0,
+        Benchmark::Metric::LOWER_IS_BETTER, 0);
+    report.Value("leaked_threads", static_cast<double>(threadsAfter) - static_cast<double>(threadsBefore),
+        Benchmark::Metric::LOWER_IS_BETTER, 0);
+    report.Value("leaked_decrypt_contexts", static_cast<double>(contextsAfter) - static_cast<double>(contextsBefore),
+        Benchmark::Metric::LOWER_IS_BETTER, 0);
+    report.Add();
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    Benchmark::Options options;
+    if (options.Parse(argc, argv, USAGE) == false) {
+        return (1);
+    }
+
+    std::vector<uint32_t> concurrencies = (options.quick == true) ? std::vector<uint32_t>({ 1, 4 }) : std::vector<uint32_t>({ 1, 4, 8 });
+    std::vector<uint32_t> rates = { 0 };
+    Case base;
+    base.cycles = (options.iterations != 0) ? options.iterations : ((options.quick == true) ? QUICK_CYCLES : DEFAULT_CYCLES);
+    base.decrypts = DEFAULT_DECRYPTS;
+    base.sampleSize = DEFAULT_SAMPLE_SIZE;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string argument(argv[i]);
+        bool valid = true;
+        if (argument.compare(0, 14, "--concurrency=") == 0) {
+            valid = (Benchmark::ParseList(argument.substr(14), concurrencies) == true) &&
+                    (std::find(concurrencies.begin(), concurrencies.end(), 0) == concurrencies.end());
+        } else if (argument.compare(0, 7, "--rate=") == 0) {
+            valid = Benchmark::ParseList(argument.substr(7), rates);
+        } else if (argument.compare(0, 11, "--decrypts=") == 0) {
+            base.decrypts = static_cast<uint32_t>(::strtoul(argument.c_str() + 11, nullptr, 10));
+        } else if (argument.compare(0, 9, "--sample=") == 0) {
+            base.sampleSize = static_cast<uint32_t>(::strtoul(argument.c_str() + 9, nullptr, 10));
+            valid = (base.sampleSize > 0);
+        } else {
+            printf("Unknown option %s\n%s\n", argument.c_str(), USAGE);
+            return (1);
+        }
+        if (valid == false) {
+            printf("Invalid option %s\n%s\n", argument.c_str(), USAGE);
+            return (1);
+        }
+    }
+
+    Benchmark::System system;
+    if (system.IsValid() == false) {
+        return (1);
+    }
+
+    // One zap first, so the threads and buffers the system sets up on first
+    // use are not counted against the first case.
+    {
+        Case warmup(base);
+        warmup.concurrency = 1;
+        warmup.rate = 0;
+        std::vector<uint8_t> sample(base.sampleSize, 0);
+        Player player;
+        if (Zap(system, warmup, 0xFF, sample, player) == false) {
+            fprintf(stderr, "Could not license a session\n");
+            return (1);
+        }
+    }
+
+    Benchmark::Report report("churn");
+
+    for (uint32_t rate : rates) {
+        for (uint32_t concurrency : concurrencies) {
+            Case test(base);
+            test.concurrency = concurrency;
+            test.rate = rate;
+
+            Run(system, test, report);
+        }
+    }
+
+    return (options.Finish(report));
+}
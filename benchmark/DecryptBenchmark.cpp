@@ -0,0 +1,321 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// Decrypt throughput and latency of MediaKeySession::Decrypt(), over sample
+// sizes from an audio frame to a 4K I-frame, with and without subsamples, for
+// both IV conventions and with one or more sessions decrypting at once.
+
+#include "Harness.h"
+#include "Report.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace CDMi;
+
+namespace {
+
+const char USAGE[] =
+    "Usage: PlayReadyDecryptBenchmark [options]\n"
+    "  --sizes=LIST      sample sizes, e.g. 200,16K,2M\n"
+    "  --sessions=LIST   concurrent sessions, e.g. 1,4";
+
+// Encrypted bytes per case for the default number of iterations, bounded so
+// small samples still finish quickly and large ones give a usable p99.9.
+const uint64_t BYTES_PER_CASE = 256 * 1024 * 1024;
+const uint32_t MIN_ITERATIONS = 1000;
+const uint32_t MAX_ITERATIONS = 20000;
+const uint32_t QUICK_ITERATIONS = 200;
+const uint32_t WARMUP_ITERATIONS = 16;
+
+// Subsampled samples are split in NAL units of this size, each with a clear
+// header.
+const uint32_t NAL_UNIT_SIZE = 16 * 1024;
+const uint32_t NAL_HEADER_SIZE = 64;
+
+struct Case {
+    uint32_t size;
+    bool subsamples;
+    bool netflix;
+    uint32_t sessions;
+    uint32_t iterations;
+};
+
+// One licensed session with a sample encrypted for its key.
+struct Stream {
+    Stream()
+        : session(nullptr)
+        , callback()
+        , keyId()
+        , sample()
+        , subsamples()
+        , latencies()
+        , failures(0)
+    {
+    }
+
+    MediaKeySession* session;
+    Benchmark::Callback callback;
+    FakePlayReady::KeyId keyId;
+    std::vector<uint8_t> sample;
+    std::vector<uint32_t> subsamples;
+    Benchmark::Latencies latencies;
+    uint32_t failures;
+};
+
+const uint64_t SAMPLE_IV = 0x0123456789ABCDEFULL;
+
+void Prepare(Stream& stream, const Case& test)
+{
+    stream.sample.resize(test.size);
+    for (uint32_t i = 0; i < test.size; i++) {
+        stream.sample[i] = static_cast<uint8_t>(i * 31 + 7);
+    }
+
+    stream.subsamples.clear();
+    if (test.subsamples == true) {
+        for (uint32_t offset = 0; offset < test.size; offset += NAL_UNIT_SIZE) {
+            const uint32_t unit = std::min(NAL_UNIT_SIZE, test.size - offset);
+            const uint32_t clear = std::min(NAL_HEADER_SIZE, unit);
+            stream.subsamples.push_back(clear);
+            stream.subsamples.push_back(unit - clear);
+        }
+    }
+
+    FakePlayReady::EncryptSample(stream.keyId, SAMPLE_IV, stream.subsamples, stream.sample.data(), stream.sample.size());
+    stream.latencies = Benchmark::Latencies();
+    stream.latencies.Reserve(test.iterations);
+    stream.failures = 0;
+}
+
+CDMi_RESULT Decrypt(Stream& stream, const Case& test)
+{
+    uint32_t outputSize = 0;
+    uint8_t* output = nullptr;
+    const uint32_t* mapping = (stream.subsamples.empty() == true) ? nullptr : stream.subsamples.data();
+
+    if (test.netflix == true) {
+        DRM_AES_COUNTER_MODE_CONTEXT context = { SAMPLE_IV, 0, 0 };
+        return (stream.session->Decrypt(nullptr, 0, mapping, stream.subsamples.size(),
+            reinterpret_cast<const uint8_t*>(&context), sizeof(context),
+            stream.sample.data(), stream.sample.size(), &outputSize, &output,
+            stream.keyId.size(), stream.keyId.data(), true));
+    }
+
+    // Decrypt() puts the IV in host order in place.
+    uint8_t iv[sizeof(SAMPLE_IV)];
+    for (uint32_t i = 0; i < sizeof(iv); i++) {
+        iv[i] = static_cast<uint8_t>(SAMPLE_IV >> (56 - (8 * i)));
+    }
+    return (stream.session->Decrypt(nullptr, 0, mapping, stream.subsamples.size(), iv, sizeof(iv),
+        stream.sample.data(), stream.sample.size(), &outputSize, &output,
+        stream.keyId.size(), stream.keyId.data(), false));
+}
+
+void Decrypting(Stream& stream, const Case& test, std::atomic<uint32_t>& warm, std::atomic<bool>& start)
+{
+    // The first calls size the Nexus buffers, they are not measured.
+    for (uint32_t i = 0; i < WARMUP_ITERATIONS; i++) {
+        Decrypt(stream, test);
+    }
+    warm++;
+
+    while (start.load() == false) {
+        std::this_thread::yield();
+    }
+
+    for (uint32_t i = 0; i < test.iterations; i++) {
+        const uint64_t begin = Benchmark::NowNs();
+        const CDMi_RESULT result = Decrypt(stream, test);
+        stream.latencies.Add(Benchmark::NowNs() - begin);
+
+        if (result != CDMi_SUCCESS) {
+            stream.failures++;
+        }
+    }
+}
+
+bool Run(std::vector<std::unique_ptr<Stream>>& streams, const Case& test, Benchmark::Report& report)
+{
+    for (uint32_t i = 0; i < test.sessions; i++) {
+        Prepare(*streams[i], test);
+    }
+
+    std::atomic<uint32_t> warm(0);
+    std::atomic<bool> start(false);
+    std::vector<std::thread> threads;
+    for (uint32_t i = 0; i < test.sessions; i++) {
+        threads.emplace_back(Decrypting, std::ref(*streams[i]), std::cref(test), std::ref(warm), std::ref(start));
+    }
+
+    while (warm.load() < test.sessions) {
+        std::this_thread::yield();
+    }
+
+    FakeNexus_HeapUsage nexusBefore;
+    FakeNexus_GetHeapUsage(&nexusBefore);
+    const uint64_t allocationsBefore = Benchmark::Allocations();
+    const uint64_t begin = Benchmark::NowNs();
+
+    start = true;
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    const uint64_t elapsed = Benchmark::NowNs() - begin;
+    const uint64_t allocations = Benchmark::Allocations() - allocationsBefore;
+    FakeNexus_HeapUsage nexusAfter;
+    FakeNexus_GetHeapUsage(&nexusAfter);
+
+    Benchmark::Latencies latencies;
+    uint32_t failures = 0;
+    for (uint32_t i = 0; i < test.sessions; i++) {
+        latencies.Merge(streams[i]->latencies);
+        failures += streams[i]->failures;
+    }
+
+    if (failures > 0) {
+        fprintf(stderr, "%u of %zu decrypts failed\n", failures, latencies.Count());
+        return (false);
+    }
+
+    const double calls = static_cast<double>(latencies.Count());
+    const double seconds = static_cast<double>(elapsed) / 1e9;
+
+    report.Parameter("size", test.size);
+    report.Parameter("layout", (test.subsamples == true) ? "subsamples" : "full");
+    report.Parameter("iv", (test.netflix == true) ? "netflix" : "cenc");
+    report.Parameter("sessions", test.sessions);
+    report.Value("throughput_mib_s", (calls * test.size) / (1024.0 * 1024.0) / seconds, Benchmark::Metric::HIGHER_IS_BETTER);
+    report.Value("calls_per_s", calls / seconds, Benchmark::Metric::HIGHER_IS_BETTER);
+    report.Value("p50_us", latencies.Percentile(50) / 1000.0, Benchmark::Metric::LOWER_IS_BETTER, 1);
+    report.Value("p99_us", latencies.Percentile(99) / 1000.0, Benchmark::Metric::LOWER_IS_BETTER, 1);
+    report.Value("p999_us", latencies.Percentile(99.9) / 1000.0, Benchmark::Metric::LOWER_IS_BETTER, 1);
+    report.Value("allocs_per_call", allocations / calls, Benchmark::Metric::LOWER_IS_BETTER, 0.05);
+    report.Value("nexus_allocs_per_call", (nexusAfter.totalAllocations - nexusBefore.totalAllocations) / calls,
+        Benchmark::Metric::LOWER_IS_BETTER, 0.05);
+    report.Add();
+
+    return (true);
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    Benchmark::Options options;
+    if (options.Parse(argc, argv, USAGE) == false) {
+        return (1);
+    }
+
+    std::vector<uint32_t> sizes;
+    std::vector<uint32_t> sessionCounts;
+    if (options.quick == true) {
+        sizes = { 200, 64 * 1024, 2 * 1024 * 1024 };
+        sessionCounts = { 1, 2 };
+    } else {
+        sizes = { 200, 2 * 1024, 16 * 1024, 64 * 1024, 256 * 1024, 1024 * 1024, 2 * 1024 * 1024 };
+        sessionCounts = { 1, 4 };
+    }
+
+    for (int i = 1; i < argc; i++) {
+        const std::string argument(argv[i]);
+        if (argument.compare(0, 8, "--sizes=") == 0) {
+            if ((Benchmark::ParseList(argument.substr(8), sizes) == false) ||
+                (std::find(sizes.begin(), sizes.end(), 0) != sizes.end())) {
+                printf("Invalid sizes: %s\n", argument.c_str());
+                return (1);
+            }
+        } else if (argument.compare(0, 11, "--sessions=") == 0) {
+            if ((Benchmark::ParseList(argument.substr(11), sessionCounts) == false) ||
+                (std::find(sessionCounts.begin(), sessionCounts.end(), 0) != sessionCounts.end())) {
+                printf("Invalid sessions: %s\n", argument.c_str());
+                return (1);
+            }
+        } else {
+            printf("Unknown option %s\n%s\n", argument.c_str(), USAGE);
+            return (1);
+        }
+    }
+
+    Benchmark::System system;
+    if (system.IsValid() == false) {
+        return (1);
+    }
+
+    // Every session has a license of its own, as the streams of different
+    // players would.
+    const uint32_t maxSessions = *std::max_element(sessionCounts.begin(), sessionCounts.end());
+    std::vector<std::unique_ptr<Stream>> streams;
+    bool licensed = true;
+    for (uint32_t i = 0; (i < maxSessions) && (licensed == true); i++) {
+        std::unique_ptr<Stream> stream(new Stream());
+        const std::vector<FakePlayReady::KeyId> keyIds(Benchmark::KeyIds(1, static_cast<uint8_t>(i)));
+        stream->keyId = keyIds[0];
+        stream->session = system.CreateSession(FakePlayReady::BuildPssh(keyIds, true));
+        licensed = Benchmark::License(*stream->session, stream->callback);
+        streams.push_back(std::move(stream));
+    }
+
+    Benchmark::Report report("decrypt");
+    bool succeeded = licensed;
+
+    if (licensed == false) {
+        fprintf(stderr, "Could not license the sessions\n");
+    }
+
+    for (uint32_t size : sizes) {
+        for (uint32_t layout = 0; (layout < 2) && (succeeded == true); layout++) {
+            for (uint32_t iv = 0; (iv < 2) && (succeeded == true); iv++) {
+                for (uint32_t sessions : sessionCounts) {
+                    Case test;
+                    test.size = size;
+                    test.subsamples = (layout == 1);
+                    test.netflix = (iv == 1);
+                    test.sessions = sessions;
+                    if (options.iterations != 0) {
+                        test.iterations = options.iterations;
+                    } else if (options.quick == true) {
+                        test.iterations = QUICK_ITERATIONS;
+                    } else {
+                        test.iterations = static_cast<uint32_t>(std::max<uint64_t>(MIN_ITERATIONS,
+                            std::min<uint64_t>(MAX_ITERATIONS, BYTES_PER_CASE / size)));
+                    }
+
+                    if ((succeeded == true) && (Run(streams, test, report) == false)) {
+                        succeeded = false;
+                    }
+                }
+            }
+        }
+    }
+
+    for (std::unique_ptr<Stream>& stream : streams) {
+        stream->session->Close();
+        system.DestroySession(stream->session);
+    }
+
+    return ((succeeded == true) ? options.Finish(report) : 1);
+}
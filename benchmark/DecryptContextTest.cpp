@@ -0,0 +1,74 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+
+// Decrypt contexts are closed along with their session. An EME session binds
+// one in Update(); selecting its keys afterwards through the Netflix
+// (IMediaKeySessionExt) calls must not leave that one open. Exits non-zero
+// if the session leaves any decrypt context behind.
+
+#include "Harness.h"
+
+#include <stdio.h>
+
+using namespace CDMi;
+
+namespace {
+
+const uint32_t KEYS_PER_SESSION = 2;
+
+} // namespace
+
+int main()
+{
+    // Without prefetching, so only the binds of the session are counted.
+    Benchmark::System system(false);
+    if (system.IsValid() == false) {
+        return (1);
+    }
+
+    const std::vector<FakePlayReady::KeyId> keyIds(Benchmark::KeyIds(KEYS_PER_SESSION));
+    const uint32_t contextsBefore = FakePlayReady::GetStatistics().openDecryptContexts;
+
+    Benchmark::Callback callback;
+    MediaKeySession* session = system.CreateSession(FakePlayReady::BuildPssh(keyIds, true));
+    bool succeeded = Benchmark::License(*session, callback);
+
+    for (uint32_t i = 0; (i < keyIds.size()) && (succeeded == true); i++) {
+        succeeded = (session->SelectKeyId(keyIds[i].size(), keyIds[i].data()) == CDMi_SUCCESS);
+    }
+
+    session->Close();
+    system.DestroySession(session);
+
+    const uint32_t contextsAfter = FakePlayReady::GetStatistics().openDecryptContexts;
+
+    if (succeeded == false) {
+        fprintf(stderr, "Could not license the session and select its keys\n");
+        return (1);
+    }
+    if (contextsAfter != contextsBefore) {
+        fprintf(stderr, "%d decrypt contexts left open\n", static_cast<int>(contextsAfter - contextsBefore));
+        return (1);
+    }
+
+    printf("decrypt contexts: none left open\n");
+    return (0);
+}
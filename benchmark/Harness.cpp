@@ -0,0 +1,434 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "Harness.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace WPEFramework;
+using namespace CDMi;
+
+using SafeCriticalSection = Core::SafeSyncType<Core::CriticalSection>;
+extern Core::CriticalSection drmAppContextMutex_;
+
+namespace Benchmark {
+
+namespace {
+
+// As configured by default in MediaSystem.cpp.
+const uint32_t MAX_DECRYPT_CONTEXTS = 32;
+const uint32_t CALLBACK_DISPATCHER_CAPACITY = 64;
+
+std::vector<DRM_WCHAR> DrmString(const std::string& text)
+{
+    std::vector<DRM_WCHAR> result(text.begin(), text.end());
+    result.push_back(0);
+    return (result);
+}
+
+void RemoveDirectory(const std::string& path)
+{
+    DIR* directory = ::opendir(path.c_str());
+    if (directory != nullptr) {
+        struct dirent* entry;
+        while ((entry = ::readdir(directory)) != nullptr) {
+            const std::string name(entry->d_name);
+            if ((name == ".") || (name == "..")) {
+                continue;
+            }
+            const std::string fullName(path + '/' + name);
+            struct stat status;
+            if ((::lstat(fullName.c_str(), &status) == 0) && (S_ISDIR(status.st_mode))) {
+                RemoveDirectory(fullName);
+            } else {
+                ::unlink(fullName.c_str());
+            }
+        }
+        ::closedir(directory);
+    }
+    ::rmdir(path.c_str());
+}
+
+} // namespace
+
+System::System(const bool prefetchKeys)
+    : _directory()
+    , _storeLocation()
+    , _drmPath()
+    , _storePath()
+    , _oemContext(nullptr)
+    , _appContext()
+    , _opaqueBuffer()
+    , _revocationBuffer(nullptr)
+    , _nexusJoined(false)
+    , _nxAllocResults()
+    , _backgroundWorker()
+    , _callbackDispatcher(CALLBACK_DISPATCHER_CAPACITY)
+    , _challengeBuffers()
+    , _tuning()
+    , _licenseStoreUsage()
+    , _secureClock()
+    , _environment()
+{
+    char directory[] = "/tmp/playready-benchmark-XXXXXX";
+    if (::mkdtemp(directory) == nullptr) {
+        fprintf(stderr, "Could not create a directory for the DRM store\n");
+        return;
+    }
+
+    _directory = std::string(directory) + '/';
+    _storeLocation = _directory + "drmstore";
+
+    _environment.prefetchWorker = (prefetchKeys == true) ? &_backgroundWorker : nullptr;
+    _environment.maxDecryptContexts = MAX_DECRYPT_CONTEXTS;
+    _environment.dispatcher = &_callbackDispatcher;
+    _environment.challengeBuffers = &_challengeBuffers;
+    _environment.opaqueBuffer = &_opaqueBuffer;
+    _environment.tuning = &_tuning;
+    _environment.licenseStore = &_licenseStoreUsage;
+    _environment.sessionRecordPath = _directory + "sessions/";
+    _environment.secureClock = &_secureClock;
+
+    Core::Directory(_environment.sessionRecordPath.c_str()).CreatePath();
+
+    if (Initialize() == false) {
+        fprintf(stderr, "Could not initialize the PlayReady system in %s\n", _directory.c_str());
+        Deinitialize();
+    }
+}
+
+System::~System()
+{
+    _backgroundWorker.Stop();
+    _callbackDispatcher.Stop();
+
+    Deinitialize();
+
+    if (_directory.empty() == false) {
+        RemoveDirectory(_directory);
+    }
+}
+
+bool System::Initialize()
+{
+    NxClient_JoinSettings joinSettings;
+    NxClient_AllocSettings allocSettings;
+    NEXUS_ClientConfiguration platformConfig;
+    NEXUS_MemoryAllocationSettings heapSettings;
+    OEM_Settings oemSettings;
+    DRM_CONST_STRING storePath = DRM_EMPTY_DRM_STRING;
+    DRMFILETIME systemTime;
+    DRM_SECURETIME_CLOCK_TYPE clockType;
+    DRM_DWORD decryptionMode = OEM_TEE_DECRYPTION_MODE_HANDLE;
+    DRM_RESULT dr = DRM_SUCCESS;
+
+    NxClient_GetDefaultJoinSettings(&joinSettings);
+    strncpy(joinSettings.name, "playready3x-benchmark", NXCLIENT_MAX_NAME);
+    joinSettings.ignoreStandbyRequest = true;
+    if (NxClient_Join(&joinSettings) != 0) {
+        return (false);
+    }
+    NxClient_GetDefaultAllocSettings(&allocSettings);
+    if (NxClient_Alloc(&allocSettings, &_nxAllocResults) != 0) {
+        NxClient_Uninit();
+        return (false);
+    }
+    _nexusJoined = true;
+
+    NEXUS_Memory_GetDefaultAllocationSettings(&heapSettings);
+    NEXUS_Platform_GetClientConfiguration(&platformConfig);
+    if (platformConfig.heap[NXCLIENT_FULL_HEAP]) {
+        NEXUS_MemoryStatus heapStatus;
+        NEXUS_Heap_GetStatus(platformConfig.heap[NXCLIENT_FULL_HEAP], &heapStatus);
+        if (heapStatus.memoryType & NEXUS_MemoryType_eFull) {
+            heapSettings.heap = platformConfig.heap[NXCLIENT_FULL_HEAP];
+        }
+    }
+
+    BKNI_Memset(&oemSettings, 0, sizeof(OEM_Settings));
+    oemSettings.heap = heapSettings.heap;
+    ChkDR(Drm_Platform_Initialize((void *)&oemSettings));
+    _oemContext = oemSettings.f_pOEMContext;
+    ChkMem(_oemContext);
+
+    _drmPath = DrmString(_directory);
+    g_dstrDrmPath.pwszString = _drmPath.data();
+    g_dstrDrmPath.cchString = _directory.length();
+
+    _appContext.reset(new DRM_APP_CONTEXT);
+    memset(_appContext.get(), 0, sizeof(DRM_APP_CONTEXT));
+
+    _tuning.Load(_storeLocation + ".tuning");
+    _opaqueBuffer.size = MINIMUM_APPCONTEXT_OPAQUE_BUFFER_SIZE;
+    ChkMem(_opaqueBuffer.buffer = (DRM_BYTE *)Oem_MemAlloc(_opaqueBuffer.size));
+
+    _storePath = DrmString(_storeLocation);
+    storePath.pwszString = _storePath.data();
+    storePath.cchString = _storeLocation.length();
+    ChkDR(Drm_Initialize(_appContext.get(), _oemContext, _opaqueBuffer.buffer, _opaqueBuffer.size, &storePath));
+
+    dr = Drm_SecureTime_GetValue(_appContext.get(), &systemTime, &clockType);
+    if ((dr == DRM_E_SECURETIME_CLOCK_NOT_SET) || (dr == DRM_E_TEE_PROVISIONING_REQUIRED)) {
+        _secureClock.Start(_appContext.get(), drmAppContextMutex_);
+        dr = DRM_SUCCESS;
+    }
+    ChkDR(dr);
+
+    _licenseStoreUsage.capacity = MAX_NUM_LICENSES * LICENSE_SIZE_BYTES;
+    ChkDR(Drm_ResizeInMemoryLicenseStore(_appContext.get(), _licenseStoreUsage.capacity));
+
+    if (DRM_REVOCATION_IsRevocationSupported()) {
+        ChkMem(_revocationBuffer = (DRM_BYTE *)Oem_MemAlloc(REVOCATION_BUFFER_SIZE));
+        ChkDR(Drm_Revocation_SetBuffer(_appContext.get(), _revocationBuffer, REVOCATION_BUFFER_SIZE));
+    }
+
+    ChkDR(Drm_Content_SetProperty(_appContext.get(), DRM_CSP_DECRYPTION_OUTPUT_MODE,
+        (const DRM_BYTE*)&decryptionMode, sizeof(DRM_DWORD)));
+
+ErrorExit:
+    if (DRM_FAILED(dr)) {
+        fprintf(stderr, "PlayReady initialization failed (error: 0x%08X)\n", static_cast<unsigned int>(dr));
+        return (false);
+    }
+
+    return (true);
+}
+
+void System::Deinitialize()
+{
+    _secureClock.Stop();
+
+    if (_appContext.get() != nullptr) {
+        Drm_Uninitialize(_appContext.get());
+        _appContext.reset();
+    }
+
+    SAFE_OEM_FREE(_revocationBuffer);
+    SAFE_OEM_FREE(_opaqueBuffer.buffer);
+    _opaqueBuffer.size = 0;
+
+    if (_oemContext != nullptr) {
+        Drm_Platform_Uninitialize(_oemContext);
+        _oemContext = nullptr;
+    }
+
+    if (_nexusJoined == true) {
+        NxClient_Free(&_nxAllocResults);
+        NxClient_Uninit();
+        _nexusJoined = false;
+    }
+}
+
+MediaKeySession* System::CreateSession(const std::vector<uint8_t>& initData, const bool persistent)
+{
+    return (new MediaKeySession(initData.data(), initData.size(), nullptr, 0,
+        _oemContext, _appContext.get(), persistent, _environment));
+}
+
+void System::DestroySession(MediaKeySession* session)
+{
+    // Like DestroyMediaKeySession, without the DRM lock: closing takes it.
+    delete session;
+}
+
+uint32_t System::ExchangeSecureStops()
+{
+    SafeCriticalSection systemLock(drmAppContextMutex_);
+
+    DRM_ID* sessionIds = nullptr;
+    DRM_DWORD sessions = 0;
+    uint32_t committed = 0;
+
+    const DRM_RESULT dr = Drm_SecureStop_EnumerateSessions(_appContext.get(), 0, nullptr, &sessions, &sessionIds);
+    if ((dr != DRM_SUCCESS) && (dr != DRM_E_NOMORE)) {
+        sessions = 0;
+    }
+
+    for (DRM_DWORD i = 0; i < sessions; i++) {
+        DRM_DWORD challengeSize = 0;
+        DRM_BYTE* challenge = nullptr;
+
+        if (Drm_SecureStop_GenerateChallenge(_appContext.get(), &sessionIds[i], 0, nullptr, 0, nullptr,
+                &challengeSize, &challenge) == DRM_SUCCESS) {
+            const std::vector<uint8_t> response(FakePlayReady::SecureStopResponse(challenge, challengeSize));
+            DRM_DWORD customDataSize = 0;
+            DRM_CHAR* customData = nullptr;
+
+            if (Drm_SecureStop_ProcessResponse(_appContext.get(), &sessionIds[i], 0, nullptr, response.size(), response.data(),
+                    &customDataSize, &customData) == DRM_SUCCESS) {
+                committed++;
+            }
+            SAFE_OEM_FREE(customData);
+        }
+        SAFE_OEM_FREE(challenge);
+    }
+
+    SAFE_OEM_FREE(sessionIds);
+
+    return (committed);
+}
+
+Callback::Callback()
+    : _lock()
+    , _signal()
+    , _challenge()
+    , _errors(0)
+{
+}
+
+Callback::~Callback()
+{
+}
+
+void Callback::OnKeyMessage(const uint8_t* keyMessage, uint32_t length, char* url)
+{
+    // Output protection of a bound key comes as a "properties" key message.
+    if ((url != nullptr) && (strcmp(url, "properties") == 0)) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(_lock);
+    _challenge.assign(keyMessage, keyMessage + length);
+    _signal.notify_all();
+}
+
+void Callback::OnKeyReady()
+{
+}
+
+void Callback::OnError(int16_t, CDMi_RESULT, const char* errorMessage)
+{
+    std::unique_lock<std::mutex> lock(_lock);
+    _errors++;
+    fprintf(stderr, "Session error: %s\n", (errorMessage != nullptr) ? errorMessage : "");
+}
+
+void Callback::OnKeyStatusUpdate(const char*, const uint8_t[], const uint8_t)
+{
+}
+
+void Callback::OnKeyStatusesUpdated() const
+{
+}
+
+std::vector<uint8_t> Callback::Challenge(const uint32_t timeoutMs)
+{
+    std::unique_lock<std::mutex> lock(_lock);
+    _signal.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this]() { return (_challenge.empty() == false); });
+    std::vector<uint8_t> result;
+    result.swap(_challenge);
+    return (result);
+}
+
+uint32_t Callback::Errors() const
+{
+    std::unique_lock<std::mutex> lock(_lock);
+    return (_errors);
+}
+
+LicenseServer::LicenseServer(const uint32_t latencyMs, const uint32_t jitterMs)
+    : _latencyMs(latencyMs)
+    , _jitterMs(jitterMs)
+    , _lock()
+    , _responses()
+    , _seed(1)
+{
+}
+
+LicenseServer::~LicenseServer()
+{
+}
+
+void LicenseServer::Can(const std::vector<FakePlayReady::KeyId>& keyIds)
+{
+    std::vector<FakePlayReady::KeyId> key(keyIds);
+    std::sort(key.begin(), key.end());
+
+    std::vector<uint8_t> response(FakePlayReady::LicenseResponse(keyIds));
+
+    std::unique_lock<std::mutex> lock(_lock);
+    _responses[key].swap(response);
+}
+
+std::vector<uint8_t> LicenseServer::Request(const std::vector<uint8_t>& challenge)
+{
+    std::vector<FakePlayReady::KeyId> key(FakePlayReady::ChallengeKeyIds(challenge.data(), challenge.size()));
+    std::sort(key.begin(), key.end());
+
+    std::vector<uint8_t> response;
+    uint32_t delayMs = _latencyMs;
+    {
+        std::unique_lock<std::mutex> lock(_lock);
+        if (_jitterMs > 0) {
+            delayMs += ::rand_r(&_seed) % (_jitterMs + 1);
+        }
+
+        std::map<std::vector<FakePlayReady::KeyId>, std::vector<uint8_t>>::const_iterator canned(_responses.find(key));
+        if (canned != _responses.end()) {
+            response = canned->second;
+        }
+    }
+
+    if (response.empty() == true) {
+        response = FakePlayReady::LicenseResponse(challenge.data(), challenge.size());
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(delayMs));
+
+    return (response);
+}
+
+std::vector<FakePlayReady::KeyId> KeyIds(const uint32_t count, const uint8_t seed)
+{
+    std::vector<FakePlayReady::KeyId> keyIds(count);
+    for (uint32_t i = 0; i < count; i++) {
+        keyIds[i].fill(0);
+        keyIds[i][0] = 0xB0;
+        keyIds[i][1] = seed;
+        keyIds[i][14] = static_cast<uint8_t>(i >> 8);
+        keyIds[i][15] = static_cast<uint8_t>(i);
+    }
+    return (keyIds);
+}
+
+bool License(MediaKeySession& session, Callback& callback)
+{
+    session.Run(&callback);
+
+    const std::vector<uint8_t> challenge(callback.Challenge(5000));
+    if (challenge.empty() == true) {
+        return (false);
+    }
+
+    const std::vector<uint8_t> response(FakePlayReady::LicenseResponse(challenge.data(), challenge.size()));
+    session.Update(response.data(), response.size());
+
+    return (session.ready());
+}
+
+} // namespace Benchmark
@@ -0,0 +1,154 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include "MediaSession.h"
+
+#include <fake_server.h>
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Sets up a PlayReady system the way MediaSystem.cpp does, on the fake
+// backend and a store in a directory of its own, and drives MediaKeySession
+// directly. Creating the system through GetSystemFactory() needs an OCDM
+// IShell, which only the framework can provide.
+namespace Benchmark {
+
+using CDMi::MediaKeySession;
+
+class System {
+public:
+    System(const System&) = delete;
+    System& operator=(const System&) = delete;
+
+    // Without prefetching, decrypt contexts are only bound on SelectKeyId().
+    explicit System(const bool prefetchKeys = true);
+    ~System();
+
+    bool IsValid() const
+    {
+        return (_appContext.get() != nullptr);
+    }
+    DRM_APP_CONTEXT* AppContext()
+    {
+        return (_appContext.get());
+    }
+
+    // The session and DRM lock handling of PlayReady::CreateMediaKeySession()
+    // and PlayReady::DestroyMediaKeySession().
+    MediaKeySession* CreateSession(const std::vector<uint8_t>& initData, const bool persistent = false);
+    void DestroySession(MediaKeySession* session);
+
+    // The secure stop exchange of PlayReady::GetSecureStops() and
+    // CommitSecureStops(), with the DRM lock held throughout: every pending
+    // secure stop is challenged and acknowledged by the fake server. Returns
+    // the number committed.
+    uint32_t ExchangeSecureStops();
+
+private:
+    bool Initialize();
+    void Deinitialize();
+
+private:
+    std::string _directory;
+    std::string _storeLocation;
+    std::vector<DRM_WCHAR> _drmPath;
+    std::vector<DRM_WCHAR> _storePath;
+    DRM_VOID* _oemContext;
+    std::unique_ptr<DRM_APP_CONTEXT> _appContext;
+    CDMi::OpaqueBuffer _opaqueBuffer;
+    DRM_BYTE* _revocationBuffer;
+    bool _nexusJoined;
+    NxClient_AllocResults _nxAllocResults;
+    CDMi::BackgroundWorker _backgroundWorker;
+    CDMi::CallbackDispatcher _callbackDispatcher;
+    CDMi::ChallengeBuffers _challengeBuffers;
+    CDMi::Tuning _tuning;
+    CDMi::LicenseStoreUsage _licenseStoreUsage;
+    CDMi::SecureClock _secureClock;
+    CDMi::SessionEnvironment _environment;
+};
+
+// Keeps what a session reports; the key message can be waited for.
+class Callback : public CDMi::IMediaKeySessionCallback {
+public:
+    Callback(const Callback&) = delete;
+    Callback& operator=(const Callback&) = delete;
+
+    Callback();
+    ~Callback() override;
+
+    void OnKeyMessage(const uint8_t* keyMessage, uint32_t length, char* url) override;
+    void OnKeyReady() override;
+    void OnError(int16_t error, CDMi::CDMi_RESULT sysError, const char* errorMessage) override;
+    void OnKeyStatusUpdate(const char* keyMessage, const uint8_t buffer[], const uint8_t length) override;
+    void OnKeyStatusesUpdated() const override;
+
+    // The license challenge, waited for up to timeoutMs. Empty on a timeout.
+    std::vector<uint8_t> Challenge(const uint32_t timeoutMs);
+    uint32_t Errors() const;
+
+private:
+    mutable std::mutex _lock;
+    std::condition_variable _signal;
+    std::vector<uint8_t> _challenge;
+    uint32_t _errors;
+};
+
+// Stand-in for the license server of an application. It answers a challenge
+// after a network latency, replaying the response canned for the key IDs the
+// challenge asks for, or generating one if none was canned.
+class LicenseServer {
+public:
+    LicenseServer(const LicenseServer&) = delete;
+    LicenseServer& operator=(const LicenseServer&) = delete;
+
+    // Every request takes latencyMs plus a random part of up to jitterMs.
+    LicenseServer(const uint32_t latencyMs, const uint32_t jitterMs = 0);
+    ~LicenseServer();
+
+    // Prepares the response for keyIds. Canned licenses are not bound to the
+    // nonce of a challenge, like the licenses a server hands to anyone.
+    void Can(const std::vector<FakePlayReady::KeyId>& keyIds);
+
+    std::vector<uint8_t> Request(const std::vector<uint8_t>& challenge);
+
+private:
+    const uint32_t _latencyMs;
+    const uint32_t _jitterMs;
+    std::mutex _lock;
+    std::map<std::vector<FakePlayReady::KeyId>, std::vector<uint8_t>> _responses;
+    uint32_t _seed;
+};
+
+// count distinct key IDs, a different set for every seed.
+std::vector<FakePlayReady::KeyId> KeyIds(const uint32_t count, const uint8_t seed = 0);
+
+// The EME license flow of a session: Run, the key message, the response of
+// the license server and Update. Returns whether the session has a usable
+// key afterwards.
+bool License(MediaKeySession& session, Callback& callback);
+
+} // namespace Benchmark
@@ -0,0 +1,437 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// Time to first decrypt, from the creation of a session to its first
+// decrypted sample, for the EME flow and the Netflix (IMediaKeySessionExt)
+// flow, against a local license server with a configurable latency. Every
+// phase is timed, as are the porting kit calls inside them, so the time can
+// be attributed to the plugin, the DRM and the network.
+
+#include "Harness.h"
+#include "Report.h"
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <thread>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace CDMi;
+
+namespace {
+
+const char USAGE[] =
+    "Usage: PlayReadyLicenseLatency [options]\n"
+    "  --flow=eme|netflix|all  flows to run (default all)\n"
+    "  --latency=LIST          license server latencies in ms, e.g. 0,50,200\n"
+    "  --jitter=MS             random extra server latency, up to MS\n"
+    "  --timeline=FILE         write the timeline of the median run of every case\n"
+    "                          in Chrome trace event format (chrome://tracing, Perfetto)";
+
+const uint32_t DEFAULT_ITERATIONS = 50;
+const uint32_t QUICK_ITERATIONS = 5;
+const uint32_t KEYS_PER_SESSION = 2;
+const uint32_t SAMPLE_SIZE = 16 * 1024;
+const uint32_t KEY_MESSAGE_TIMEOUT_MS = 5000;
+
+enum Flow {
+    EME,
+    NETFLIX
+};
+
+struct Phase {
+    std::string name;
+    uint64_t begin;
+    uint64_t end;
+    // Not part of the plugin.
+    bool network;
+};
+
+// What one run of a flow took.
+struct Timeline {
+    Timeline()
+        : phases()
+        , calls()
+        , thread(std::hash<std::thread::id>()(std::this_thread::get_id()))
+        , succeeded(false)
+    {
+    }
+
+    void Begin(const char name[], const bool network = false)
+    {
+        const uint64_t now = Benchmark::NowNs();
+        if (phases.empty() == false) {
+            phases.back().end = now;
+        }
+        Phase phase;
+        phase.name = name;
+        phase.begin = now;
+        phase.end = now;
+        phase.network = network;
+        phases.push_back(phase);
+    }
+    void End()
+    {
+        phases.back().end = Benchmark::NowNs();
+        calls = FakePlayReady::TraceEvents();
+    }
+
+    uint64_t Total() const
+    {
+        return (phases.back().end - phases.front().begin);
+    }
+    uint64_t Network() const
+    {
+        uint64_t total = 0;
+        for (const Phase& phase : phases) {
+            total += (phase.network == true) ? (phase.end - phase.begin) : 0;
+        }
+        return (total);
+    }
+
+    std::vector<Phase> phases;
+    std::vector<FakePlayReady::TraceEvent> calls;
+    uint64_t thread;
+    bool succeeded;
+};
+
+bool FirstDecrypt(MediaKeySession& session, const FakePlayReady::KeyId& keyId, const bool netflix)
+{
+    std::vector<uint8_t> sample(SAMPLE_SIZE, 0x3C);
+    uint32_t outputSize = 0;
+    uint8_t* output = nullptr;
+
+    if (netflix == true) {
+        DRM_AES_COUNTER_MODE_CONTEXT context = { 1, 0, 0 };
+        return (session.Decrypt(nullptr, 0, nullptr, 0, reinterpret_cast<const uint8_t*>(&context), sizeof(context),
+            sample.data(), sample.size(), &outputSize, &output, keyId.size(), keyId.data(), true) == CDMi_SUCCESS);
+    }
+
+    uint8_t iv[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+    return (session.Decrypt(nullptr, 0, nullptr, 0, iv, sizeof(iv), sample.data(), sample.size(),
+        &outputSize, &output, keyId.size(), keyId.data(), false) == CDMi_SUCCESS);
+}
+
+// Create, Run (playreadyGenerateKeyRequest), OnKeyMessage, the server,
+// Update (process the response, bind, commit) and the first Decrypt.
+Timeline RunEme(Benchmark::System& system, Benchmark::LicenseServer& server, const std::vector<FakePlayReady::KeyId>& keyIds)
+{
+    const std::vector<uint8_t> initData(FakePlayReady::BuildPssh(keyIds, true));
+    Benchmark::Callback callback;
+    Timeline timeline;
+
+    FakePlayReady::TraceEvents();
+
+    timeline.Begin("create");
+    MediaKeySession* session = system.CreateSession(initData);
+
+    timeline.Begin("run");
+    session->Run(&callback);
+
+    timeline.Begin("key_message");
+    const std::vector<uint8_t> challenge(callback.Challenge(KEY_MESSAGE_TIMEOUT_MS));
+
+    timeline.Begin("license_server", true);
+    const std::vector<uint8_t> response(server.Request(challenge));
+
+    timeline.Begin("update");
+    session->Update(response.data(), response.size());
+
+    timeline.Begin("first_decrypt");
+    timeline.succeeded = ((challenge.empty() == false) && (session->ready() == true) &&
+                          (FirstDecrypt(*session, keyIds[0], false) == true));
+    timeline.End();
+
+    session->Close();
+    system.DestroySession(session);
+
+    return (timeline);
+}
+
+// Create, SetDrmHeader, GetChallengeDataExt (the size, then the challenge),
+// the server, StoreLicenseData, SelectKeyId and the first Decrypt.
+Timeline RunNetflix(Benchmark::System& system, Benchmark::LicenseServer& server, const std::vector<FakePlayReady::KeyId>& keyIds)
+{
+    const std::vector<uint8_t> header(FakePlayReady::BuildHeader(keyIds));
+    Timeline timeline;
+    uint8_t secureStopId[16];
+    bool succeeded = true;
+
+    FakePlayReady::TraceEvents();
+
+    timeline.Begin("create");
+    MediaKeySession* session = system.CreateSession(std::vector<uint8_t>());
+
+    timeline.Begin("set_drm_header");
+    succeeded = (session->SetDrmHeader(header.data(), header.size()) == CDMi_SUCCESS);
+
+    timeline.Begin("challenge");
+    uint32_t challengeSize = 0;
+    std::vector<uint8_t> challenge;
+    if ((succeeded == true) && (session->GetChallengeDataExt(nullptr, challengeSize, 0) == CDMi_SUCCESS)) {
+        challenge.resize(challengeSize);
+        succeeded = (session->GetChallengeDataExt(challenge.data(), challengeSize, 0) == CDMi_SUCCESS);
+        challenge.resize(challengeSize);
+    } else {
+        succeeded = false;
+    }
+
+    timeline.Begin("license_server", true);
+    const std::vector<uint8_t> response((succeeded == true) ? server.Request(challenge) : std::vector<uint8_t>());
+
+    timeline.Begin("store_license");
+    succeeded = (succeeded == true) && (session->StoreLicenseData(response.data(), response.size(), secureStopId) == CDMi_SUCCESS);
+
+    timeline.Begin("select_key");
+    succeeded = (succeeded == true) && (session->SelectKeyId(keyIds[0].size(), keyIds[0].data()) == CDMi_SUCCESS);
+
+    timeline.Begin("first_decrypt");
+    timeline.succeeded = (succeeded == true) && (FirstDecrypt(*session, keyIds[0], true) == true);
+    timeline.End();
+
+    system.DestroySession(session);
+
+    return (timeline);
+}
+
+void Print(const std::string& title, const Timeline& timeline)
+{
+    const uint64_t origin = timeline.phases.front().begin;
+
+    printf("%s: %.3f ms to first decrypt, %.3f ms of it the license server\n", title.c_str(),
+        timeline.Total() / 1e6, timeline.Network() / 1e6);
+
+    for (const Phase& phase : timeline.phases) {
+        printf("  %9.3f ms %+9.3f ms  %s\n", (phase.begin - origin) / 1e6, (phase.end - phase.begin) / 1e6, phase.name.c_str());
+
+        for (const FakePlayReady::TraceEvent& call : timeline.calls) {
+            if ((call.begin >= phase.begin) && (call.begin < phase.end)) {
+                printf("  %9.3f ms %+9.3f ms    %s%s\n", (call.begin - origin) / 1e6, (call.end - call.begin) / 1e6,
+                    call.function, (call.thread != timeline.thread) ? " (background)" : "");
+            }
+        }
+    }
+}
+
+std::string Escape(const std::string& text)
+{
+    std::string result;
+    for (const char c : text) {
+        if ((c == '"') || (c == '\\')) {
+            result += '\\';
+        }
+        result += c;
+    }
+    return (result);
+}
+
+// Chrome trace event format: one process per case, the phases on one track
+// and the porting kit calls on one track per thread.
+bool WriteTimelines(const std::string& fileName, const std::vector<std::pair<std::string, Timeline>>& timelines)
+{
+    std::ofstream file(fileName, std::ios::out | std::ios::trunc);
+    if (file.is_open() == false) {
+        return (false);
+    }
+
+    file << "[\n";
+    bool first = true;
+    for (uint32_t index = 0; index < timelines.size(); index++) {
+        const Timeline& timeline = timelines[index].second;
+        const uint64_t origin = timeline.phases.front().begin;
+        const uint32_t pid = index + 1;
+        char line[512];
+
+        snprintf(line, sizeof(line), "%s{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%u,\"args\":{\"name\":\"%s\"}}",
+            (first == true) ? "" : ",\n", pid, Escape(timelines[index].first).c_str());
+        file << line;
+        first = false;
+
+        for (const Phase& phase : timeline.phases) {
+            snprintf(line, sizeof(line), ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":%u,\"tid\":0,\"ts\":%.3f,\"dur\":%.3f}",
+                phase.name.c_str(), (phase.network == true) ? "network" : "plugin", pid,
+                (phase.begin - origin) / 1e3, (phase.end - phase.begin) / 1e3);
+            file << line;
+        }
+
+        std::map<uint64_t, uint32_t> threads;
+        for (const FakePlayReady::TraceEvent& call : timeline.calls) {
+            const uint32_t tid = threads.insert(std::make_pair(call.thread, threads.size() + 1)).first->second;
+            snprintf(line, sizeof(line), ",\n{\"name\":\"%s\",\"cat\":\"drm\",\"ph\":\"X\",\"pid\":%u,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                call.function, pid, tid, (static_cast<double>(call.begin) - static_cast<double>(origin)) / 1e3,
+                (call.end - call.begin) / 1e3);
+            file << line;
+        }
+    }
+    file << "\n]\n";
+
+    return (file.good());
+}
+
+bool Run(Benchmark::System& system, const Flow flow, const uint32_t latencyMs, const uint32_t jitterMs, const uint32_t iterations,
+    Benchmark::Report& report, std::vector<std::pair<std::string, Timeline>>& timelines)
+{
+    const char* flowName = (flow == EME) ? "eme" : "netflix";
+    Benchmark::LicenseServer server(latencyMs, jitterMs);
+
+    // Other keys for every run, so no run finds the licenses of another.
+    std::vector<std::vector<FakePlayReady::KeyId>> keyIds;
+    for (uint32_t i = 0; i < iterations; i++) {
+        keyIds.push_back(Benchmark::KeyIds(KEYS_PER_SESSION, static_cast<uint8_t>(i)));
+        server.Can(keyIds.back());
+    }
+
+    std::vector<Timeline> runs;
+    for (uint32_t i = 0; i < iterations; i++) {
+        runs.push_back((flow == EME) ? RunEme(system, server, keyIds[i]) : RunNetflix(system, server, keyIds[i]));
+        if (runs.back().succeeded == false) {
+            fprintf(stderr, "The %s flow failed in run %u\n", flowName, i);
+            return (false);
+        }
+    }
+
+    // Phases and porting kit calls, each over all runs.
+    std::map<std::string, Benchmark::Latencies> phases;
+    std::map<std::string, Benchmark::Latencies> calls;
+    Benchmark::Latencies total;
+    Benchmark::Latencies plugin;
+    std::vector<std::string> order;
+
+    for (const Timeline& run : runs) {
+        for (const Phase& phase : run.phases) {
+            if (phases.find(phase.name) == phases.end()) {
+                order.push_back(phase.name);
+            }
+            phases[phase.name].Add(phase.end - phase.begin);
+        }
+
+        std::map<std::string, uint64_t> perRun;
+        for (const FakePlayReady::TraceEvent& call : run.calls) {
+            if (call.thread == run.thread) {
+                perRun[call.function] += (call.end - call.begin);
+            }
+        }
+        for (const std::pair<const std::string, uint64_t>& call : perRun) {
+            calls[call.first].Add(call.second);
+        }
+
+        total.Add(run.Total());
+        plugin.Add(run.Total() - run.Network());
+    }
+
+    report.Parameter("flow", flowName);
+    report.Parameter("latency_ms", latencyMs);
+    report.Parameter("jitter_ms", jitterMs);
+    report.Value("time_to_first_decrypt_p50_us", total.Percentile(50) / 1000.0, Benchmark::Metric::LOWER_IS_BETTER, 50);
+    report.Value("time_to_first_decrypt_p99_us", total.Percentile(99) / 1000.0, Benchmark::Metric::LOWER_IS_BETTER, 50);
+    report.Value("plugin_p50_us", plugin.Percentile(50) / 1000.0, Benchmark::Metric::LOWER_IS_BETTER, 20);
+    report.Value("plugin_p99_us", plugin.Percentile(99) / 1000.0, Benchmark::Metric::LOWER_IS_BETTER, 20);
+    for (const std::string& name : order) {
+        report.Value(name + "_p50_us", phases[name].Percentile(50) / 1000.0, Benchmark::Metric::LOWER_IS_BETTER, 20);
+    }
+    for (std::pair<const std::string, Benchmark::Latencies>& call : calls) {
+        report.Value(call.first + "_p50_us", call.second.Percentile(50) / 1000.0, Benchmark::Metric::LOWER_IS_BETTER, 20);
+    }
+    report.Add();
+
+    // The run in the middle is the one shown.
+    std::vector<std::pair<uint64_t, uint32_t>> ranked;
+    for (uint32_t i = 0; i < runs.size(); i++) {
+        ranked.push_back(std::make_pair(runs[i].Total(), i));
+    }
+    std::sort(ranked.begin(), ranked.end());
+    const Timeline& median = runs[ranked[ranked.size() / 2].second];
+
+    const std::string title(std::string(flowName) + " latency=" + std::to_string(latencyMs) + "ms");
+    Print(title + " (median run)", median);
+    timelines.push_back(std::make_pair(title, median));
+
+    return (true);
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    Benchmark::Options options;
+    if (options.Parse(argc, argv, USAGE) == false) {
+        return (1);
+    }
+
+    std::vector<Flow> flows = { EME, NETFLIX };
+    std::vector<uint32_t> latencies = (options.quick == true) ? std::vector<uint32_t>({ 0, 20 }) : std::vector<uint32_t>({ 0, 50, 200 });
+    uint32_t jitterMs = 0;
+    std::string timelineFile;
+    const uint32_t iterations = (options.iterations != 0) ? options.iterations : ((options.quick == true) ? QUICK_ITERATIONS : DEFAULT_ITERATIONS);
+
+    for (int i = 1; i < argc; i++) {
+        const std::string argument(argv[i]);
+        bool valid = true;
+        if (argument == "--flow=eme") {
+            flows = { EME };
+        } else if (argument == "--flow=netflix") {
+            flows = { NETFLIX };
+        } else if (argument == "--flow=all") {
+            flows = { EME, NETFLIX };
+        } else if (argument.compare(0, 10, "--latency=") == 0) {
+            valid = Benchmark::ParseList(argument.substr(10), latencies);
+        } else if (argument.compare(0, 9, "--jitter=") == 0) {
+            jitterMs = static_cast<uint32_t>(::strtoul(argument.c_str() + 9, nullptr, 10));
+        } else if ((argument.compare(0, 11, "--timeline=") == 0) && (argument.size() > 11)) {
+            timelineFile = argument.substr(11);
+        } else {
+            valid = false;
+        }
+        if (valid == false) {
+            printf("Invalid option %s\n%s\n", argument.c_str(), USAGE);
+            return (1);
+        }
+    }
+
+    Benchmark::System system;
+    if (system.IsValid() == false) {
+        return (1);
+    }
+
+    FakePlayReady::EnableTrace(true);
+
+    Benchmark::Report report("license");
+    std::vector<std::pair<std::string, Timeline>> timelines;
+    bool succeeded = true;
+
+    for (const Flow flow : flows) {
+        for (const uint32_t latency : latencies) {
+            if ((succeeded == true) && (Run(system, flow, latency, jitterMs, iterations, report, timelines) == false)) {
+                succeeded = false;
+            }
+        }
+    }
+
+    FakePlayReady::EnableTrace(false);
+
+    if ((timelineFile.empty() == false) && (WriteTimelines(timelineFile, timelines) == false)) {
+        printf("Could not write %s\n", timelineFile.c_str());
+        succeeded = false;
+    }
+
+    return ((succeeded == true) ? options.Finish(report) : 1);
+}
@@ -0,0 +1,460 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "Report.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <fstream>
+#include <map>
+#include <new>
+#include <sstream>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+namespace {
+
+std::atomic<uint64_t> g_allocations(0);
+
+void* Allocate(size_t size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return (::malloc(size == 0 ? 1 : size));
+}
+
+uint64_t StatusValue(const char name[])
+{
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    const size_t length = strlen(name);
+    while (std::getline(status, line)) {
+        if ((line.compare(0, length, name) == 0) && (line.size() > length) && (line[length] == ':')) {
+            return (::strtoull(line.c_str() + length + 1, nullptr, 10));
+        }
+    }
+    return (0);
+}
+
+std::string Escape(const std::string& text)
+{
+    std::string result;
+    for (const char c : text) {
+        if ((c == '"') || (c == '\\')) {
+            result += '\\';
+        }
+        result += c;
+    }
+    return (result);
+}
+
+// Reads the flat objects Report::Write() produces, one per line, into a map
+// of case name to its keys and (unquoted) values.
+bool ReadResults(const std::string& fileName, std::map<std::string, std::map<std::string, std::string>>& results)
+{
+    std::ifstream file(fileName);
+    if (file.is_open() == false) {
+        return (false);
+    }
+
+    std::string line;
+    while (std::getline(file, line)) {
+        std::map<std::string, std::string> values;
+        size_t pos = line.find('{');
+        while ((pos != std::string::npos) && (pos < line.size())) {
+            const size_t keyStart = line.find('"', pos);
+            if (keyStart == std::string::npos) {
+                break;
+            }
+            const size_t keyEnd = line.find('"', keyStart + 1);
+            const size_t colon = line.find(':', keyEnd);
+            if ((keyEnd == std::string::npos) || (colon == std::string::npos)) {
+                break;
+            }
+            const std::string key(line.substr(keyStart + 1, keyEnd - keyStart - 1));
+            size_t valueStart = line.find_first_not_of(' ', colon + 1);
+            std::string value;
+            if ((valueStart != std::string::npos) && (line[valueStart] == '"')) {
+                size_t i = valueStart + 1;
+                while ((i < line.size()) && (line[i] != '"')) {
+                    if ((line[i] == '\\') && (i + 1 < line.size())) {
+                        i++;
+                    }
+                    value += line[i++];
+                }
+                pos = i + 1;
+            } else if (valueStart != std::string::npos) {
+                const size_t valueEnd = line.find_first_of(",}", valueStart);
+                value = line.substr(valueStart, valueEnd - valueStart);
+                pos = valueEnd;
+            } else {
+                break;
+            }
+            values[key] = value;
+        }
+
+        std::map<std::string, std::string>::const_iterator name(values.find("case"));
+        if (name != values.end()) {
+            results[values["benchmark"] + ':' + name->second] = values;
+        }
+    }
+
+    return (true);
+}
+
+} // namespace
+
+// Counted replacements of the global allocation functions.
+void* operator new(size_t size)
+{
+    void* result = Allocate(size);
+    if (result == nullptr) {
+        throw std::bad_alloc();
+    }
+    return (result);
+}
+
+void* operator new[](size_t size)
+{
+    return (operator new(size));
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    return (Allocate(size));
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    return (Allocate(size));
+}
+
+void operator delete(void* memory) noexcept
+{
+    ::free(memory);
+}
+
+void operator delete[](void* memory) noexcept
+{
+    ::free(memory);
+}
+
+void operator delete(void* memory, const std::nothrow_t&) noexcept
+{
+    ::free(memory);
+}
+
+void operator delete[](void* memory, const std::nothrow_t&) noexcept
+{
+    ::free(memory);
+}
+
+namespace Benchmark {
+
+uint64_t NowNs()
+{
+    struct timespec now;
+    ::clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((static_cast<uint64_t>(now.tv_sec) * 1000000000ULL) + now.tv_nsec);
+}
+
+uint64_t Allocations()
+{
+    return (g_allocations.load(std::memory_order_relaxed));
+}
+
+uint64_t Resident()
+{
+    return (StatusValue("VmRSS"));
+}
+
+uint64_t PeakResident()
+{
+    return (StatusValue("VmHWM"));
+}
+
+bool ResetPeakResident()
+{
+    // Writing 5 to clear_refs resets VmHWM to the current RSS.
+    std::ofstream clearRefs("/proc/self/clear_refs");
+    clearRefs << "5";
+    clearRefs.flush();
+    return (clearRefs.good());
+}
+
+uint32_t Threads()
+{
+    return (static_cast<uint32_t>(StatusValue("Threads")));
+}
+
+Latencies::Latencies()
+    : _samples()
+    , _sorted(true)
+{
+}
+
+void Latencies::Reserve(const size_t count)
+{
+    _samples.reserve(count);
+}
+
+void Latencies::Merge(const Latencies& other)
+{
+    _samples.insert(_samples.end(), other._samples.begin(), other._samples.end());
+    _sorted = false;
+}
+
+uint64_t Latencies::Percentile(const double percentile)
+{
+    if (_samples.empty() == true) {
+        return (0);
+    }
+    if (_sorted == false) {
+        std::sort(_samples.begin(), _samples.end());
+        _sorted = true;
+    }
+
+    size_t rank = static_cast<size_t>(std::ceil((percentile / 100.0) * _samples.size()));
+    rank = std::max<size_t>(1, std::min(rank, _samples.size()));
+
+    return (_samples[rank - 1]);
+}
+
+uint64_t Latencies::Total() const
+{
+    uint64_t total = 0;
+    for (const uint64_t sample : _samples) {
+        total += sample;
+    }
+    return (total);
+}
+
+std::string Result::Name() const
+{
+    std::string name;
+    for (const std::pair<std::string, std::string>& parameter : parameters) {
+        if (name.empty() == false) {
+            name += '/';
+        }
+        name += parameter.first + '=' + parameter.second;
+    }
+    return (name);
+}
+
+Report::Report(const std::string& benchmark)
+    : _benchmark(benchmark)
+    , _current()
+    , _results()
+{
+}
+
+void Report::Parameter(const std::string& key, const std::string& value)
+{
+    _current.parameters.push_back(std::make_pair(key, value));
+}
+
+void Report::Parameter(const std::string& key, const uint64_t value)
+{
+    Parameter(key, std::to_string(value));
+}
+
+void Report::Value(const std::string& name, const double value, const Metric::Direction direction, const double slack)
+{
+    _current.metrics.push_back(Benchmark::Metric(name, value, direction, slack));
+}
+
+void Report::Add()
+{
+    _current.benchmark = _benchmark;
+
+    printf("%s %s:", _benchmark.c_str(), _current.Name().c_str());
+    for (const Benchmark::Metric& metric : _current.metrics) {
+        printf(" %s=%.2f", metric.name.c_str(), metric.value);
+    }
+    printf("\n");
+    fflush(stdout);
+
+    _results.push_back(_current);
+    _current = Result();
+}
+
+bool Report::Write(const std::string& fileName) const
+{
+    std::ofstream file(fileName, std::ios::out | std::ios::trunc);
+    if (file.is_open() == false) {
+        return (false);
+    }
+
+    for (const Result& result : _results) {
+        std::ostringstream line;
+        line.precision(6);
+        line << std::fixed;
+        line << "{\"benchmark\":\"" << Escape(result.benchmark) << "\",\"case\":\"" << Escape(result.Name()) << '"';
+        for (const std::pair<std::string, std::string>& parameter : result.parameters) {
+            line << ",\"" << Escape(parameter.first) << "\":\"" << Escape(parameter.second) << '"';
+        }
+        for (const Benchmark::Metric& metric : result.metrics) {
+            line << ",\"" << Escape(metric.name) << "\":" << metric.value;
+        }
+        line << "}\n";
+        file << line.str();
+    }
+
+    return (file.good());
+}
+
+int Report::Compare(const std::string& fileName, const double threshold) const
+{
+    std::map<std::string, std::map<std::string, std::string>> baseline;
+    if (ReadResults(fileName, baseline) == false) {
+        return (-1);
+    }
+
+    int regressions = 0;
+    uint32_t compared = 0;
+
+    for (const Result& result : _results) {
+        std::map<std::string, std::map<std::string, std::string>>::const_iterator entry(baseline.find(result.benchmark + ':' + result.Name()));
+        if (entry == baseline.end()) {
+            continue;
+        }
+
+        for (const Benchmark::Metric& metric : result.metrics) {
+            std::map<std::string, std::string>::const_iterator value(entry->second.find(metric.name));
+            if (value == entry->second.end()) {
+                continue;
+            }
+
+            const double before = ::strtod(value->second.c_str(), nullptr);
+            const double allowed = (std::fabs(before) * threshold / 100.0) + metric.slack;
+            const double worse = (metric.direction == Metric::HIGHER_IS_BETTER) ? (before - metric.value) : (metric.value - before);
+            compared++;
+
+            if (worse > allowed) {
+                printf("REGRESSION %s %s: %s %.2f -> %.2f (%+.1f%%)\n", result.benchmark.c_str(), result.Name().c_str(),
+                    metric.name.c_str(), before, metric.value, (before != 0) ? ((metric.value - before) * 100.0 / before) : 0.0);
+                regressions++;
+            }
+        }
+    }
+
+    printf("Compared %u metrics with %s: %d regression(s) beyond %.1f%%\n", compared, fileName.c_str(), regressions, threshold);
+
+    return (regressions);
+}
+
+bool ParseList(const std::string& text, std::vector<uint32_t>& values)
+{
+    values.clear();
+
+    const char* position = text.c_str();
+    while (*position != '\0') {
+        char* end = nullptr;
+        unsigned long value = ::strtoul(position, &end, 10);
+        if (end == position) {
+            return (false);
+        }
+        if ((*end == 'K') || (*end == 'k')) {
+            value *= 1024;
+            end++;
+        } else if ((*end == 'M') || (*end == 'm')) {
+            value *= 1024 * 1024;
+            end++;
+        }
+        if ((*end != ',') && (*end != '\0')) {
+            return (false);
+        }
+        values.push_back(static_cast<uint32_t>(value));
+        position = (*end == ',') ? end + 1 : end;
+    }
+
+    return (values.empty() == false);
+}
+
+bool Options::Parse(int& argc, char* argv[], const char* usage)
+{
+    int kept = 1;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string argument(argv[i]);
+        const size_t equals = argument.find('=');
+        const std::string name(argument.substr(0, equals));
+        const std::string value((equals != std::string::npos) ? argument.substr(equals + 1) : std::string());
+
+        if (name == "--json") {
+            json = value;
+        } else if (name == "--baseline") {
+            baseline = value;
+        } else if (name == "--threshold") {
+            threshold = ::strtod(value.c_str(), nullptr);
+        } else if (name == "--iterations") {
+            iterations = static_cast<uint32_t>(::strtoul(value.c_str(), nullptr, 10));
+        } else if (name == "--quick") {
+            quick = true;
+            continue;
+        } else if ((name == "--help") || (name == "-h")) {
+            printf("%s\n"
+                   "  --json=FILE       write the results to FILE, one JSON object per case\n"
+                   "  --baseline=FILE   compare with the results of an earlier run\n"
+                   "  --threshold=PCT   regression threshold in percent (default 5)\n"
+                   "  --iterations=N    iterations per case instead of the default\n"
+                   "  --quick           a reduced matrix, for a smoke test\n", usage);
+            return (false);
+        } else {
+            argv[kept++] = argv[i];
+            continue;
+        }
+
+        if (value.empty() == true) {
+            printf("Missing value for %s\n%s\n", name.c_str(), usage);
+            return (false);
+        }
+    }
+
+    argc = kept;
+    return (true);
+}
+
+int Options::Finish(const Report& report) const
+{
+    int result = 0;
+
+    if ((json.empty() == false) && (report.Write(json) == false)) {
+        printf("Could not write %s\n", json.c_str());
+        result = 1;
+    }
+
+    if (baseline.empty() == false) {
+        const int regressions = report.Compare(baseline, threshold);
+        if (regressions < 0) {
+            printf("Could not read the baseline %s\n", baseline.c_str());
+            result = 1;
+        } else if (regressions > 0) {
+            result = 2;
+        }
+    }
+
+    return (result);
+}
+
+} // namespace Benchmark
@@ -0,0 +1,172 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Measurement and reporting shared by the benchmarks: latency samples,
+// allocation counting and the JSON results, one object per line, that a later
+// run can be compared against.
+namespace Benchmark {
+
+// Monotonic time in nanoseconds.
+uint64_t NowNs();
+
+// Calls to the global operator new since the start of the process, from any
+// thread. The benchmarks link a replacement of the global operators that
+// counts them.
+uint64_t Allocations();
+
+// Resident set size of the process now and at its peak, in KiB, from
+// /proc/self/status. ResetPeakResident() starts a new peak where the kernel
+// allows it (returns false otherwise, the peak then covers the whole run).
+uint64_t Resident();
+uint64_t PeakResident();
+bool ResetPeakResident();
+
+// Threads of the process.
+uint32_t Threads();
+
+// Latency samples, in nanoseconds.
+class Latencies {
+public:
+    Latencies();
+
+    void Reserve(const size_t count);
+    void Add(const uint64_t ns)
+    {
+        _samples.push_back(ns);
+        _sorted = false;
+    }
+    void Merge(const Latencies& other);
+
+    size_t Count() const
+    {
+        return _samples.size();
+    }
+    // Nearest-rank percentile (0 < percentile <= 100), 0 without samples.
+    uint64_t Percentile(const double percentile);
+    uint64_t Total() const;
+
+private:
+    std::vector<uint64_t> _samples;
+    bool _sorted;
+};
+
+struct Metric {
+    enum Direction {
+        HIGHER_IS_BETTER,
+        LOWER_IS_BETTER
+    };
+
+    Metric(const std::string& name, const double value, const Direction direction, const double slack = 0)
+        : name(name)
+        , value(value)
+        , direction(direction)
+        , slack(slack)
+    {
+    }
+
+    std::string name;
+    double value;
+    Direction direction;
+    // Absolute difference always taken as noise, so a value near 0 (an
+    // allocation count, a latency in the noise) does not flag a regression.
+    double slack;
+};
+
+// One case of a benchmark, named by its parameters.
+struct Result {
+    std::string benchmark;
+    std::vector<std::pair<std::string, std::string>> parameters;
+    std::vector<Metric> metrics;
+
+    // "key=value/key=value", what identifies the case in a baseline.
+    std::string Name() const;
+};
+
+class Report {
+public:
+    Report(const Report&) = delete;
+    Report& operator=(const Report&) = delete;
+
+    explicit Report(const std::string& benchmark);
+
+    void Parameter(const std::string& key, const std::string& value);
+    void Parameter(const std::string& key, const uint64_t value);
+    void Value(const std::string& name, const double value, const Metric::Direction direction, const double slack = 0);
+
+    // Closes the case that the parameters and metrics since the previous
+    // call describe, and prints it.
+    void Add();
+
+    const std::vector<Result>& Results() const
+    {
+        return _results;
+    }
+
+    bool Write(const std::string& fileName) const;
+
+    // Compares with the results of an earlier run, written by Write(), and
+    // prints every metric that got worse by more than threshold percent.
+    // Returns the number of such regressions, or -1 if the baseline can not
+    // be read.
+    int Compare(const std::string& fileName, const double threshold) const;
+
+private:
+    std::string _benchmark;
+    Result _current;
+    std::vector<Result> _results;
+};
+
+// A comma separated list of numbers, each with an optional K or M (binary)
+// suffix: "200,16K,2M".
+bool ParseList(const std::string& text, std::vector<uint32_t>& values);
+
+// Command line options common to all benchmarks.
+struct Options {
+    Options()
+        : json()
+        , baseline()
+        , threshold(5)
+        , iterations(0)
+        , quick(false)
+    {
+    }
+
+    std::string json;
+    std::string baseline;
+    double threshold;
+    uint32_t iterations;
+    bool quick;
+
+    // Takes the common options out of argv; returns false on a malformed one
+    // after printing the usage.
+    bool Parse(int& argc, char* argv[], const char* usage);
+
+    // Writes the results and compares them with the baseline, as requested.
+    // Returns the process exit code.
+    int Finish(const Report& report) const;
+};
+
+} // namespace Benchmark
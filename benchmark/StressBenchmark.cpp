@@ -0,0 +1,420 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// Contention on the DRM lock: N sessions decrypt continuously while other
+// threads rotate their keys (SelectKeyId), store licenses, exchange secure
+// stops and tear sessions down, all on the one app context. Reports the
+// throughput and tail latency of every decrypting session as N grows, so the
+// cost of serializing on drmAppContextMutex_ shows in the scaling table.
+//
+// Also meant to run under ThreadSanitizer, see CMakeLists.txt; --quick keeps
+// such a run short.
+
+#include "Harness.h"
+#include "Report.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace CDMi;
+
+namespace {
+
+const char USAGE[] =
+    "Usage: PlayReadyStressBenchmark [options]\n"
+    "  --sessions=LIST     concurrently decrypting sessions, e.g. 1,2,4,8,16\n"
+    "  --duration=MS       time every case runs for (default 2000)\n"
+    "  --sample=BYTES      size of the decrypted samples (default 65536)\n"
+    "  --background=0|1    rotate keys, store licenses, exchange secure stops and\n"
+    "                      tear sessions down next to the decrypts (default 1)";
+
+const uint32_t DEFAULT_DURATION_MS = 2000;
+const uint32_t QUICK_DURATION_MS = 300;
+const uint32_t DEFAULT_SAMPLE_SIZE = 64 * 1024;
+const uint32_t KEYS_PER_STREAM = 4;
+const uint32_t WARMUP_ITERATIONS = 16;
+
+// How often each of the background actors takes the DRM lock.
+const uint32_t ROTATE_INTERVAL_MS = 2;
+const uint32_t LICENSE_INTERVAL_MS = 5;
+const uint32_t SECURE_STOP_INTERVAL_MS = 50;
+const uint32_t TEARDOWN_INTERVAL_MS = 10;
+
+// Key ID seeds, apart for the decrypting sessions and each actor.
+const uint8_t LICENSE_SEEDS = 0x80;
+const uint8_t TEARDOWN_SEEDS = 0x40;
+const uint32_t SEEDS_PER_ACTOR = 32;
+
+struct Case {
+    uint32_t sessions;
+    uint32_t durationMs;
+    uint32_t sampleSize;
+    bool background;
+};
+
+// A session with a license for all its keys, decrypting with one of them.
+struct Stream {
+    Stream()
+        : session(nullptr)
+        , keyIds()
+        , latencies()
+        , failures(0)
+    {
+    }
+
+    MediaKeySession* session;
+    std::vector<FakePlayReady::KeyId> keyIds;
+    Benchmark::Latencies latencies;
+    uint32_t failures;
+};
+
+// What a background thread did.
+struct Actor {
+    Actor()
+        : latencies()
+        , failures(0)
+        , items(0)
+    {
+    }
+
+    Benchmark::Latencies latencies;
+    uint32_t failures;
+    uint32_t items;
+};
+
+// A row of the scaling table printed at the end.
+struct Scaling {
+    uint32_t sessions;
+    double aggregate;
+    double perSession;
+    double slowest;
+    double efficiency;
+    uint64_t p99;
+};
+
+// SetDrmHeader, GetChallengeDataExt, the server and StoreLicenseData: the
+// licensing part of the Netflix flow, which holds the DRM lock per call.
+bool Acquire(MediaKeySession& session, Benchmark::LicenseServer& server, const std::vector<FakePlayReady::KeyId>& keyIds)
+{
+    const std::vector<uint8_t> header(FakePlayReady::BuildHeader(keyIds));
+    std::vector<uint8_t> challenge;
+    uint32_t challengeSize = 0;
+    uint8_t secureStopId[16];
+
+    bool succeeded = (session.SetDrmHeader(header.data(), header.size()) == CDMi_SUCCESS) &&
+                     (session.GetChallengeDataExt(nullptr, challengeSize, 0) == CDMi_SUCCESS);
+
+    if (succeeded == true) {
+        challenge.resize(challengeSize);
+        succeeded = (session.GetChallengeDataExt(challenge.data(), challengeSize, 0) == CDMi_SUCCESS);
+        challenge.resize(challengeSize);
+    }
+    if (succeeded == true) {
+        const std::vector<uint8_t> response(server.Request(challenge));
+        succeeded = (session.StoreLicenseData(response.data(), response.size(), secureStopId) == CDMi_SUCCESS);
+    }
+
+    return (succeeded);
+}
+
+bool Decrypt(MediaKeySession& session, const FakePlayReady::KeyId& keyId, const std::vector<uint8_t>& sample, const uint64_t counter)
+{
+    DRM_AES_COUNTER_MODE_CONTEXT context = { counter, 0, 0 };
+    uint32_t outputSize = 0;
+    uint8_t* output = nullptr;
+
+    return (session.Decrypt(nullptr, 0, nullptr, 0, reinterpret_cast<const uint8_t*>(&context), sizeof(context),
+                sample.data(), sample.size(), &outputSize, &output, keyId.size(), keyId.data(), true) == CDMi_SUCCESS);
+}
+
+void Decrypting(Stream& stream, const Case& test, std::atomic<uint32_t>& warm, std::atomic<bool>& start, const std::atomic<bool>& running)
+{
+    const std::vector<uint8_t> sample(test.sampleSize, 0xA5);
+    uint64_t counter = 0;
+
+    for (uint32_t i = 0; i < WARMUP_ITERATIONS; i++) {
+        Decrypt(*stream.session, stream.keyIds[0], sample, counter++);
+    }
+    warm++;
+
+    while (start.load() == false) {
+        std::this_thread::yield();
+    }
+
+    while (running.load() == true) {
+        const uint64_t begin = Benchmark::NowNs();
+        const bool succeeded = Decrypt(*stream.session, stream.keyIds[0], sample, counter++);
+        stream.latencies.Add(Benchmark::NowNs() - begin);
+        if (succeeded == false) {
+            stream.failures++;
+        }
+    }
+}
+
+// Calls operation every intervalMs until stopped, timing each call.
+void Paced(const uint32_t intervalMs, const std::atomic<bool>& running, Actor& actor, const std::function<bool(uint32_t)>& operation)
+{
+    for (uint32_t tick = 0; running.load() == true; tick++) {
+        const uint64_t begin = Benchmark::NowNs();
+        if (operation(tick) == false) {
+            actor.failures++;
+        }
+        actor.latencies.Add(Benchmark::NowNs() - begin);
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(intervalMs));
+    }
+}
+
+// Creates the decrypting sessions one after the other; the Netflix flow is
+// used throughout since SelectKeyId is what rotates keys.
+bool Prepare(Benchmark::System& system, Benchmark::LicenseServer& server, const Case& test, std::vector<Stream>& streams)
+{
+    for (uint32_t i = 0; i < test.sessions; i++) {
+        Stream& stream = streams[i];
+        stream.keyIds = Benchmark::KeyIds(KEYS_PER_STREAM, static_cast<uint8_t>(i));
+        stream.session = system.CreateSession(std::vector<uint8_t>());
+
+        if ((Acquire(*stream.session, server, stream.keyIds) == false) ||
+            (stream.session->SelectKeyId(stream.keyIds[0].size(), stream.keyIds[0].data()) != CDMi_SUCCESS)) {
+            fprintf(stderr, "Session %u did not get usable keys\n", i);
+            return (false);
+        }
+    }
+    return (true);
+}
+
+bool Run(Benchmark::System& system, const Case& test, Benchmark::Report& report, std::vector<Scaling>& scaling)
+{
+    Benchmark::LicenseServer server(0);
+    std::vector<Stream> streams(test.sessions);
+    bool succeeded = Prepare(system, server, test, streams);
+
+    Actor rotations;
+    Actor licenses;
+    Actor secureStops;
+    Actor teardowns;
+    MediaKeySession* licensing = system.CreateSession(std::vector<uint8_t>());
+    std::atomic<uint32_t> warm(0);
+    std::atomic<bool> start(false);
+    std::atomic<bool> running(true);
+    uint64_t elapsed = 0;
+
+    if (succeeded == true) {
+        std::vector<std::thread> threads;
+        for (Stream& stream : streams) {
+            threads.emplace_back(Decrypting, std::ref(stream), std::cref(test), std::ref(warm), std::ref(start), std::cref(running));
+        }
+        while (warm.load() < test.sessions) {
+            std::this_thread::yield();
+        }
+
+        if (test.background == true) {
+            // Switches the session next in line to its next key.
+            threads.emplace_back(Paced, ROTATE_INTERVAL_MS, std::cref(running), std::ref(rotations), [&streams](const uint32_t tick) {
+                Stream& stream = streams[tick % streams.size()];
+                const FakePlayReady::KeyId& keyId = stream.keyIds[((tick / streams.size()) + 1) % KEYS_PER_STREAM];
+                return (stream.session->SelectKeyId(keyId.size(), keyId.data()) == CDMi_SUCCESS);
+            });
+            // Licenses for other content on a session that does not decrypt.
+            threads.emplace_back(Paced, LICENSE_INTERVAL_MS, std::cref(running), std::ref(licenses), [&server, licensing](const uint32_t tick) {
+                return (Acquire(*licensing, server, Benchmark::KeyIds(2, static_cast<uint8_t>(LICENSE_SEEDS + (tick % SEEDS_PER_ACTOR)))));
+            });
+            threads.emplace_back(Paced, SECURE_STOP_INTERVAL_MS, std::cref(running), std::ref(secureStops), [&system, &secureStops](const uint32_t) {
+                secureStops.items += system.ExchangeSecureStops();
+                return (true);
+            });
+            // A short-lived session: licensed, one decrypt and torn down.
+            threads.emplace_back(Paced, TEARDOWN_INTERVAL_MS, std::cref(running), std::ref(teardowns), [&system, &server, &test](const uint32_t tick) {
+                const std::vector<FakePlayReady::KeyId> keyIds(Benchmark::KeyIds(2, static_cast<uint8_t>(TEARDOWN_SEEDS + (tick % SEEDS_PER_ACTOR))));
+                MediaKeySession* session = system.CreateSession(std::vector<uint8_t>());
+                const bool result = (Acquire(*session, server, keyIds) == true) &&
+                                    (session->SelectKeyId(keyIds[0].size(), keyIds[0].data()) == CDMi_SUCCESS) &&
+                                    (Decrypt(*session, keyIds[0], std::vector<uint8_t>(test.sampleSize, 0x5A), 0) == true);
+                system.DestroySession(session);
+                return (result);
+            });
+        }
+
+        const uint64_t begin = Benchmark::NowNs();
+        start = true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(test.durationMs));
+        running = false;
+
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        elapsed = Benchmark::NowNs() - begin;
+    }
+
+    system.DestroySession(licensing);
+    for (Stream& stream : streams) {
+        if (stream.session != nullptr) {
+            system.DestroySession(stream.session);
+        }
+    }
+
+    if (succeeded == false) {
+        return (false);
+    }
+
+    const double seconds = elapsed / 1e9;
+    const double mib = static_cast<double>(test.sampleSize) / (1024 * 1024);
+    Benchmark::Latencies decrypts;
+    double slowest = -1;
+    uint32_t failures = 0;
+
+    for (Stream& stream : streams) {
+        const double throughput = (stream.latencies.Count() * mib) / seconds;
+        slowest = ((slowest < 0) || (throughput < slowest)) ? throughput : slowest;
+        decrypts.Merge(stream.latencies);
+        failures += stream.failures;
+    }
+
+    const double aggregate = (decrypts.Count() * mib) / seconds;
+    const double perSession = aggregate / test.sessions;
+    const double reference = (scaling.empty() == true) ? perSession : scaling.front().perSession;
+    const double efficiency = (reference > 0) ? ((100.0 * perSession) / reference) : 0;
+
+    Scaling row;
+    row.sessions = test.sessions;
+    row.aggregate = aggregate;
+    row.perSession = perSession;
+    row.slowest = slowest;
+    row.efficiency = efficiency;
+    row.p99 = decrypts.Percentile(99);
+    scaling.push_back(row);
+
+    report.Parameter("sessions", test.sessions);
+    report.Parameter("size", test.sampleSize);
+    report.Parameter("background", (test.background == true) ? "on" : "off");
+    report.Value("throughput_mib_s", aggregate, Benchmark::Metric::HIGHER_IS_BETTER);
+    report.Value("session_mib_s", perSession, Benchmark::Metric::HIGHER_IS_BETTER);
+    report.Value("slowest_session_mib_s", slowest, Benchmark::Metric::HIGHER_IS_BETTER);
+    report.Value("scaling_pct", efficiency, Benchmark::Metric::HIGHER_IS_BETTER, 5);
+    report.Value("decrypt_p50_us", decrypts.Percentile(50) / 1000.0, Benchmark::Metric::LOWER_IS_BETTER, 1);
+    report.Value("decrypt_p99_us", decrypts.Percentile(99) / 1000.0, Benchmark::Metric::LOWER_IS_BETTER, 5);
+    report.Value("decrypt_p999_us", decrypts.Percentile(99.9) / 1000.0, Benchmark::Metric::LOWER_IS_BETTER, 20);
+    report.Value("decrypt_failures", failures, Benchmark::Metric::LOWER_IS_BETTER, 0);
+
+    if (test.background == true) {
+        Actor* const actors[] = { &rotations, &licenses, &secureStops, &teardowns };
+        const char* const names[] = { "select_key", "store_license", "secure_stop", "teardown" };
+        uint32_t backgroundFailures = 0;
+
+        for (uint32_t i = 0; i < (sizeof(actors) / sizeof(actors[0])); i++) {
+            Actor& actor = *actors[i];
+            report.Value(std::string(names[i]) + "_p50_us", actor.latencies.Percentile(50) / 1000.0, Benchmark::Metric::LOWER_IS_BETTER, 20);
+            report.Value(std::string(names[i]) + "_p99_us", actor.latencies.Percentile(99) / 1000.0, Benchmark::Metric::LOWER_IS_BETTER, 50);
+            backgroundFailures += actor.failures;
+        }
+        report.Value("secure_stops_committed", secureStops.items, Benchmark::Metric::HIGHER_IS_BETTER, 10);
+        report.Value("background_failures", backgroundFailures, Benchmark::Metric::LOWER_IS_BETTER, 0);
+    }
+    report.Add();
+
+    // Counted rather than fatal, like the session failures of the churn
+    // benchmark: they are part of what is measured.
+    if (failures > 0) {
+        fprintf(stderr, "%u of %zu decrypts failed\n", failures, decrypts.Count());
+    }
+
+    return (true);
+}
+
+void Print(const std::vector<Scaling>& scaling)
+{
+    printf("\n%8s %16s %16s %16s %9s %10s\n", "sessions", "total MiB/s", "per session", "slowest", "scaling", "p99 us");
+    for (const Scaling& row : scaling) {
+        printf("%8u %16.1f %16.1f %16.1f %8.1f%% %10.1f\n", row.sessions, row.aggregate, row.perSession, row.slowest,
+            row.efficiency, row.p99 / 1000.0);
+    }
+    const uint32_t cpus = std::thread::hardware_concurrency();
+
+    printf("Scaling is the per session throughput against that of the first case, %u session%s, on %u CPU%s.\n",
+        scaling.front().sessions, (scaling.front().sessions > 1) ? "s" : "", cpus, (cpus > 1) ? "s" : "");
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    Benchmark::Options options;
+    if (options.Parse(argc, argv, USAGE) == false) {
+        return (1);
+    }
+
+    std::vector<uint32_t> sessions = (options.quick == true) ? std::vector<uint32_t>({ 1, 4 }) : std::vector<uint32_t>({ 1, 2, 4, 8, 16 });
+    Case base;
+    base.durationMs = (options.quick == true) ? QUICK_DURATION_MS : DEFAULT_DURATION_MS;
+    base.sampleSize = DEFAULT_SAMPLE_SIZE;
+    base.background = true;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string argument(argv[i]);
+        bool valid = true;
+        if (argument.compare(0, 11, "--sessions=") == 0) {
+            valid = (Benchmark::ParseList(argument.substr(11), sessions) == true) &&
+                    (std::find(sessions.begin(), sessions.end(), 0) == sessions.end());
+        } else if (argument.compare(0, 11, "--duration=") == 0) {
+            base.durationMs = static_cast<uint32_t>(::strtoul(argument.c_str() + 11, nullptr, 10));
+            valid = (base.durationMs > 0);
+        } else if (argument.compare(0, 9, "--sample=") == 0) {
+            base.sampleSize = static_cast<uint32_t>(::strtoul(argument.c_str() + 9, nullptr, 10));
+            valid = (base.sampleSize > 0);
+        } else if ((argument == "--background=0") || (argument == "--background=1")) {
+            base.background = (argument == "--background=1");
+        } else {
+            valid = false;
+        }
+        if (valid == false) {
+            printf("Invalid option %s\n%s\n", argument.c_str(), USAGE);
+            return (1);
+        }
+    }
+
+    Benchmark::System system;
+    if (system.IsValid() == false) {
+        return (1);
+    }
+
+    Benchmark::Report report("stress");
+    std::vector<Scaling> scaling;
+    bool succeeded = true;
+
+    for (const uint32_t count : sessions) {
+        Case test(base);
+        test.sessions = count;
+        if ((succeeded == true) && (Run(system, test, report, scaling) == false)) {
+            succeeded = false;
+        }
+    }
+
+    if (scaling.empty() == false) {
+        Print(scaling);
+    }
+
+    return ((succeeded == true) ? options.Finish(report) : 1);
+}
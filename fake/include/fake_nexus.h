@@ -0,0 +1,132 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Host stand-in for the subset of the Nexus, NxClient and BKNI APIs used by
+// the plugin. Memory comes from the regular heap; "secure" memory blocks are
+// plain heap buffers so decrypted output can be inspected.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+typedef unsigned NEXUS_Error;
+#define NEXUS_SUCCESS 0
+#define NEXUS_OUT_OF_SYSTEM_MEMORY 2
+#define NEXUS_INVALID_PARAMETER 3
+
+#define NEXUS_MAX_HEAPS 16
+#define NXCLIENT_FULL_HEAP 1
+#define NXCLIENT_MAX_NAME 32
+
+#define BSTD_UNUSED(x) ((void)(x))
+#define BSTD_ENDIAN_LITTLE 1234
+
+typedef struct NEXUS_Heap* NEXUS_HeapHandle;
+typedef struct NEXUS_MemoryBlock* NEXUS_MemoryBlockHandle;
+typedef struct NEXUS_MemoryBlockToken* NEXUS_MemoryBlockTokenHandle;
+
+typedef enum NEXUS_MemoryType {
+    NEXUS_MemoryType_eDriver = 0x01,
+    NEXUS_MemoryType_eApplication = 0x02,
+    NEXUS_MemoryType_eSecure = 0x04,
+    NEXUS_MemoryType_eFull = 0x03
+} NEXUS_MemoryType;
+
+typedef enum NEXUS_HeapLookupType {
+    NEXUS_HeapLookupType_eMain,
+    NEXUS_HeapLookupType_eCompressedRegion
+} NEXUS_HeapLookupType;
+
+typedef struct NEXUS_MemoryAllocationSettings {
+    NEXUS_HeapHandle heap;
+    unsigned alignment;
+} NEXUS_MemoryAllocationSettings;
+
+typedef struct NEXUS_MemoryBlockAllocationSettings {
+    bool reserved;
+} NEXUS_MemoryBlockAllocationSettings;
+
+typedef struct NEXUS_MemoryStatus {
+    unsigned memoryType;
+    size_t size;
+    size_t free;
+    size_t highWatermark;
+    unsigned numAllocs;
+} NEXUS_MemoryStatus;
+
+typedef struct NEXUS_ClientConfiguration {
+    NEXUS_HeapHandle heap[NEXUS_MAX_HEAPS];
+} NEXUS_ClientConfiguration;
+
+typedef struct NxClient_JoinSettings {
+    char name[NXCLIENT_MAX_NAME];
+    bool ignoreStandbyRequest;
+} NxClient_JoinSettings;
+
+typedef struct NxClient_AllocSettings {
+    unsigned surfaceClient;
+} NxClient_AllocSettings;
+
+typedef struct NxClient_AllocResults {
+    unsigned allocated;
+} NxClient_AllocResults;
+
+// Memory
+void NEXUS_Memory_GetDefaultAllocationSettings(NEXUS_MemoryAllocationSettings* pSettings);
+NEXUS_Error NEXUS_Memory_Allocate(size_t numBytes, const NEXUS_MemoryAllocationSettings* pSettings, void** ppMemory);
+void NEXUS_Memory_Free(void* pMemory);
+
+NEXUS_HeapHandle NEXUS_Heap_Lookup(NEXUS_HeapLookupType lookupType);
+NEXUS_Error NEXUS_Heap_GetStatus(NEXUS_HeapHandle heap, NEXUS_MemoryStatus* pStatus);
+
+NEXUS_MemoryBlockHandle NEXUS_MemoryBlock_Allocate(NEXUS_HeapHandle heap, size_t numBytes, size_t alignment,
+    const NEXUS_MemoryBlockAllocationSettings* pSettings);
+void NEXUS_MemoryBlock_Free(NEXUS_MemoryBlockHandle memoryBlock);
+NEXUS_Error NEXUS_MemoryBlock_Lock(NEXUS_MemoryBlockHandle memoryBlock, void** ppMemory);
+void NEXUS_MemoryBlock_Unlock(NEXUS_MemoryBlockHandle memoryBlock);
+NEXUS_MemoryBlockTokenHandle NEXUS_MemoryBlock_CreateToken(NEXUS_MemoryBlockHandle memoryBlock);
+
+void NEXUS_Platform_GetClientConfiguration(NEXUS_ClientConfiguration* pConfig);
+
+// NxClient
+void NxClient_GetDefaultJoinSettings(NxClient_JoinSettings* pSettings);
+NEXUS_Error NxClient_Join(const NxClient_JoinSettings* pSettings);
+void NxClient_Uninit(void);
+void NxClient_GetDefaultAllocSettings(NxClient_AllocSettings* pSettings);
+NEXUS_Error NxClient_Alloc(const NxClient_AllocSettings* pSettings, NxClient_AllocResults* pResults);
+void NxClient_Free(const NxClient_AllocResults* pResults);
+
+// BKNI
+void* BKNI_Malloc(size_t size);
+void BKNI_Free(void* mem);
+void* BKNI_Memset(void* mem, int ch, size_t n);
+void* BKNI_Memcpy(void* dst, const void* src, size_t n);
+
+// Host-only accounting, used by the benchmarks to report Nexus heap usage.
+typedef struct FakeNexus_HeapUsage {
+    size_t currentBytes;
+    size_t peakBytes;
+    size_t liveBlocks;
+    uint64_t totalAllocations;
+} FakeNexus_HeapUsage;
+
+void FakeNexus_GetHeapUsage(FakeNexus_HeapUsage* pUsage);
@@ -0,0 +1,386 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Host stand-in for the subset of the PlayReady 3.x porting kit used by the
+// plugin. Names and signatures follow the porting kit so the plugin sources
+// build unmodified; behaviour is a functional model (software AES-CTR, a
+// file-backed store, a nonce FIFO) and not a security implementation.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <sys/time.h>
+
+#include "fake_nexus.h"
+
+#define DRM_API
+#define DRM_CALL
+
+typedef void DRM_VOID;
+typedef uint8_t DRM_BYTE;
+typedef char DRM_CHAR;
+typedef uint16_t DRM_WCHAR;
+typedef uint16_t DRM_WORD;
+typedef uint32_t DRM_DWORD;
+typedef int32_t DRM_LONG;
+typedef int32_t DRM_BOOL;
+typedef uint64_t DRM_UINT64;
+typedef int32_t DRM_RESULT;
+
+#ifndef TRUE
+#define TRUE 1
+#endif
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+#define DRM_SUCCESS                                         ((DRM_RESULT)0x00000000L)
+#define DRM_S_FALSE                                         ((DRM_RESULT)0x00000001L)
+#define DRM_E_FAIL                                          ((DRM_RESULT)0x80004005L)
+#define DRM_E_NOTIMPL                                       ((DRM_RESULT)0x80004001L)
+#define DRM_E_OUTOFMEMORY                                   ((DRM_RESULT)0x80000002L)
+#define DRM_E_INVALIDARG                                    ((DRM_RESULT)0x80070057L)
+#define DRM_E_BUFFERTOOSMALL                                ((DRM_RESULT)0x8007007AL)
+#define DRM_E_FILENOTFOUND                                  ((DRM_RESULT)0x80030002L)
+#define DRM_E_NOMORE                                        ((DRM_RESULT)0x80070103L)
+#define DRM_E_LICENSE_NOT_FOUND                             ((DRM_RESULT)0x8004C013L)
+#define DRM_E_LICENSE_EXPIRED                               ((DRM_RESULT)0x8004C006L)
+#define DRM_E_RIV_TOO_SMALL                                 ((DRM_RESULT)0x8004C3F8L)
+#define DRM_E_LICEVAL_REQUIRED_REVOCATION_LIST_NOT_AVAILABLE ((DRM_RESULT)0x8004C3EFL)
+#define DRM_E_LICACQ_TOO_MANY_LICENSES                      ((DRM_RESULT)0x8004C503L)
+#define DRM_E_DST_STORE_FULL                                ((DRM_RESULT)0x8004C0A1L)
+#define DRM_E_EXTENDED_RESTRICTION_NOT_UNDERSTOOD           ((DRM_RESULT)0x8004C060L)
+#define DRM_E_SECURETIME_CLOCK_NOT_SET                      ((DRM_RESULT)0x8004C601L)
+#define DRM_E_CLK_NOT_SUPPORTED                             ((DRM_RESULT)0x8004C02BL)
+#define DRM_E_TEE_PROVISIONING_REQUIRED                     ((DRM_RESULT)0x8004CD20L)
+#define DRM_E_NO_OPL_CALLBACK                               ((DRM_RESULT)0x8004C07EL)
+#define DRM_E_DECRYPT_NOT_INITIALIZED                       ((DRM_RESULT)0x8004C058L)
+#define DRM_E_HEADER_NOT_SET                                ((DRM_RESULT)0x8004C03CL)
+#define DRM_E_SECURESTOP_SESSION_NOT_FOUND                  ((DRM_RESULT)0x8004C604L)
+#define DRM_E_NONCE_STORE_TOKEN_NOT_FOUND                   ((DRM_RESULT)0x8004C610L)
+
+#define DRM_FAILED(dr)      (((DRM_RESULT)(dr)) < 0)
+#define DRM_SUCCEEDED(dr)   (((DRM_RESULT)(dr)) >= 0)
+
+#define ChkDR(expr)         do { dr = (expr); if (DRM_FAILED(dr)) { goto ErrorExit; } } while (0)
+#define ChkMem(expr)        do { if ((expr) == NULL) { dr = DRM_E_OUTOFMEMORY; goto ErrorExit; } } while (0)
+#define ChkArg(expr)        do { if (!(expr)) { dr = DRM_E_INVALIDARG; goto ErrorExit; } } while (0)
+#define ChkBOOL(expr, err)  do { if (!(expr)) { dr = (err); goto ErrorExit; } } while (0)
+
+#define DRM_NO_OF(a)            (sizeof(a) / sizeof((a)[0]))
+#define ZEROMEM(p, cb)          memset((p), 0, (cb))
+#define CCH_BASE64_EQUIV(cb)    ((((cb) + 2) / 3) * 4)
+#define DRM_ONE_WCHAR(ch1, ch2) ((DRM_WCHAR)(((DRM_WCHAR)(DRM_BYTE)(ch2) << 8) | (DRM_BYTE)(ch1)))
+
+#define DRM_ID_SIZE             16
+#define DRM_MAX_LICENSE_ACK     20
+
+#define MINIMUM_APPCONTEXT_OPAQUE_BUFFER_SIZE   (64 * 1024)
+#define REVOCATION_BUFFER_SIZE                  (32 * 1024)
+
+typedef struct { DRM_BYTE rgb[DRM_ID_SIZE]; } DRM_ID;
+typedef DRM_ID DRM_KID;
+typedef DRM_ID DRM_LID;
+typedef DRM_ID DRM_GUID;
+
+#define DRM_IDENTICAL_GUIDS(a, b) (memcmp((a), (b), sizeof(DRM_GUID)) == 0)
+
+typedef struct {
+    const DRM_WCHAR* pwszString;
+    DRM_DWORD cchString;
+} DRM_CONST_STRING;
+
+typedef struct {
+    const DRM_CHAR* pszString;
+    DRM_DWORD cchString;
+} DRM_ANSI_CONST_STRING;
+
+#define DRM_EMPTY_DRM_STRING { NULL, 0 }
+
+typedef struct {
+    DRM_DWORD dwLowDateTime;
+    DRM_DWORD dwHighDateTime;
+} DRMFILETIME;
+
+typedef struct {
+    DRM_WORD wYear;
+    DRM_WORD wMonth;
+    DRM_WORD wDayOfWeek;
+    DRM_WORD wDay;
+    DRM_WORD wHour;
+    DRM_WORD wMinute;
+    DRM_WORD wSecond;
+    DRM_WORD wMilliseconds;
+} DRMSYSTEMTIME;
+
+typedef enum {
+    DRM_SECURETIME_CLOCK_TYPE_INVALID = 0,
+    DRM_SECURETIME_CLOCK_TYPE_TEE = 1,
+    DRM_SECURETIME_CLOCK_TYPE_ANTIROLLBACK = 2
+} DRM_SECURETIME_CLOCK_TYPE;
+
+// The app context and decrypt context are opaque to the caller, who allocates
+// and zeroes them. The model keeps its state behind the first pointer.
+typedef struct {
+    DRM_VOID* pvInternal;
+    DRM_BYTE rgbReserved[56];
+} DRM_APP_CONTEXT;
+
+typedef struct {
+    DRM_VOID* pvInternal;
+    DRM_BYTE rgbReserved[56];
+} DRM_DECRYPT_CONTEXT;
+
+typedef struct {
+    DRM_UINT64 qwInitializationVector;
+    DRM_UINT64 qwBlockOffset;
+    DRM_BYTE bByteOffset;
+} DRM_AES_COUNTER_MODE_CONTEXT;
+
+typedef struct {
+    DRM_VOID* heap;
+    DRM_VOID* f_pOEMContext;
+} OEM_Settings;
+
+typedef enum {
+    DRM_PLAY_OPL_CALLBACK = 0x1,
+    DRM_EXTENDED_RESTRICTION_CONDITION_CALLBACK = 0x2,
+    DRM_EXTENDED_RESTRICTION_ACTION_CALLBACK = 0x3,
+    DRM_EXTENDED_RESTRICTION_QUERY_CALLBACK = 0x4,
+    DRM_SECURE_STATE_TOKEN_RESOLVE_CALLBACK = 0x5,
+    DRM_RESTRICTED_SOURCEID_CALLBACK = 0x6
+} DRM_POLICY_CALLBACK_TYPE;
+
+typedef struct {
+    DRM_WORD wCompressedDigitalVideo;
+    DRM_WORD wUncompressedDigitalVideo;
+    DRM_WORD wAnalogVideo;
+    DRM_WORD wCompressedDigitalAudio;
+    DRM_WORD wUncompressedDigitalAudio;
+} DRM_MINIMUM_OUTPUT_PROTECTION_LEVELS;
+
+typedef struct {
+    DRM_DWORD dwVersion;
+    DRM_GUID guidId;
+    DRM_DWORD dwConfigData;
+    DRM_DWORD cbConfigData;
+    DRM_BYTE rgbConfigData[16];
+} DRM_OUTPUT_PROTECTION_EX;
+
+typedef struct {
+    DRM_DWORD dwVersion;
+    DRM_WORD cEntries;
+    DRM_OUTPUT_PROTECTION_EX* rgVop;
+} DRM_VIDEO_OUTPUT_PROTECTION_IDS_EX;
+
+typedef struct {
+    DRM_DWORD dwVersion;
+    DRM_WORD cEntries;
+    DRM_OUTPUT_PROTECTION_EX* rgAop;
+} DRM_AUDIO_OUTPUT_PROTECTION_IDS_EX;
+
+typedef struct {
+    DRM_WORD cIds;
+    DRM_GUID* rgIds;
+} DRM_OPL_OUTPUT_IDS;
+
+typedef struct {
+    DRM_DWORD dwVersion;
+    DRM_MINIMUM_OUTPUT_PROTECTION_LEVELS minOPL;
+    DRM_OPL_OUTPUT_IDS oplIdReserved;
+    DRM_VIDEO_OUTPUT_PROTECTION_IDS_EX vopi;
+    DRM_AUDIO_OUTPUT_PROTECTION_IDS_EX aopi;
+    DRM_VIDEO_OUTPUT_PROTECTION_IDS_EX dvopi;
+} DRM_PLAY_OPL_EX2;
+
+typedef struct {
+    DRM_WORD wType;
+    DRM_WORD wFlags;
+    const DRM_BYTE* pbBuffer;
+    DRM_DWORD ibData;
+    DRM_DWORD cbData;
+} DRM_XMRFORMAT_UNKNOWN_OBJECT;
+
+typedef struct {
+    DRM_WORD wRightID;
+    const DRM_XMRFORMAT_UNKNOWN_OBJECT* pRestriction;
+} DRM_EXTENDED_RESTRICTION_CALLBACK_STRUCT;
+
+typedef DRM_RESULT (DRM_CALL* DRMPFNPOLICYCALLBACK)(
+    const DRM_VOID* f_pvPolicyCallbackData,
+    DRM_POLICY_CALLBACK_TYPE f_dwCallbackType,
+    const DRM_KID* f_pKID,
+    const DRM_LID* f_pLID,
+    const DRM_VOID* f_pv);
+
+typedef DRM_RESULT (DRM_CALL* DRM_STORE_CLEANUP_CALLBACK)(
+    const DRM_VOID* f_pvCallerData,
+    DRM_DWORD f_cLicenses,
+    DRM_DWORD f_cTotalLicenses);
+
+typedef enum {
+    DRM_CSP_HEADER_NOT_SET = 0,
+    DRM_CSP_V1_HEADER = 1,
+    DRM_CSP_V2_HEADER = 2,
+    DRM_CSP_KID = 3,
+    DRM_CSP_V2_4_HEADER = 5,
+    DRM_CSP_V4_HEADER = 6,
+    DRM_CSP_AUTODETECT_HEADER = 7,
+    DRM_CSP_PLAYREADY_OBJ = 8,
+    DRM_CSP_V4_1_HEADER = 9,
+    DRM_CSP_PLAYREADY_OBJ_WITH_KID = 10,
+    DRM_CSP_HEADER_COMPONENTS = 11,
+    DRM_CSP_V4_2_HEADER = 12,
+    DRM_CSP_DECRYPTION_OUTPUT_MODE = 13,
+    DRM_CSP_SELECT_KID = 14,
+    DRM_CSP_V4_3_HEADER = 15
+} DRM_CONTENT_SET_PROPERTY;
+
+#define OEM_TEE_DECRYPTION_MODE_NOT_SECURE   0
+#define OEM_TEE_DECRYPTION_MODE_HANDLE       1
+#define OEM_TEE_DECRYPTION_MODE_SAMPLE_PROTECTION 2
+
+typedef DRM_DWORD DRM_PROCESS_LIC_RESPONSE_FLAG;
+#define DRM_PROCESS_LIC_RESPONSE_NO_FLAGS                   0x00000000
+#define DRM_PROCESS_LIC_RESPONSE_SIGNATURE_NOT_REQUIRED     0x00000001
+
+#define DRM_STORE_CLEANUP_DELETE_EXPIRED_LICENSES           0x00000001
+#define DRM_STORE_CLEANUP_DELETE_REMOVAL_DATE_LICENSES      0x00000002
+#define DRM_STORE_CLEANUP_ALL                               0xFFFFFFFF
+
+typedef struct {
+    DRM_KID m_oKID;
+    DRM_LID m_oLID;
+    DRM_RESULT m_dwResult;
+    DRM_DWORD m_dwFlags;
+} DRM_LICENSE_ACK;
+
+typedef enum {
+    eUnknownProtocol = 0,
+    eV2Protocol = 1,
+    eV3Protocol = 2
+} DRM_LICENSE_RESPONSE_TYPE;
+
+typedef struct {
+    DRM_LICENSE_RESPONSE_TYPE m_eType;
+    DRM_ID m_idSession;
+    DRM_LICENSE_ACK m_rgoAcks[DRM_MAX_LICENSE_ACK];
+    DRM_LICENSE_ACK* m_pAcks;
+    DRM_DWORD m_cMaxAcks;
+    DRM_DWORD m_cAcks;
+    DRM_RESULT m_dwResult;
+    DRM_ID m_oBatchID;
+} DRM_LICENSE_RESPONSE;
+
+typedef struct {
+    DRM_ID m_oAccountID;
+    DRM_ID m_oServiceID;
+    DRM_DWORD m_dwRevision;
+} DRM_DOMAIN_ID;
+
+// Constant data
+extern const DRM_CONST_STRING g_dstrWMDRM_RIGHT_PLAYBACK;
+extern DRM_CONST_STRING g_dstrDrmPath;
+extern const DRM_CONST_STRING g_dstrReqTagPlayReadyClientVersionData;
+extern const DRM_ANSI_CONST_STRING g_dstrHttpSecureTimeServerUrl;
+extern const DRM_GUID g_guidMaxResDecode;
+
+// OEM
+DRM_VOID* Oem_MemAlloc(DRM_DWORD f_cbSize);
+DRM_VOID Oem_MemFree(DRM_VOID* f_pv);
+DRM_RESULT Oem_Random_GetBytes(DRM_VOID* f_pOEMContext, DRM_BYTE* f_pbData, DRM_DWORD f_cbData);
+
+#define SAFE_OEM_FREE(p) do { if ((p) != NULL) { Oem_MemFree((DRM_VOID*)(p)); (p) = NULL; } } while (0)
+
+// Utilities
+DRM_RESULT DRM_B64_EncodeA(const DRM_BYTE* f_pvInput, DRM_DWORD f_cbInput, DRM_CHAR* f_pchEncoded,
+    DRM_DWORD* f_pcchEncoded, DRM_DWORD f_dwFlags);
+DRM_RESULT DRM_B64_EncodeW(const DRM_BYTE* f_pvInput, DRM_DWORD f_cbInput, DRM_WCHAR* f_pwchEncoded,
+    DRM_DWORD* f_pcchEncoded, DRM_DWORD f_dwFlags);
+DRM_VOID DRM_UTL_DemoteUNICODEtoASCII(const DRM_WCHAR* f_pwszFrom, DRM_CHAR* f_pszTo, DRM_DWORD f_cchMax);
+DRM_VOID PackedCharsToNative(DRM_CHAR* f_pPackedString, DRM_DWORD f_cch);
+
+// Platform and app context
+DRM_RESULT Drm_Platform_Initialize(DRM_VOID* f_pPlatformInitData);
+DRM_RESULT Drm_Platform_Uninitialize(DRM_VOID* f_pPlatformInitData);
+DRM_RESULT Drm_Initialize(DRM_APP_CONTEXT* f_poAppContext, DRM_VOID* f_pOEMContext, DRM_BYTE* f_pbOpaqueBuffer,
+    DRM_DWORD f_cbOpaqueBuffer, const DRM_CONST_STRING* f_pdstrDeviceStoreName);
+DRM_VOID Drm_Uninitialize(DRM_APP_CONTEXT* f_poAppContext);
+DRM_RESULT Drm_Reinitialize(DRM_APP_CONTEXT* f_poAppContext);
+DRM_RESULT Drm_ResizeOpaqueBuffer(DRM_APP_CONTEXT* f_poAppContext, DRM_BYTE* f_pbOpaqueBuffer, DRM_DWORD f_cbOpaqueBuffer);
+DRM_RESULT Drm_ResizeInMemoryLicenseStore(DRM_APP_CONTEXT* f_poAppContext, DRM_DWORD f_cbLicenseStore);
+
+// Content
+DRM_RESULT Drm_Content_SetProperty(DRM_APP_CONTEXT* f_poAppContext, DRM_CONTENT_SET_PROPERTY f_eProperty,
+    const DRM_BYTE* f_pbPropertyData, DRM_DWORD f_cbPropertyData);
+
+// License acquisition
+DRM_RESULT Drm_LicenseAcq_GenerateChallenge(DRM_APP_CONTEXT* f_poAppContext, const DRM_CONST_STRING** f_rgpdstrRights,
+    DRM_DWORD f_cRights, const DRM_DOMAIN_ID* f_poDomainID, const DRM_CHAR* f_pchCustomData, DRM_DWORD f_cchCustomData,
+    DRM_CHAR* f_pchSilentURL, DRM_DWORD* f_pcchSilentURL, DRM_CHAR* f_pchNonSilentURL, DRM_DWORD* f_pcchNonSilentURL,
+    DRM_BYTE* f_pbChallenge, DRM_DWORD* f_pcbChallenge, DRM_ID* f_pLicenseNonce);
+DRM_RESULT Drm_LicenseAcq_ProcessResponse(DRM_APP_CONTEXT* f_poAppContext, DRM_PROCESS_LIC_RESPONSE_FLAG f_dwFlags,
+    const DRM_BYTE* f_pbResponse, DRM_DWORD f_cbResponse, DRM_LICENSE_RESPONSE* f_poLicenseResponse);
+
+// Reader
+DRM_RESULT Drm_Reader_Bind(DRM_APP_CONTEXT* f_poAppContext, const DRM_CONST_STRING** f_rgpdstrRights,
+    DRM_DWORD f_cRights, DRMPFNPOLICYCALLBACK f_pfnPolicyCallback, const DRM_VOID* f_pv,
+    DRM_DECRYPT_CONTEXT* f_pcontextDCRY);
+DRM_RESULT Drm_Reader_Commit(DRM_APP_CONTEXT* f_poAppContext, DRMPFNPOLICYCALLBACK f_pfnPolicyCallback,
+    const DRM_VOID* f_pvPolicyCallbackData);
+DRM_VOID Drm_Reader_Close(DRM_DECRYPT_CONTEXT* f_pDecryptContext);
+DRM_RESULT Drm_Reader_DecryptOpaque(DRM_DECRYPT_CONTEXT* f_pDecryptContext, DRM_DWORD f_cEncryptedRegionMappings,
+    const DRM_DWORD* f_pdwEncryptedRegionMappings, DRM_UINT64 f_ui64Initializer, DRM_DWORD f_cbEncryptedContent,
+    const DRM_BYTE* f_pbEncryptedContent, DRM_DWORD* f_pcbOpaqueClearContent, DRM_BYTE** f_ppbOpaqueClearContent);
+
+// Store management
+DRM_RESULT Drm_StoreMgmt_CleanupStore(DRM_APP_CONTEXT* f_poAppContext, DRM_DWORD f_dwFlags, const DRM_VOID* f_pvCallerData,
+    DRM_DWORD f_dwCallbackInterval, DRM_STORE_CLEANUP_CALLBACK f_pfnCallback);
+DRM_RESULT Drm_StoreMgmt_DeleteInMemoryLicenses(DRM_APP_CONTEXT* f_poAppContext, const DRM_ID* f_pidBatch);
+DRM_RESULT Drm_StoreMgmt_DeleteLicenses(DRM_APP_CONTEXT* f_poAppContext, const DRM_CONST_STRING* f_pdcstrKID,
+    DRM_DWORD* f_pcLicDeleted);
+
+// Revocation
+DRM_BOOL DRM_REVOCATION_IsRevocationSupported(DRM_VOID);
+DRM_RESULT Drm_Revocation_SetBuffer(DRM_APP_CONTEXT* f_poAppContext, DRM_BYTE* f_pbRevocationBuffer,
+    DRM_DWORD f_cbRevocationBuffer);
+DRM_RESULT Drm_Revocation_StorePackage(DRM_APP_CONTEXT* f_poAppContext, const DRM_CHAR* f_pbRevPackage,
+    DRM_DWORD f_cbRevPackage);
+
+// Secure time
+DRM_RESULT Drm_SecureTime_GetValue(DRM_APP_CONTEXT* f_poAppContext, DRMFILETIME* f_pftSystemTime,
+    DRM_SECURETIME_CLOCK_TYPE* f_peClockType);
+DRM_RESULT Drm_SecureTime_GenerateChallenge(DRM_APP_CONTEXT* f_poAppContext, DRM_DWORD* f_pcbChallenge,
+    DRM_BYTE** f_ppbChallenge);
+DRM_RESULT Drm_SecureTime_ProcessResponse(DRM_APP_CONTEXT* f_poAppContext, DRM_DWORD f_cbResponse,
+    const DRM_BYTE* f_pbResponse);
+DRM_RESULT Drm_AntiRollBackClock_Init(DRM_APP_CONTEXT* f_poAppContext, const DRMSYSTEMTIME* f_pSystemTime);
+
+// Secure stop
+DRM_RESULT Drm_SecureStop_EnumerateSessions(DRM_APP_CONTEXT* f_poAppContext, DRM_DWORD f_cbPublisherCertificate,
+    const DRM_BYTE* f_pbPublisherCertificate, DRM_DWORD* f_pcSessionIDs, DRM_ID** f_ppSessionIDs);
+DRM_RESULT Drm_SecureStop_GenerateChallenge(DRM_APP_CONTEXT* f_poAppContext, const DRM_ID* f_pidSession,
+    DRM_DWORD f_cbPublisherCertificate, const DRM_BYTE* f_pbPublisherCertificate, DRM_DWORD f_cchCustomData,
+    const DRM_CHAR* f_pchCustomData, DRM_DWORD* f_pcbChallenge, DRM_BYTE** f_ppbChallenge);
+DRM_RESULT Drm_SecureStop_ProcessResponse(DRM_APP_CONTEXT* f_poAppContext, const DRM_ID* f_pidSession,
+    DRM_DWORD f_cbPublisherCertificate, const DRM_BYTE* f_pbPublisherCertificate, DRM_DWORD f_cbResponse,
+    const DRM_BYTE* f_pbResponse, DRM_DWORD* f_pcbCustomData, DRM_CHAR** f_ppchCustomData);
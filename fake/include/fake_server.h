@@ -0,0 +1,114 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Host-side helpers around the fake backend: the local license, secure-stop
+// and secure-time server, content packaging helpers and the knobs that model
+// TEE and network cost. Only the benchmarks and harnesses use this header; the
+// plugin sources never include it.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <array>
+#include <string>
+#include <vector>
+
+namespace FakePlayReady {
+
+typedef std::array<uint8_t, 16> KeyId;
+
+struct Settings {
+    Settings()
+        : teeLatencyUs(0)
+        , storeCommitLatencyUs(0)
+        , licenseServerLatencyMs(0)
+        , timeServerLatencyMs(0)
+        , platformLatencyMs(0)
+        , secureClockPreset(false)
+    {
+    }
+
+    uint32_t teeLatencyUs;          // added to every challenge, bind and secure-stop signature
+    uint32_t storeCommitLatencyUs;  // added to every store write, models flash latency
+    uint32_t licenseServerLatencyMs;
+    uint32_t timeServerLatencyMs;
+    uint32_t platformLatencyMs;     // added to joining Nexus, models the platform start
+    bool secureClockPreset;         // report the secure clock as already set
+};
+
+struct Statistics {
+    uint64_t licenseChallenges;
+    uint64_t challengeSizingCalls;
+    uint64_t licenseResponses;
+    uint64_t binds;
+    uint64_t commits;
+    uint64_t storeWrites;
+    uint64_t decrypts;
+    uint64_t nonceEvictions;
+    uint64_t opaqueBufferResizes;
+    uint64_t inMemoryStoreGrowths;
+    uint64_t secureStopChallenges;
+    uint64_t secureTimeRequests;
+    uint64_t revocationPackagesStored;
+    uint32_t openDecryptContexts;
+};
+
+// Settings are read from FAKE_PLAYREADY_* environment variables on first use;
+// Configure() overrides them.
+void Configure(const Settings& settings);
+Settings Configuration();
+Statistics GetStatistics();
+void ResetStatistics();
+
+// Porting kit calls that take noticeable time (challenge generation, license
+// processing, bind, commit, decrypt, header selection), timed while tracing
+// is enabled. Times are CLOCK_MONOTONIC in nanoseconds, so they line up with
+// the caller's own. TraceEvents() hands out the events recorded so far and
+// clears them.
+struct TraceEvent {
+    const char* function;
+    uint64_t thread;
+    uint64_t begin;
+    uint64_t end;
+};
+
+void EnableTrace(bool enable);
+std::vector<TraceEvent> TraceEvents();
+
+// Key IDs are given in the standard (big-endian UUID) byte order.
+void ContentKey(const KeyId& keyId, uint8_t key[16]);
+std::vector<uint8_t> BuildHeader(const std::vector<KeyId>& keyIds);
+std::vector<uint8_t> BuildPssh(const std::vector<KeyId>& keyIds, bool version1);
+
+// Encrypts in place with AES-128-CTR the way a CENC packager does, honouring
+// the (clear, encrypted) subsample pairs when any are given.
+void EncryptSample(const KeyId& keyId, uint64_t iv, const std::vector<uint32_t>& subsamples,
+    uint8_t* data, size_t size);
+
+// License server. The response carries one license per key ID found in the
+// challenge (or given explicitly) and can mark the licenses persistent.
+std::vector<uint8_t> LicenseResponse(const uint8_t* challenge, size_t challengeSize, bool persistent = false);
+std::vector<uint8_t> LicenseResponse(const std::vector<KeyId>& keyIds, bool persistent = false);
+std::vector<KeyId> ChallengeKeyIds(const uint8_t* challenge, size_t challengeSize);
+
+// Secure-stop server: acknowledges the session named in the challenge.
+std::vector<uint8_t> SecureStopResponse(const uint8_t* challenge, size_t challengeSize);
+
+} // namespace FakePlayReady
@@ -0,0 +1,30 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+// Host stand-in for the Broadcom prdy_http client. Requests are answered by
+// the in-process fake time server (see fake_server.h).
+
+int32_t PRDY_HTTP_Client_GetForwardLinkUrl(char* pUrl, uint32_t* pHttpRespCode, char** ppOutUrl);
+int32_t PRDY_HTTP_Client_GetSecureTimeUrl(char* pUrl, uint32_t* pHttpRespCode, char** ppOutUrl);
+uint32_t PRDY_HTTP_Client_SecureTimeChallengePost(char* pUrl, char* pChallenge, unsigned char fNonQuiet,
+    uint32_t timeoutSeconds, unsigned char** ppResponse, uint32_t* pStartOffset, uint32_t* pLength);
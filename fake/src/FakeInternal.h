@@ -0,0 +1,93 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "fake_playready.h"
+#include "fake_server.h"
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+namespace FakePlayReady {
+
+// License response wire format used between the fake server and the fake
+// client:
+//   "FPRL" | version (1) | flags (1) | reserved (2) | count (4, LE) | nonce (16)
+//   count * { kid (16, PlayReady order) | key (16) | expiry (8, LE, 0 = none) }
+static const char LicenseMagic[] = "FPRL";
+static const uint8_t LicenseFlagPersistent = 0x01;
+static const size_t LicenseHeaderSize = 4 + 1 + 1 + 2 + 4 + 16;
+static const size_t LicenseEntrySize = 16 + 16 + 8;
+
+static const char SecureStopAckPrefix[] = "FAKESECURESTOPACK:";
+static const char SecureTimeResponsePrefix[] = "FAKESECURETIME:";
+
+struct Counters {
+    std::atomic<uint64_t> licenseChallenges;
+    std::atomic<uint64_t> challengeSizingCalls;
+    std::atomic<uint64_t> licenseResponses;
+    std::atomic<uint64_t> binds;
+    std::atomic<uint64_t> commits;
+    std::atomic<uint64_t> storeWrites;
+    std::atomic<uint64_t> decrypts;
+    std::atomic<uint64_t> nonceEvictions;
+    std::atomic<uint64_t> opaqueBufferResizes;
+    std::atomic<uint64_t> inMemoryStoreGrowths;
+    std::atomic<uint64_t> secureStopChallenges;
+    std::atomic<uint64_t> secureTimeRequests;
+    std::atomic<uint64_t> revocationPackagesStored;
+    std::atomic<uint32_t> openDecryptContexts;
+};
+
+Counters& Stats();
+
+// Records the porting kit call it is placed in, while tracing is enabled.
+class TraceScope {
+public:
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+    explicit TraceScope(const char* function);
+    ~TraceScope();
+
+private:
+    const char* _function;
+    uint64_t _begin;
+};
+
+const Settings& CurrentSettings();
+uint32_t TakeTimeServerFailure();
+
+void SleepMicroseconds(uint64_t us);
+void ToggleKeyId(uint8_t keyId[16]);
+
+std::string Base64Encode(const uint8_t* data, size_t length);
+bool Base64Decode(const std::string& text, std::vector<uint8_t>& out);
+
+// Collects all KIDs from a PlayReady object, WRM header or PSSH box. The
+// header is UTF-16; zero bytes are dropped so both encodings parse the same.
+// KIDs are returned in PlayReady byte order.
+std::vector<KeyId> HeaderKeyIds(const uint8_t* header, size_t size);
+
+// Extracts the text between <tag> and </tag>, starting at offset.
+bool ExtractElement(const std::string& text, const std::string& tag, size_t& offset, std::string& value);
+
+} // namespace FakePlayReady
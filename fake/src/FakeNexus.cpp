@@ -0,0 +1,241 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FakeInternal.h"
+#include "fake_nexus.h"
+
+#include <stdlib.h>
+#include <new>
+#include <mutex>
+#include <map>
+
+namespace {
+
+struct Heap {
+    NEXUS_MemoryType type;
+};
+
+Heap g_fullHeap = { NEXUS_MemoryType_eFull };
+Heap g_secureHeap = { NEXUS_MemoryType_eSecure };
+
+struct Accounting {
+    std::mutex lock;
+    std::map<void*, size_t> allocations;
+    FakeNexus_HeapUsage usage;
+
+    Accounting()
+        : lock()
+        , allocations()
+        , usage()
+    {
+    }
+
+    void* Allocate(size_t size)
+    {
+        void* memory = malloc(size > 0 ? size : 1);
+        if (memory != nullptr) {
+            std::lock_guard<std::mutex> guard(lock);
+            allocations[memory] = size;
+            usage.currentBytes += size;
+            usage.liveBlocks++;
+            usage.totalAllocations++;
+            if (usage.currentBytes > usage.peakBytes) {
+                usage.peakBytes = usage.currentBytes;
+            }
+        }
+        return memory;
+    }
+
+    void Free(void* memory)
+    {
+        if (memory != nullptr) {
+            std::lock_guard<std::mutex> guard(lock);
+            std::map<void*, size_t>::iterator index = allocations.find(memory);
+            if (index != allocations.end()) {
+                usage.currentBytes -= index->second;
+                usage.liveBlocks--;
+                allocations.erase(index);
+            }
+        }
+        free(memory);
+    }
+};
+
+Accounting& Heaps()
+{
+    static Accounting accounting;
+    return accounting;
+}
+
+} // namespace
+
+struct NEXUS_MemoryBlock {
+    void* memory;
+    size_t size;
+    unsigned locks;
+};
+
+void NEXUS_Memory_GetDefaultAllocationSettings(NEXUS_MemoryAllocationSettings* pSettings)
+{
+    memset(pSettings, 0, sizeof(*pSettings));
+}
+
+NEXUS_Error NEXUS_Memory_Allocate(size_t numBytes, const NEXUS_MemoryAllocationSettings*, void** ppMemory)
+{
+    *ppMemory = Heaps().Allocate(numBytes);
+    return (*ppMemory != nullptr) ? NEXUS_SUCCESS : NEXUS_OUT_OF_SYSTEM_MEMORY;
+}
+
+void NEXUS_Memory_Free(void* pMemory)
+{
+    Heaps().Free(pMemory);
+}
+
+NEXUS_HeapHandle NEXUS_Heap_Lookup(NEXUS_HeapLookupType lookupType)
+{
+    return reinterpret_cast<NEXUS_HeapHandle>(lookupType == NEXUS_HeapLookupType_eCompressedRegion ? &g_secureHeap : &g_fullHeap);
+}
+
+NEXUS_Error NEXUS_Heap_GetStatus(NEXUS_HeapHandle heap, NEXUS_MemoryStatus* pStatus)
+{
+    if ((heap == nullptr) || (pStatus == nullptr)) {
+        return NEXUS_INVALID_PARAMETER;
+    }
+    FakeNexus_HeapUsage usage;
+    FakeNexus_GetHeapUsage(&usage);
+
+    memset(pStatus, 0, sizeof(*pStatus));
+    pStatus->memoryType = reinterpret_cast<const Heap*>(heap)->type;
+    pStatus->size = 256 * 1024 * 1024;
+    pStatus->free = (usage.currentBytes < pStatus->size) ? (pStatus->size - usage.currentBytes) : 0;
+    pStatus->highWatermark = usage.peakBytes;
+    pStatus->numAllocs = static_cast<unsigned>(usage.liveBlocks);
+    return NEXUS_SUCCESS;
+}
+
+NEXUS_MemoryBlockHandle NEXUS_MemoryBlock_Allocate(NEXUS_HeapHandle, size_t numBytes, size_t,
+    const NEXUS_MemoryBlockAllocationSettings*)
+{
+    NEXUS_MemoryBlockHandle block = new (std::nothrow) NEXUS_MemoryBlock;
+    if (block != nullptr) {
+        block->memory = Heaps().Allocate(numBytes);
+        block->size = numBytes;
+        block->locks = 0;
+        if (block->memory == nullptr) {
+            delete block;
+            block = nullptr;
+        }
+    }
+    return block;
+}
+
+void NEXUS_MemoryBlock_Free(NEXUS_MemoryBlockHandle memoryBlock)
+{
+    if (memoryBlock != nullptr) {
+        Heaps().Free(memoryBlock->memory);
+        delete memoryBlock;
+    }
+}
+
+NEXUS_Error NEXUS_MemoryBlock_Lock(NEXUS_MemoryBlockHandle memoryBlock, void** ppMemory)
+{
+    if (memoryBlock == nullptr) {
+        return NEXUS_INVALID_PARAMETER;
+    }
+    memoryBlock->locks++;
+    *ppMemory = memoryBlock->memory;
+    return NEXUS_SUCCESS;
+}
+
+void NEXUS_MemoryBlock_Unlock(NEXUS_MemoryBlockHandle memoryBlock)
+{
+    if ((memoryBlock != nullptr) && (memoryBlock->locks > 0)) {
+        memoryBlock->locks--;
+    }
+}
+
+NEXUS_MemoryBlockTokenHandle NEXUS_MemoryBlock_CreateToken(NEXUS_MemoryBlockHandle memoryBlock)
+{
+    // There is no second process to hand the block to, the block itself is the token.
+    return reinterpret_cast<NEXUS_MemoryBlockTokenHandle>(memoryBlock);
+}
+
+void NEXUS_Platform_GetClientConfiguration(NEXUS_ClientConfiguration* pConfig)
+{
+    memset(pConfig, 0, sizeof(*pConfig));
+    pConfig->heap[NXCLIENT_FULL_HEAP] = reinterpret_cast<NEXUS_HeapHandle>(&g_fullHeap);
+}
+
+void NxClient_GetDefaultJoinSettings(NxClient_JoinSettings* pSettings)
+{
+    memset(pSettings, 0, sizeof(*pSettings));
+}
+
+NEXUS_Error NxClient_Join(const NxClient_JoinSettings*)
+{
+    FakePlayReady::SleepMicroseconds(static_cast<uint64_t>(FakePlayReady::CurrentSettings().platformLatencyMs) * 1000);
+    return NEXUS_SUCCESS;
+}
+
+void NxClient_Uninit(void)
+{
+}
+
+void NxClient_GetDefaultAllocSettings(NxClient_AllocSettings* pSettings)
+{
+    memset(pSettings, 0, sizeof(*pSettings));
+}
+
+NEXUS_Error NxClient_Alloc(const NxClient_AllocSettings*, NxClient_AllocResults* pResults)
+{
+    memset(pResults, 0, sizeof(*pResults));
+    pResults->allocated = 1;
+    return NEXUS_SUCCESS;
+}
+
+void NxClient_Free(const NxClient_AllocResults*)
+{
+}
+
+void* BKNI_Malloc(size_t size)
+{
+    return malloc(size);
+}
+
+void BKNI_Free(void* mem)
+{
+    free(mem);
+}
+
+void* BKNI_Memset(void* mem, int ch, size_t n)
+{
+    return memset(mem, ch, n);
+}
+
+void* BKNI_Memcpy(void* dst, const void* src, size_t n)
+{
+    return memcpy(dst, src, n);
+}
+
+void FakeNexus_GetHeapUsage(FakeNexus_HeapUsage* pUsage)
+{
+    Accounting& heaps = Heaps();
+    std::lock_guard<std::mutex> guard(heaps.lock);
+    *pUsage = heaps.usage;
+}
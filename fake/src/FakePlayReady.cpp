@@ -0,0 +1,1041 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FakeInternal.h"
+
+#include <openssl/evp.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/time.h>
+#include <algorithm>
+#include <deque>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace FakePlayReady;
+
+namespace {
+
+static const char StoreMagic[] = "FKHDS1";
+static const DRM_DWORD NonceStoreSize = 100;
+static const DRM_DWORD InMemoryLicenseBytes = 512;
+static const DRM_DWORD LicensesPerOpaqueBuffer = 32;
+static const char SilentUrl[] = "http://localhost/rightsmanager.asmx";
+
+struct License {
+    KeyId keyId;        // PlayReady byte order
+    DRM_ID licenseId;
+    DRM_ID batchId;
+    uint8_t key[16];
+    uint64_t expiry;
+    bool persistent;
+};
+
+// File-backed model of the HDS: persistent licenses, pending secure stops and
+// the secure clock state. Every Save() rewrites the whole file.
+struct Store {
+    std::string path;
+    bool secureTimeSet;
+    std::vector<License> licenses;
+    std::vector<DRM_ID> secureStops;
+
+    Store()
+        : path()
+        , secureTimeSet(false)
+        , licenses()
+        , secureStops()
+    {
+    }
+
+    bool Load()
+    {
+        licenses.clear();
+        secureStops.clear();
+        secureTimeSet = false;
+
+        FILE* file = fopen(path.c_str(), "rb");
+        if (file == nullptr) {
+            return false;
+        }
+
+        char magic[sizeof(StoreMagic)] = { 0 };
+        uint8_t flag = 0;
+        uint32_t count = 0;
+        bool valid = (fread(magic, 1, sizeof(magic) - 1, file) == sizeof(magic) - 1) && (memcmp(magic, StoreMagic, sizeof(magic) - 1) == 0)
+            && (fread(&flag, 1, 1, file) == 1) && (fread(&count, sizeof(count), 1, file) == 1);
+        secureTimeSet = valid && (flag != 0);
+        for (uint32_t i = 0; valid && (i < count); ++i) {
+            License license;
+            uint8_t persistent = 0;
+            valid = (fread(license.keyId.data(), 16, 1, file) == 1) && (fread(license.licenseId.rgb, 16, 1, file) == 1)
+                && (fread(license.batchId.rgb, 16, 1, file) == 1) && (fread(license.key, 16, 1, file) == 1)
+                && (fread(&license.expiry, sizeof(license.expiry), 1, file) == 1) && (fread(&persistent, 1, 1, file) == 1);
+            license.persistent = (persistent != 0);
+            if (valid) {
+                licenses.push_back(license);
+            }
+        }
+        valid = valid && (fread(&count, sizeof(count), 1, file) == 1);
+        for (uint32_t i = 0; valid && (i < count); ++i) {
+            DRM_ID id;
+            valid = (fread(id.rgb, 16, 1, file) == 1);
+            if (valid) {
+                secureStops.push_back(id);
+            }
+        }
+        fclose(file);
+        return valid;
+    }
+
+    bool Save()
+    {
+        FILE* file = fopen(path.c_str(), "wb");
+        if (file == nullptr) {
+            return false;
+        }
+        const uint8_t flag = secureTimeSet ? 1 : 0;
+        uint32_t count = static_cast<uint32_t>(licenses.size());
+        fwrite(StoreMagic, 1, sizeof(StoreMagic) - 1, file);
+        fwrite(&flag, 1, 1, file);
+        fwrite(&count, sizeof(count), 1, file);
+        for (size_t i = 0; i < licenses.size(); ++i) {
+            const License& license = licenses[i];
+            const uint8_t persistent = license.persistent ? 1 : 0;
+            fwrite(license.keyId.data(), 16, 1, file);
+            fwrite(license.licenseId.rgb, 16, 1, file);
+            fwrite(license.batchId.rgb, 16, 1, file);
+            fwrite(license.key, 16, 1, file);
+            fwrite(&license.expiry, sizeof(license.expiry), 1, file);
+            fwrite(&persistent, 1, 1, file);
+        }
+        count = static_cast<uint32_t>(secureStops.size());
+        fwrite(&count, sizeof(count), 1, file);
+        for (size_t i = 0; i < secureStops.size(); ++i) {
+            fwrite(secureStops[i].rgb, 16, 1, file);
+        }
+        const bool written = (fflush(file) == 0);
+        fclose(file);
+
+        Stats().storeWrites++;
+        SleepMicroseconds(CurrentSettings().storeCommitLatencyUs);
+        return written;
+    }
+};
+
+struct AppState {
+    DRM_VOID* oemContext;
+    DRM_BYTE* opaqueBuffer;
+    DRM_DWORD opaqueBufferSize;
+    DRM_DWORD inMemoryCapacity;
+    DRM_DWORD decryptionMode;
+    std::vector<KeyId> headerKeyIds;
+    bool headerSet;
+    KeyId selectedKeyId;
+    bool keyIdSelected;
+    // Drm_Reader_Commit acts on the last bind, whichever context it was for.
+    KeyId boundKeyId;
+    bool keyIdBound;
+    std::vector<License> inMemory;
+    std::deque<DRM_ID> nonces;
+    Store store;
+    bool dirty;
+    DRM_BYTE* revocationBuffer;
+
+    AppState()
+        : oemContext(nullptr)
+        , opaqueBuffer(nullptr)
+        , opaqueBufferSize(0)
+        , inMemoryCapacity(0)
+        , decryptionMode(OEM_TEE_DECRYPTION_MODE_NOT_SECURE)
+        , headerKeyIds()
+        , headerSet(false)
+        , selectedKeyId()
+        , keyIdSelected(false)
+        , boundKeyId()
+        , keyIdBound(false)
+        , inMemory()
+        , nonces()
+        , store()
+        , dirty(false)
+        , revocationBuffer(nullptr)
+    {
+    }
+
+    const License* Find(const KeyId& keyId) const
+    {
+        for (size_t i = 0; i < inMemory.size(); ++i) {
+            if (inMemory[i].keyId == keyId) {
+                return &inMemory[i];
+            }
+        }
+        for (size_t i = 0; i < store.licenses.size(); ++i) {
+            if (store.licenses[i].keyId == keyId) {
+                return &store.licenses[i];
+            }
+        }
+        return nullptr;
+    }
+};
+
+struct DecryptState {
+    KeyId keyId;
+    uint8_t key[16];
+    EVP_CIPHER_CTX* cipher;
+};
+
+AppState* State(DRM_APP_CONTEXT* context)
+{
+    return (context != nullptr) ? static_cast<AppState*>(context->pvInternal) : nullptr;
+}
+
+std::mt19937_64& RandomEngine()
+{
+    static thread_local std::mt19937_64 engine(std::random_device {}());
+    return engine;
+}
+
+void RandomId(DRM_ID& id)
+{
+    for (size_t i = 0; i < sizeof(id.rgb); i += 8) {
+        const uint64_t value = RandomEngine()();
+        memcpy(&id.rgb[i], &value, 8);
+    }
+}
+
+std::string Narrow(const DRM_WCHAR* text, DRM_DWORD length)
+{
+    std::string result;
+    for (DRM_DWORD i = 0; (i < length) && (text[i] != 0); ++i) {
+        result += static_cast<char>(text[i] & 0xFF);
+    }
+    return result;
+}
+
+uint32_t ReadLittleEndian32(const DRM_BYTE* data)
+{
+    return data[0] | (data[1] << 8) | (data[2] << 16) | (static_cast<uint32_t>(data[3]) << 24);
+}
+
+uint64_t ReadLittleEndian64(const DRM_BYTE* data)
+{
+    return ReadLittleEndian32(data) | (static_cast<uint64_t>(ReadLittleEndian32(data + 4)) << 32);
+}
+
+std::string LicenseChallenge(const AppState& state, const DRM_ID& nonce, const DRM_CHAR* customData, DRM_DWORD customDataSize)
+{
+    std::string challenge = "<AcquireLicense><LicenseRequest><ContentHeader>";
+    for (size_t i = 0; i < state.headerKeyIds.size(); ++i) {
+        challenge += "<KID>" + Base64Encode(state.headerKeyIds[i].data(), 16) + "</KID>";
+    }
+    challenge += "</ContentHeader><Nonce>" + Base64Encode(nonce.rgb, sizeof(nonce.rgb)) + "</Nonce>";
+    if ((customData != nullptr) && (customDataSize > 0)) {
+        challenge += "<CustomData>" + std::string(customData, customDataSize) + "</CustomData>";
+    }
+    // A real challenge carries the device certificate chain, which makes up
+    // most of its size.
+    challenge += "<CertificateChain>" + std::string(3000, 'C') + "</CertificateChain>";
+    challenge += "</LicenseRequest></AcquireLicense>";
+    return challenge;
+}
+
+void AnnounceOutputProtection(DRMPFNPOLICYCALLBACK callback, const DRM_VOID* data, const License& license)
+{
+    if (callback == nullptr) {
+        return;
+    }
+
+    DRM_OUTPUT_PROTECTION_EX maxResDecode;
+    ZEROMEM(&maxResDecode, sizeof(maxResDecode));
+    maxResDecode.dwVersion = 3;
+    maxResDecode.guidId = g_guidMaxResDecode;
+    maxResDecode.cbConfigData = 8;
+    const uint32_t width = 3840;
+    const uint32_t height = 2160;
+    for (int i = 0; i < 4; ++i) {
+        maxResDecode.rgbConfigData[i] = static_cast<DRM_BYTE>(width >> (24 - 8 * i));
+        maxResDecode.rgbConfigData[4 + i] = static_cast<DRM_BYTE>(height >> (24 - 8 * i));
+    }
+
+    DRM_PLAY_OPL_EX2 opl;
+    ZEROMEM(&opl, sizeof(opl));
+    opl.dwVersion = 0;
+    opl.minOPL.wCompressedDigitalVideo = 400;
+    opl.minOPL.wUncompressedDigitalVideo = 300;
+    opl.minOPL.wAnalogVideo = 150;
+    opl.minOPL.wCompressedDigitalAudio = 300;
+    opl.minOPL.wUncompressedDigitalAudio = 300;
+    opl.dvopi.cEntries = 1;
+    opl.dvopi.rgVop = &maxResDecode;
+
+    DRM_KID keyId;
+    std::copy(license.keyId.begin(), license.keyId.end(), keyId.rgb);
+    callback(&opl, DRM_PLAY_OPL_CALLBACK, &keyId, &license.licenseId, data);
+}
+
+} // namespace
+
+// Constant data
+static const DRM_WCHAR g_rgwchPlayback[] = { 'P', 'l', 'a', 'y', 0 };
+static const DRM_WCHAR g_rgwchVersion[] = { '3', '.', '0', '.', '0', '.', '0', '0', '0', '0', 0 };
+
+const DRM_CONST_STRING g_dstrWMDRM_RIGHT_PLAYBACK = { g_rgwchPlayback, 4 };
+DRM_CONST_STRING g_dstrDrmPath = DRM_EMPTY_DRM_STRING;
+const DRM_CONST_STRING g_dstrReqTagPlayReadyClientVersionData = { g_rgwchVersion, 10 };
+const DRM_ANSI_CONST_STRING g_dstrHttpSecureTimeServerUrl = { "http://localhost/fake-securetime/fwlink", 39 };
+const DRM_GUID g_guidMaxResDecode = { { 0x9d, 0x0d, 0x1c, 0x44, 0x32, 0x5e, 0x4c, 0xf4, 0xad, 0xe0, 0x7e, 0x5c, 0x66, 0x05, 0x83, 0x5a } };
+
+// OEM
+DRM_VOID* Oem_MemAlloc(DRM_DWORD f_cbSize)
+{
+    return malloc(f_cbSize > 0 ? f_cbSize : 1);
+}
+
+DRM_VOID Oem_MemFree(DRM_VOID* f_pv)
+{
+    free(f_pv);
+}
+
+DRM_RESULT Oem_Random_GetBytes(DRM_VOID*, DRM_BYTE* f_pbData, DRM_DWORD f_cbData)
+{
+    for (DRM_DWORD i = 0; i < f_cbData; ++i) {
+        f_pbData[i] = static_cast<DRM_BYTE>(RandomEngine()());
+    }
+    return DRM_SUCCESS;
+}
+
+// Utilities
+DRM_RESULT DRM_B64_EncodeA(const DRM_BYTE* f_pvInput, DRM_DWORD f_cbInput, DRM_CHAR* f_pchEncoded,
+    DRM_DWORD* f_pcchEncoded, DRM_DWORD)
+{
+    const std::string encoded = Base64Encode(f_pvInput, f_cbInput);
+    if ((f_pchEncoded == nullptr) || (*f_pcchEncoded < encoded.size())) {
+        *f_pcchEncoded = static_cast<DRM_DWORD>(encoded.size());
+        return DRM_E_BUFFERTOOSMALL;
+    }
+    memcpy(f_pchEncoded, encoded.data(), encoded.size());
+    *f_pcchEncoded = static_cast<DRM_DWORD>(encoded.size());
+    return DRM_SUCCESS;
+}
+
+DRM_RESULT DRM_B64_EncodeW(const DRM_BYTE* f_pvInput, DRM_DWORD f_cbInput, DRM_WCHAR* f_pwchEncoded,
+    DRM_DWORD* f_pcchEncoded, DRM_DWORD)
+{
+    const std::string encoded = Base64Encode(f_pvInput, f_cbInput);
+    if ((f_pwchEncoded == nullptr) || (*f_pcchEncoded < encoded.size())) {
+        *f_pcchEncoded = static_cast<DRM_DWORD>(encoded.size());
+        return DRM_E_BUFFERTOOSMALL;
+    }
+    for (size_t i = 0; i < encoded.size(); ++i) {
+        f_pwchEncoded[i] = static_cast<DRM_WCHAR>(encoded[i]);
+    }
+    *f_pcchEncoded = static_cast<DRM_DWORD>(encoded.size());
+    return DRM_SUCCESS;
+}
+
+DRM_VOID DRM_UTL_DemoteUNICODEtoASCII(const DRM_WCHAR* f_pwszFrom, DRM_CHAR* f_pszTo, DRM_DWORD f_cchMax)
+{
+    DRM_DWORD i = 0;
+    for (; (i + 1 < f_cchMax) && (f_pwszFrom[i] != 0); ++i) {
+        f_pszTo[i] = static_cast<DRM_CHAR>(f_pwszFrom[i] & 0xFF);
+    }
+    if (f_cchMax > 0) {
+        f_pszTo[i] = 0;
+    }
+}
+
+DRM_VOID PackedCharsToNative(DRM_CHAR*, DRM_DWORD)
+{
+    // Characters are never packed on the host.
+}
+
+// Platform and app context
+DRM_RESULT Drm_Platform_Initialize(DRM_VOID* f_pPlatformInitData)
+{
+    static int oemContext;
+    OEM_Settings* settings = static_cast<OEM_Settings*>(f_pPlatformInitData);
+    if (settings == nullptr) {
+        return DRM_E_INVALIDARG;
+    }
+    settings->f_pOEMContext = &oemContext;
+    return DRM_SUCCESS;
+}
+
+DRM_RESULT Drm_Platform_Uninitialize(DRM_VOID*)
+{
+    return DRM_SUCCESS;
+}
+
+DRM_RESULT Drm_Initialize(DRM_APP_CONTEXT* f_poAppContext, DRM_VOID* f_pOEMContext, DRM_BYTE* f_pbOpaqueBuffer,
+    DRM_DWORD f_cbOpaqueBuffer, const DRM_CONST_STRING* f_pdstrDeviceStoreName)
+{
+    if ((f_poAppContext == nullptr) || (f_pbOpaqueBuffer == nullptr) || (f_pdstrDeviceStoreName == nullptr)
+        || (f_cbOpaqueBuffer < MINIMUM_APPCONTEXT_OPAQUE_BUFFER_SIZE)) {
+        return DRM_E_INVALIDARG;
+    }
+
+    AppState* state = new AppState;
+    state->oemContext = f_pOEMContext;
+    state->opaqueBuffer = f_pbOpaqueBuffer;
+    state->opaqueBufferSize = f_cbOpaqueBuffer;
+    state->inMemoryCapacity = 64 * InMemoryLicenseBytes;
+    state->store.path = Narrow(f_pdstrDeviceStoreName->pwszString, f_pdstrDeviceStoreName->cchString);
+    if ((state->store.Load() == false) && (state->store.Save() == false)) {
+        delete state;
+        return DRM_E_FILENOTFOUND;
+    }
+    f_poAppContext->pvInternal = state;
+    return DRM_SUCCESS;
+}
+
+DRM_VOID Drm_Uninitialize(DRM_APP_CONTEXT* f_poAppContext)
+{
+    AppState* state = State(f_poAppContext);
+    if (state != nullptr) {
+        delete state;
+        f_poAppContext->pvInternal = nullptr;
+    }
+}
+
+DRM_RESULT Drm_Reinitialize(DRM_APP_CONTEXT* f_poAppContext)
+{
+    AppState* state = State(f_poAppContext);
+    if (state == nullptr) {
+        return DRM_E_INVALIDARG;
+    }
+    state->headerSet = false;
+    state->keyIdSelected = false;
+    state->headerKeyIds.clear();
+    if ((state->store.Load() == false) && (state->store.Save() == false)) {
+        return DRM_E_FILENOTFOUND;
+    }
+    return DRM_SUCCESS;
+}
+
+DRM_RESULT Drm_ResizeOpaqueBuffer(DRM_APP_CONTEXT* f_poAppContext, DRM_BYTE* f_pbOpaqueBuffer, DRM_DWORD f_cbOpaqueBuffer)
+{
+    AppState* state = State(f_poAppContext);
+    if ((state == nullptr) || (f_pbOpaqueBuffer == nullptr) || (f_cbOpaqueBuffer < state->opaqueBufferSize)) {
+        return DRM_E_INVALIDARG;
+    }
+    memcpy(f_pbOpaqueBuffer, state->opaqueBuffer, std::min<DRM_DWORD>(state->opaqueBufferSize, 64));
+    state->opaqueBuffer = f_pbOpaqueBuffer;
+    state->opaqueBufferSize = f_cbOpaqueBuffer;
+    Stats().opaqueBufferResizes++;
+    return DRM_SUCCESS;
+}
+
+DRM_RESULT Drm_ResizeInMemoryLicenseStore(DRM_APP_CONTEXT* f_poAppContext, DRM_DWORD f_cbLicenseStore)
+{
+    AppState* state = State(f_poAppContext);
+    if (state == nullptr) {
+        return DRM_E_INVALIDARG;
+    }
+    state->inMemoryCapacity = f_cbLicenseStore;
+    return DRM_SUCCESS;
+}
+
+// Content
+DRM_RESULT Drm_Content_SetProperty(DRM_APP_CONTEXT* f_poAppContext, DRM_CONTENT_SET_PROPERTY f_eProperty,
+    const DRM_BYTE* f_pbPropertyData, DRM_DWORD f_cbPropertyData)
+{
+    FakePlayReady::TraceScope trace(__FUNCTION__);
+    AppState* state = State(f_poAppContext);
+    if ((state == nullptr) || (f_pbPropertyData == nullptr) || (f_cbPropertyData == 0)) {
+        return DRM_E_INVALIDARG;
+    }
+
+    switch (f_eProperty) {
+    case DRM_CSP_AUTODETECT_HEADER: {
+        std::vector<KeyId> keyIds = HeaderKeyIds(f_pbPropertyData, f_cbPropertyData);
+        if (keyIds.empty()) {
+            return DRM_E_INVALIDARG;
+        }
+        state->headerKeyIds.swap(keyIds);
+        state->headerSet = true;
+        state->keyIdSelected = false;
+        return DRM_SUCCESS;
+    }
+    case DRM_CSP_SELECT_KID: {
+        const std::string encoded = Narrow(reinterpret_cast<const DRM_WCHAR*>(f_pbPropertyData), f_cbPropertyData / sizeof(DRM_WCHAR));
+        std::vector<uint8_t> decoded;
+        if ((Base64Decode(encoded, decoded) == false) || (decoded.size() != 16)) {
+            return DRM_E_INVALIDARG;
+        }
+        std::copy(decoded.begin(), decoded.end(), state->selectedKeyId.begin());
+        state->keyIdSelected = true;
+        return DRM_SUCCESS;
+    }
+    case DRM_CSP_DECRYPTION_OUTPUT_MODE:
+        if (f_cbPropertyData != sizeof(DRM_DWORD)) {
+            return DRM_E_INVALIDARG;
+        }
+        memcpy(&state->decryptionMode, f_pbPropertyData, sizeof(DRM_DWORD));
+        return DRM_SUCCESS;
+    default:
+        return DRM_E_NOTIMPL;
+    }
+}
+
+// License acquisition
+DRM_RESULT Drm_LicenseAcq_GenerateChallenge(DRM_APP_CONTEXT* f_poAppContext, const DRM_CONST_STRING**, DRM_DWORD,
+    const DRM_DOMAIN_ID*, const DRM_CHAR* f_pchCustomData, DRM_DWORD f_cchCustomData, DRM_CHAR* f_pchSilentURL,
+    DRM_DWORD* f_pcchSilentURL, DRM_CHAR*, DRM_DWORD*, DRM_BYTE* f_pbChallenge, DRM_DWORD* f_pcbChallenge, DRM_ID*)
+{
+    FakePlayReady::TraceScope trace(__FUNCTION__);
+    AppState* state = State(f_poAppContext);
+    if ((state == nullptr) || (f_pcbChallenge == nullptr)) {
+        return DRM_E_INVALIDARG;
+    }
+    if (state->headerSet == false) {
+        return DRM_E_HEADER_NOT_SET;
+    }
+
+    // Both the sizing and the filling call build and sign the full challenge.
+    SleepMicroseconds(CurrentSettings().teeLatencyUs);
+
+    DRM_ID nonce;
+    RandomId(nonce);
+    const std::string challenge = LicenseChallenge(*state, nonce, f_pchCustomData, f_cchCustomData);
+    const DRM_DWORD cchSilentURL = sizeof(SilentUrl) - 1;
+
+    bool tooSmall = (f_pbChallenge == nullptr) || (*f_pcbChallenge < challenge.size());
+    if (f_pcchSilentURL != nullptr) {
+        tooSmall = tooSmall || (f_pchSilentURL == nullptr) || (*f_pcchSilentURL < cchSilentURL);
+        *f_pcchSilentURL = cchSilentURL;
+    }
+    *f_pcbChallenge = static_cast<DRM_DWORD>(challenge.size());
+    if (tooSmall) {
+        Stats().challengeSizingCalls++;
+        return DRM_E_BUFFERTOOSMALL;
+    }
+
+    memcpy(f_pbChallenge, challenge.data(), challenge.size());
+    if (f_pchSilentURL != nullptr) {
+        memcpy(f_pchSilentURL, SilentUrl, cchSilentURL);
+    }
+
+    state->nonces.push_back(nonce);
+    if (state->nonces.size() > NonceStoreSize) {
+        state->nonces.pop_front();
+        Stats().nonceEvictions++;
+    }
+    Stats().licenseChallenges++;
+    return DRM_SUCCESS;
+}
+
+DRM_RESULT Drm_LicenseAcq_ProcessResponse(DRM_APP_CONTEXT* f_poAppContext, DRM_PROCESS_LIC_RESPONSE_FLAG,
+    const DRM_BYTE* f_pbResponse, DRM_DWORD f_cbResponse, DRM_LICENSE_RESPONSE* f_poLicenseResponse)
+{
+    FakePlayReady::TraceScope trace(__FUNCTION__);
+    AppState* state = State(f_poAppContext);
+    if ((state == nullptr) || (f_pbResponse == nullptr) || (f_poLicenseResponse == nullptr)) {
+        return DRM_E_INVALIDARG;
+    }
+    if ((f_cbResponse < LicenseHeaderSize) || (memcmp(f_pbResponse, LicenseMagic, 4) != 0)) {
+        return DRM_E_INVALIDARG;
+    }
+
+    const bool persistent = (f_pbResponse[5] & LicenseFlagPersistent) != 0;
+    const DRM_DWORD count = ReadLittleEndian32(&f_pbResponse[8]);
+    if (f_cbResponse < LicenseHeaderSize + count * LicenseEntrySize) {
+        return DRM_E_INVALIDARG;
+    }
+
+    DRM_LICENSE_ACK* acks = (f_poLicenseResponse->m_pAcks != nullptr) ? f_poLicenseResponse->m_pAcks : f_poLicenseResponse->m_rgoAcks;
+    const DRM_DWORD maxAcks = (f_poLicenseResponse->m_pAcks != nullptr) ? f_poLicenseResponse->m_cMaxAcks : DRM_MAX_LICENSE_ACK;
+    if (count > maxAcks) {
+        f_poLicenseResponse->m_cAcks = count;
+        return DRM_E_LICACQ_TOO_MANY_LICENSES;
+    }
+
+    // Licenses answering a challenge must find their nonce in the nonce store.
+    DRM_RESULT nonceResult = DRM_SUCCESS;
+    DRM_ID nonce;
+    static const DRM_ID noNonce = { { 0 } };
+    memcpy(nonce.rgb, &f_pbResponse[12], sizeof(nonce.rgb));
+    if (memcmp(nonce.rgb, noNonce.rgb, sizeof(nonce.rgb)) != 0) {
+        std::deque<DRM_ID>::iterator index = state->nonces.begin();
+        while ((index != state->nonces.end()) && (memcmp(index->rgb, nonce.rgb, sizeof(nonce.rgb)) != 0)) {
+            ++index;
+        }
+        if (index == state->nonces.end()) {
+            nonceResult = DRM_E_NONCE_STORE_TOKEN_NOT_FOUND;
+        } else {
+            state->nonces.erase(index);
+        }
+    }
+
+    f_poLicenseResponse->m_eType = eV3Protocol;
+    f_poLicenseResponse->m_dwResult = DRM_SUCCESS;
+    f_poLicenseResponse->m_cAcks = count;
+    RandomId(f_poLicenseResponse->m_oBatchID);
+
+    const DRM_BYTE* entry = f_pbResponse + LicenseHeaderSize;
+    for (DRM_DWORD i = 0; i < count; ++i, entry += LicenseEntrySize) {
+        License license;
+        std::copy(entry, entry + 16, license.keyId.begin());
+        memcpy(license.key, entry + 16, sizeof(license.key));
+        license.expiry = ReadLittleEndian64(entry + 32);
+        license.batchId = f_poLicenseResponse->m_oBatchID;
+        license.persistent = persistent;
+        RandomId(license.licenseId);
+
+        DRM_LICENSE_ACK& ack = acks[i];
+        std::copy(license.keyId.begin(), license.keyId.end(), ack.m_oKID.rgb);
+        ack.m_oLID = license.licenseId;
+        ack.m_dwResult = nonceResult;
+        ack.m_dwFlags = 0;
+        if (DRM_FAILED(nonceResult)) {
+            continue;
+        }
+
+        if (persistent) {
+            std::vector<License>& licenses = state->store.licenses;
+            for (std::vector<License>::iterator it = licenses.begin(); it != licenses.end();) {
+                it = (it->keyId == license.keyId) ? licenses.erase(it) : it + 1;
+            }
+            licenses.push_back(license);
+            state->dirty = true;
+        } else {
+            state->inMemory.push_back(license);
+            while (state->inMemory.size() * InMemoryLicenseBytes > state->inMemoryCapacity) {
+                state->inMemoryCapacity = std::max<DRM_DWORD>(state->inMemoryCapacity * 2, InMemoryLicenseBytes);
+                Stats().inMemoryStoreGrowths++;
+            }
+        }
+    }
+
+    // One secure stop session per license response.
+    if (persistent == false) {
+        state->store.secureStops.push_back(f_poLicenseResponse->m_oBatchID);
+        state->dirty = true;
+    }
+
+    Stats().licenseResponses++;
+    return DRM_SUCCESS;
+}
+
+// Reader
+DRM_RESULT Drm_Reader_Bind(DRM_APP_CONTEXT* f_poAppContext, const DRM_CONST_STRING**, DRM_DWORD,
+    DRMPFNPOLICYCALLBACK f_pfnPolicyCallback, const DRM_VOID* f_pv, DRM_DECRYPT_CONTEXT* f_pcontextDCRY)
+{
+    FakePlayReady::TraceScope trace(__FUNCTION__);
+    AppState* state = State(f_poAppContext);
+    if ((state == nullptr) || (f_pcontextDCRY == nullptr)) {
+        return DRM_E_INVALIDARG;
+    }
+    if (state->headerSet == false) {
+        return DRM_E_HEADER_NOT_SET;
+    }
+
+    // The working set in the opaque buffer grows with the number of licenses.
+    const DRM_DWORD licenses = static_cast<DRM_DWORD>(state->inMemory.size() + state->store.licenses.size());
+    const DRM_DWORD required = MINIMUM_APPCONTEXT_OPAQUE_BUFFER_SIZE
+        + ((licenses > LicensesPerOpaqueBuffer) ? (licenses - LicensesPerOpaqueBuffer) * 1024 : 0);
+    if (state->opaqueBufferSize < required) {
+        return DRM_E_BUFFERTOOSMALL;
+    }
+
+    const License* license = nullptr;
+    if (state->keyIdSelected) {
+        license = state->Find(state->selectedKeyId);
+    } else {
+        for (size_t i = 0; (i < state->headerKeyIds.size()) && (license == nullptr); ++i) {
+            license = state->Find(state->headerKeyIds[i]);
+        }
+    }
+    if (license == nullptr) {
+        return DRM_E_LICENSE_NOT_FOUND;
+    }
+    if ((license->expiry != 0) && (license->expiry < static_cast<uint64_t>(time(nullptr)))) {
+        return DRM_E_LICENSE_EXPIRED;
+    }
+
+    SleepMicroseconds(CurrentSettings().teeLatencyUs);
+
+    if (f_pfnPolicyCallback != nullptr) {
+        AnnounceOutputProtection(f_pfnPolicyCallback, f_pv, *license);
+    }
+
+    DecryptState* decryptState = static_cast<DecryptState*>(f_pcontextDCRY->pvInternal);
+    if (decryptState == nullptr) {
+        decryptState = new DecryptState;
+        decryptState->cipher = EVP_CIPHER_CTX_new();
+        f_pcontextDCRY->pvInternal = decryptState;
+        Stats().openDecryptContexts++;
+    }
+    decryptState->keyId = license->keyId;
+    memcpy(decryptState->key, license->key, sizeof(decryptState->key));
+    state->boundKeyId = license->keyId;
+    state->keyIdBound = true;
+    state->dirty = true;
+
+    Stats().binds++;
+    return DRM_SUCCESS;
+}
+
+DRM_RESULT Drm_Reader_Commit(DRM_APP_CONTEXT* f_poAppContext, DRMPFNPOLICYCALLBACK f_pfnPolicyCallback, const DRM_VOID* f_pv)
+{
+    FakePlayReady::TraceScope trace(__FUNCTION__);
+    AppState* state = State(f_poAppContext);
+    if (state == nullptr) {
+        return DRM_E_INVALIDARG;
+    }
+    if ((f_pfnPolicyCallback != nullptr) && (state->keyIdBound)) {
+        const License* license = state->Find(state->boundKeyId);
+        if (license != nullptr) {
+            AnnounceOutputProtection(f_pfnPolicyCallback, f_pv, *license);
+        }
+    }
+    if (state->dirty) {
+        state->store.Save();
+        state->dirty = false;
+    }
+    Stats().commits++;
+    return DRM_SUCCESS;
+}
+
+DRM_VOID Drm_Reader_Close(DRM_DECRYPT_CONTEXT* f_pDecryptContext)
+{
+    if ((f_pDecryptContext != nullptr) && (f_pDecryptContext->pvInternal != nullptr)) {
+        DecryptState* decryptState = static_cast<DecryptState*>(f_pDecryptContext->pvInternal);
+        EVP_CIPHER_CTX_free(decryptState->cipher);
+        delete decryptState;
+        f_pDecryptContext->pvInternal = nullptr;
+        Stats().openDecryptContexts--;
+    }
+}
+
+DRM_RESULT Drm_Reader_DecryptOpaque(DRM_DECRYPT_CONTEXT* f_pDecryptContext, DRM_DWORD f_cEncryptedRegionMappings,
+    const DRM_DWORD* f_pdwEncryptedRegionMappings, DRM_UINT64 f_ui64Initializer, DRM_DWORD f_cbEncryptedContent,
+    const DRM_BYTE* f_pbEncryptedContent, DRM_DWORD* f_pcbOpaqueClearContent, DRM_BYTE** f_ppbOpaqueClearContent)
+{
+    FakePlayReady::TraceScope trace(__FUNCTION__);
+    if ((f_pDecryptContext == nullptr) || (f_pDecryptContext->pvInternal == nullptr)) {
+        return DRM_E_DECRYPT_NOT_INITIALIZED;
+    }
+    if ((f_pbEncryptedContent == nullptr) || (f_ppbOpaqueClearContent == nullptr) || (*f_ppbOpaqueClearContent == nullptr)
+        || ((f_cEncryptedRegionMappings % 2) != 0) || ((f_cEncryptedRegionMappings > 0) && (f_pdwEncryptedRegionMappings == nullptr))) {
+        return DRM_E_INVALIDARG;
+    }
+
+    DecryptState* decryptState = static_cast<DecryptState*>(f_pDecryptContext->pvInternal);
+    uint8_t counter[16] = { 0 };
+    for (int i = 0; i < 8; ++i) {
+        counter[i] = static_cast<uint8_t>(f_ui64Initializer >> (56 - 8 * i));
+    }
+    EVP_EncryptInit_ex(decryptState->cipher, EVP_aes_128_ctr(), nullptr, decryptState->key, counter);
+
+    DRM_BYTE* output = *f_ppbOpaqueClearContent;
+    DRM_DWORD offset = 0;
+    int produced = 0;
+    for (DRM_DWORD i = 0; i < f_cEncryptedRegionMappings; i += 2) {
+        const DRM_DWORD clear = f_pdwEncryptedRegionMappings[i];
+        const DRM_DWORD encrypted = f_pdwEncryptedRegionMappings[i + 1];
+        if ((offset + clear + encrypted) > f_cbEncryptedContent) {
+            return DRM_E_INVALIDARG;
+        }
+        memcpy(output + offset, f_pbEncryptedContent + offset, clear);
+        offset += clear;
+        if (encrypted > 0) {
+            EVP_EncryptUpdate(decryptState->cipher, output + offset, &produced, f_pbEncryptedContent + offset, static_cast<int>(encrypted));
+        }
+        offset += encrypted;
+    }
+    memcpy(output + offset, f_pbEncryptedContent + offset, f_cbEncryptedContent - offset);
+
+    if (f_pcbOpaqueClearContent != nullptr) {
+        *f_pcbOpaqueClearContent = f_cbEncryptedContent;
+    }
+    Stats().decrypts++;
+    return DRM_SUCCESS;
+}
+
+// Store management
+DRM_RESULT Drm_StoreMgmt_CleanupStore(DRM_APP_CONTEXT* f_poAppContext, DRM_DWORD f_dwFlags, const DRM_VOID* f_pvCallerData,
+    DRM_DWORD f_dwCallbackInterval, DRM_STORE_CLEANUP_CALLBACK f_pfnCallback)
+{
+    AppState* state = State(f_poAppContext);
+    if (state == nullptr) {
+        return DRM_E_INVALIDARG;
+    }
+
+    DRM_RESULT dr = DRM_SUCCESS;
+    std::vector<License>& licenses = state->store.licenses;
+    const DRM_DWORD total = static_cast<DRM_DWORD>(licenses.size());
+    const uint64_t now = static_cast<uint64_t>(time(nullptr));
+    DRM_DWORD visited = 0;
+    for (std::vector<License>::iterator it = licenses.begin(); it != licenses.end(); ++visited) {
+        const bool expired = (f_dwFlags & DRM_STORE_CLEANUP_DELETE_EXPIRED_LICENSES) && (it->expiry != 0) && (it->expiry < now);
+        it = expired ? licenses.erase(it) : it + 1;
+        SleepMicroseconds(CurrentSettings().storeCommitLatencyUs / 16);
+
+        if ((f_pfnCallback != nullptr) && (f_dwCallbackInterval > 0) && (((visited + 1) % f_dwCallbackInterval) == 0)) {
+            dr = f_pfnCallback(f_pvCallerData, visited + 1, total);
+            if (DRM_FAILED(dr)) {
+                break;
+            }
+        }
+    }
+    state->store.Save();
+    return dr;
+}
+
+DRM_RESULT Drm_StoreMgmt_DeleteInMemoryLicenses(DRM_APP_CONTEXT* f_poAppContext, const DRM_ID* f_pidBatch)
+{
+    AppState* state = State(f_poAppContext);
+    if ((state == nullptr) || (f_pidBatch == nullptr)) {
+        return DRM_E_INVALIDARG;
+    }
+
+    size_t deleted = 0;
+    std::vector<License>& licenses = state->inMemory;
+    for (std::vector<License>::iterator it = licenses.begin(); it != licenses.end();) {
+        if (memcmp(it->batchId.rgb, f_pidBatch->rgb, sizeof(f_pidBatch->rgb)) == 0) {
+            it = licenses.erase(it);
+            deleted++;
+        } else {
+            ++it;
+        }
+    }
+    return (deleted > 0) ? DRM_SUCCESS : DRM_E_NOMORE;
+}
+
+DRM_RESULT Drm_StoreMgmt_DeleteLicenses(DRM_APP_CONTEXT* f_poAppContext, const DRM_CONST_STRING* f_pdcstrKID,
+    DRM_DWORD* f_pcLicDeleted)
+{
+    AppState* state = State(f_poAppContext);
+    if (state == nullptr) {
+        return DRM_E_INVALIDARG;
+    }
+
+    std::vector<KeyId> keyIds;
+    if (f_pdcstrKID != nullptr) {
+        std::vector<uint8_t> decoded;
+        if ((Base64Decode(Narrow(f_pdcstrKID->pwszString, f_pdcstrKID->cchString), decoded) == false) || (decoded.size() != 16)) {
+            return DRM_E_INVALIDARG;
+        }
+        KeyId keyId;
+        std::copy(decoded.begin(), decoded.end(), keyId.begin());
+        keyIds.push_back(keyId);
+    } else if (state->headerSet) {
+        keyIds = state->headerKeyIds;
+    } else {
+        return DRM_E_HEADER_NOT_SET;
+    }
+
+    DRM_DWORD deleted = 0;
+    std::vector<License>& licenses = state->store.licenses;
+    for (std::vector<License>::iterator it = licenses.begin(); it != licenses.end();) {
+        if (std::find(keyIds.begin(), keyIds.end(), it->keyId) != keyIds.end()) {
+            it = licenses.erase(it);
+            deleted++;
+        } else {
+            ++it;
+        }
+    }
+    if (deleted > 0) {
+        state->store.Save();
+    }
+    if (f_pcLicDeleted != nullptr) {
+        *f_pcLicDeleted = deleted;
+    }
+    return DRM_SUCCESS;
+}
+
+// Revocation
+DRM_BOOL DRM_REVOCATION_IsRevocationSupported(DRM_VOID)
+{
+    return TRUE;
+}
+
+DRM_RESULT Drm_Revocation_SetBuffer(DRM_APP_CONTEXT* f_poAppContext, DRM_BYTE* f_pbRevocationBuffer, DRM_DWORD f_cbRevocationBuffer)
+{
+    AppState* state = State(f_poAppContext);
+    if ((state == nullptr) || (f_pbRevocationBuffer == nullptr) || (f_cbRevocationBuffer == 0)) {
+        return DRM_E_INVALIDARG;
+    }
+    state->revocationBuffer = f_pbRevocationBuffer;
+    return DRM_SUCCESS;
+}
+
+DRM_RESULT Drm_Revocation_StorePackage(DRM_APP_CONTEXT* f_poAppContext, const DRM_CHAR* f_pbRevPackage, DRM_DWORD f_cbRevPackage)
+{
+    AppState* state = State(f_poAppContext);
+    if ((state == nullptr) || (state->revocationBuffer == nullptr) || (f_pbRevPackage == nullptr) || (f_cbRevPackage == 0)) {
+        return DRM_E_INVALIDARG;
+    }
+    // Verifying the package signature is the expensive part on a real device.
+    SleepMicroseconds(CurrentSettings().teeLatencyUs);
+    state->store.Save();
+    Stats().revocationPackagesStored++;
+    return DRM_SUCCESS;
+}
+
+// Secure time
+DRM_RESULT Drm_SecureTime_GetValue(DRM_APP_CONTEXT* f_poAppContext, DRMFILETIME* f_pftSystemTime,
+    DRM_SECURETIME_CLOCK_TYPE* f_peClockType)
+{
+    AppState* state = State(f_poAppContext);
+    if ((state == nullptr) || (f_pftSystemTime == nullptr) || (f_peClockType == nullptr)) {
+        return DRM_E_INVALIDARG;
+    }
+    if ((state->store.secureTimeSet == false) && (CurrentSettings().secureClockPreset == false)) {
+        return DRM_E_SECURETIME_CLOCK_NOT_SET;
+    }
+
+    // 100ns intervals since 1601-01-01
+    const uint64_t fileTime = (static_cast<uint64_t>(time(nullptr)) + 11644473600ULL) * 10000000ULL;
+    f_pftSystemTime->dwLowDateTime = static_cast<DRM_DWORD>(fileTime);
+    f_pftSystemTime->dwHighDateTime = static_cast<DRM_DWORD>(fileTime >> 32);
+    *f_peClockType = DRM_SECURETIME_CLOCK_TYPE_TEE;
+    return DRM_SUCCESS;
+}
+
+DRM_RESULT Drm_SecureTime_GenerateChallenge(DRM_APP_CONTEXT* f_poAppContext, DRM_DWORD* f_pcbChallenge, DRM_BYTE** f_ppbChallenge)
+{
+    static const char challenge[] = "<SecureTimeChallenge><Device>fake</Device></SecureTimeChallenge>";
+    if ((State(f_poAppContext) == nullptr) || (f_pcbChallenge == nullptr) || (f_ppbChallenge == nullptr)) {
+        return DRM_E_INVALIDARG;
+    }
+    SleepMicroseconds(CurrentSettings().teeLatencyUs);
+    *f_ppbChallenge = static_cast<DRM_BYTE*>(Oem_MemAlloc(sizeof(challenge)));
+    if (*f_ppbChallenge == nullptr) {
+        return DRM_E_OUTOFMEMORY;
+    }
+    memcpy(*f_ppbChallenge, challenge, sizeof(challenge));
+    *f_pcbChallenge = sizeof(challenge) - 1;
+    return DRM_SUCCESS;
+}
+
+DRM_RESULT Drm_SecureTime_ProcessResponse(DRM_APP_CONTEXT* f_poAppContext, DRM_DWORD f_cbResponse, const DRM_BYTE* f_pbResponse)
+{
+    AppState* state = State(f_poAppContext);
+    const size_t prefixLength = sizeof(SecureTimeResponsePrefix) - 1;
+    if ((state == nullptr) || (f_pbResponse == nullptr)) {
+        return DRM_E_INVALIDARG;
+    }
+    if ((f_cbResponse < prefixLength) || (memcmp(f_pbResponse, SecureTimeResponsePrefix, prefixLength) != 0)) {
+        return DRM_E_INVALIDARG;
+    }
+    state->store.secureTimeSet = true;
+    state->store.Save();
+    return DRM_SUCCESS;
+}
+
+DRM_RESULT Drm_AntiRollBackClock_Init(DRM_APP_CONTEXT* f_poAppContext, const DRMSYSTEMTIME* f_pSystemTime)
+{
+    return ((State(f_poAppContext) != nullptr) && (f_pSystemTime != nullptr)) ? DRM_SUCCESS : DRM_E_INVALIDARG;
+}
+
+// Secure stop
+DRM_RESULT Drm_SecureStop_EnumerateSessions(DRM_APP_CONTEXT* f_poAppContext, DRM_DWORD, const DRM_BYTE*,
+    DRM_DWORD* f_pcSessionIDs, DRM_ID** f_ppSessionIDs)
+{
+    AppState* state = State(f_poAppContext);
+    if ((state == nullptr) || (f_pcSessionIDs == nullptr) || (f_ppSessionIDs == nullptr)) {
+        return DRM_E_INVALIDARG;
+    }
+
+    // Enumeration walks the store on disk, like the real implementation.
+    if (state->dirty == false) {
+        state->store.Load();
+    }
+
+    const std::vector<DRM_ID>& sessions = state->store.secureStops;
+    *f_pcSessionIDs = static_cast<DRM_DWORD>(sessions.size());
+    *f_ppSessionIDs = nullptr;
+    if (sessions.empty()) {
+        return DRM_E_NOMORE;
+    }
+    *f_ppSessionIDs = static_cast<DRM_ID*>(Oem_MemAlloc(static_cast<DRM_DWORD>(sessions.size() * sizeof(DRM_ID))));
+    if (*f_ppSessionIDs == nullptr) {
+        return DRM_E_OUTOFMEMORY;
+    }
+    std::copy(sessions.begin(), sessions.end(), *f_ppSessionIDs);
+    return DRM_SUCCESS;
+}
+
+DRM_RESULT Drm_SecureStop_GenerateChallenge(DRM_APP_CONTEXT* f_poAppContext, const DRM_ID* f_pidSession, DRM_DWORD,
+    const DRM_BYTE*, DRM_DWORD f_cchCustomData, const DRM_CHAR* f_pchCustomData, DRM_DWORD* f_pcbChallenge, DRM_BYTE** f_ppbChallenge)
+{
+    AppState* state = State(f_poAppContext);
+    if ((state == nullptr) || (f_pidSession == nullptr) || (f_pcbChallenge == nullptr) || (f_ppbChallenge == nullptr)) {
+        return DRM_E_INVALIDARG;
+    }
+
+    const std::vector<DRM_ID>& sessions = state->store.secureStops;
+    bool found = false;
+    for (size_t i = 0; (i < sessions.size()) && (found == false); ++i) {
+        found = (memcmp(sessions[i].rgb, f_pidSession->rgb, sizeof(f_pidSession->rgb)) == 0);
+    }
+    if (found == false) {
+        return DRM_E_SECURESTOP_SESSION_NOT_FOUND;
+    }
+
+    SleepMicroseconds(CurrentSettings().teeLatencyUs);
+
+    std::string challenge = "<SecureStopChallenge><SessionID>" + Base64Encode(f_pidSession->rgb, sizeof(f_pidSession->rgb)) + "</SessionID>";
+    if ((f_pchCustomData != nullptr) && (f_cchCustomData > 0)) {
+        challenge += "<CustomData>" + std::string(f_pchCustomData, f_cchCustomData) + "</CustomData>";
+    }
+    challenge += "<Signature>" + std::string(512, 'S') + "</Signature></SecureStopChallenge>";
+
+    *f_ppbChallenge = static_cast<DRM_BYTE*>(Oem_MemAlloc(static_cast<DRM_DWORD>(challenge.size())));
+    if (*f_ppbChallenge == nullptr) {
+        return DRM_E_OUTOFMEMORY;
+    }
+    memcpy(*f_ppbChallenge, challenge.data(), challenge.size());
+    *f_pcbChallenge = static_cast<DRM_DWORD>(challenge.size());
+    Stats().secureStopChallenges++;
+    return DRM_SUCCESS;
+}
+
+DRM_RESULT Drm_SecureStop_ProcessResponse(DRM_APP_CONTEXT* f_poAppContext, const DRM_ID* f_pidSession, DRM_DWORD,
+    const DRM_BYTE*, DRM_DWORD f_cbResponse, const DRM_BYTE* f_pbResponse, DRM_DWORD* f_pcbCustomData, DRM_CHAR** f_ppchCustomData)
+{
+    AppState* state = State(f_poAppContext);
+    if ((state == nullptr) || (f_pidSession == nullptr) || (f_pbResponse == nullptr)) {
+        return DRM_E_INVALIDARG;
+    }
+
+    const std::string expected = std::string(SecureStopAckPrefix) + Base64Encode(f_pidSession->rgb, sizeof(f_pidSession->rgb));
+    if ((f_cbResponse != expected.size()) || (memcmp(f_pbResponse, expected.data(), expected.size()) != 0)) {
+        return DRM_E_INVALIDARG;
+    }
+
+    std::vector<DRM_ID>& sessions = state->store.secureStops;
+    for (std::vector<DRM_ID>::iterator it = sessions.begin(); it != sessions.end(); ++it) {
+        if (memcmp(it->rgb, f_pidSession->rgb, sizeof(f_pidSession->rgb)) == 0) {
+            sessions.erase(it);
+            state->store.Save();
+            if (f_pcbCustomData != nullptr) {
+                *f_pcbCustomData = 0;
+            }
+            if (f_ppchCustomData != nullptr) {
+                *f_ppchCustomData = nullptr;
+            }
+            return DRM_SUCCESS;
+        }
+    }
+    return DRM_E_SECURESTOP_SESSION_NOT_FOUND;
+}
@@ -0,0 +1,79 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FakeInternal.h"
+#include "prdy_http.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+using namespace FakePlayReady;
+
+// The output buffers are allocated by the caller (MAX_URL_LENGTH and
+// MAX_TIME_CHALLENGE_RESPONSE_LENGTH in the plugin); the fake never writes
+// more than a few hundred bytes into them.
+
+static const char SecureTimeUrl[] = "http://localhost/fake-securetime/challenge";
+
+int32_t PRDY_HTTP_Client_GetForwardLinkUrl(char* pUrl, uint32_t* pHttpRespCode, char** ppOutUrl)
+{
+    if ((pUrl == nullptr) || (pHttpRespCode == nullptr) || (ppOutUrl == nullptr) || (*ppOutUrl == nullptr)) {
+        return -1;
+    }
+    SleepMicroseconds(static_cast<uint64_t>(CurrentSettings().timeServerLatencyMs) * 1000);
+    if (TakeTimeServerFailure() != 0) {
+        return -1;
+    }
+    // The forward link always redirects once.
+    strcpy(*ppOutUrl, SecureTimeUrl);
+    *pHttpRespCode = 302;
+    return 0;
+}
+
+int32_t PRDY_HTTP_Client_GetSecureTimeUrl(char* pUrl, uint32_t* pHttpRespCode, char** ppOutUrl)
+{
+    if ((pUrl == nullptr) || (pHttpRespCode == nullptr) || (ppOutUrl == nullptr) || (*ppOutUrl == nullptr)) {
+        return -1;
+    }
+    SleepMicroseconds(static_cast<uint64_t>(CurrentSettings().timeServerLatencyMs) * 1000);
+    strcpy(*ppOutUrl, pUrl);
+    *pHttpRespCode = 200;
+    return 0;
+}
+
+uint32_t PRDY_HTTP_Client_SecureTimeChallengePost(char* pUrl, char* pChallenge, unsigned char, uint32_t,
+    unsigned char** ppResponse, uint32_t* pStartOffset, uint32_t* pLength)
+{
+    if ((pUrl == nullptr) || (pChallenge == nullptr) || (ppResponse == nullptr) || (*ppResponse == nullptr)
+        || (pStartOffset == nullptr) || (pLength == nullptr)) {
+        return 1;
+    }
+    SleepMicroseconds(static_cast<uint64_t>(CurrentSettings().timeServerLatencyMs) * 1000);
+    Stats().secureTimeRequests++;
+    if (TakeTimeServerFailure() != 0) {
+        return 1;
+    }
+
+    const int length = snprintf(reinterpret_cast<char*>(*ppResponse), 64, "%s%lld", SecureTimeResponsePrefix,
+        static_cast<long long>(time(nullptr)));
+    *pStartOffset = 0;
+    *pLength = static_cast<uint32_t>(length);
+    return 0;
+}
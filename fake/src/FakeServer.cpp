@@ -0,0 +1,527 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FakeInternal.h"
+
+#include <openssl/evp.h>
+#include <openssl/sha.h>
+
+#include <stdlib.h>
+#include <algorithm>
+#include <time.h>
+#include <mutex>
+#include <thread>
+#include <chrono>
+
+namespace FakePlayReady {
+
+namespace {
+
+static const uint8_t PlayReadySystemId[] = {
+    0x9A, 0x04, 0xF0, 0x79, 0x98, 0x40, 0x42, 0x86,
+    0xAB, 0x92, 0xE6, 0x5B, 0xE0, 0x88, 0x5F, 0x95,
+};
+
+uint32_t EnvironmentValue(const char* name, uint32_t defaultValue)
+{
+    const char* value = getenv(name);
+    return (value != nullptr) ? static_cast<uint32_t>(strtoul(value, nullptr, 10)) : defaultValue;
+}
+
+struct SettingsState {
+    std::mutex lock;
+    Settings settings;
+    uint32_t timeServerFailures;
+
+    SettingsState()
+        : lock()
+        , settings()
+        , timeServerFailures(EnvironmentValue("FAKE_PLAYREADY_TIME_FAILURES", 0))
+    {
+        settings.teeLatencyUs = EnvironmentValue("FAKE_PLAYREADY_TEE_LATENCY_US", 0);
+        settings.storeCommitLatencyUs = EnvironmentValue("FAKE_PLAYREADY_STORE_LATENCY_US", 0);
+        settings.licenseServerLatencyMs = EnvironmentValue("FAKE_PLAYREADY_LICENSE_LATENCY_MS", 0);
+        settings.timeServerLatencyMs = EnvironmentValue("FAKE_PLAYREADY_TIME_LATENCY_MS", 0);
+        settings.platformLatencyMs = EnvironmentValue("FAKE_PLAYREADY_PLATFORM_LATENCY_MS", 0);
+        settings.secureClockPreset = (EnvironmentValue("FAKE_PLAYREADY_SECURE_CLOCK_SET", 1) != 0);
+    }
+};
+
+SettingsState& Config()
+{
+    static SettingsState configuration;
+    return configuration;
+}
+
+void AppendBigEndian32(std::vector<uint8_t>& out, uint32_t value)
+{
+    out.push_back(static_cast<uint8_t>(value >> 24));
+    out.push_back(static_cast<uint8_t>(value >> 16));
+    out.push_back(static_cast<uint8_t>(value >> 8));
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+void AppendLittleEndian(std::vector<uint8_t>& out, uint64_t value, size_t bytes)
+{
+    for (size_t i = 0; i < bytes; ++i) {
+        out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+}
+
+} // namespace
+
+Counters& Stats()
+{
+    static Counters counters;
+    return counters;
+}
+
+namespace {
+
+struct TraceState {
+    TraceState()
+        : enabled(false)
+        , lock()
+        , events()
+    {
+    }
+
+    std::atomic<bool> enabled;
+    std::mutex lock;
+    std::vector<TraceEvent> events;
+};
+
+TraceState& Trace()
+{
+    static TraceState state;
+    return state;
+}
+
+uint64_t MonotonicNs()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (static_cast<uint64_t>(now.tv_sec) * 1000000000ULL) + now.tv_nsec;
+}
+
+} // namespace
+
+TraceScope::TraceScope(const char* function)
+    : _function(function)
+    , _begin(Trace().enabled ? MonotonicNs() : 0)
+{
+}
+
+TraceScope::~TraceScope()
+{
+    if (_begin != 0) {
+        TraceEvent event;
+        event.function = _function;
+        event.thread = std::hash<std::thread::id>()(std::this_thread::get_id());
+        event.begin = _begin;
+        event.end = MonotonicNs();
+
+        TraceState& state = Trace();
+        std::lock_guard<std::mutex> guard(state.lock);
+        state.events.push_back(event);
+    }
+}
+
+void EnableTrace(bool enable)
+{
+    Trace().enabled = enable;
+}
+
+std::vector<TraceEvent> TraceEvents()
+{
+    TraceState& state = Trace();
+    std::vector<TraceEvent> result;
+    std::lock_guard<std::mutex> guard(state.lock);
+    result.swap(state.events);
+    return result;
+}
+
+const Settings& CurrentSettings()
+{
+    return Config().settings;
+}
+
+uint32_t TakeTimeServerFailure()
+{
+    SettingsState& config = Config();
+    std::lock_guard<std::mutex> guard(config.lock);
+    if (config.timeServerFailures > 0) {
+        config.timeServerFailures--;
+        return 1;
+    }
+    return 0;
+}
+
+void Configure(const Settings& settings)
+{
+    SettingsState& config = Config();
+    std::lock_guard<std::mutex> guard(config.lock);
+    config.settings = settings;
+}
+
+Settings Configuration()
+{
+    return Config().settings;
+}
+
+Statistics GetStatistics()
+{
+    Counters& counters = Stats();
+    Statistics result;
+    result.licenseChallenges = counters.licenseChallenges;
+    result.challengeSizingCalls = counters.challengeSizingCalls;
+    result.licenseResponses = counters.licenseResponses;
+    result.binds = counters.binds;
+    result.commits = counters.commits;
+    result.storeWrites = counters.storeWrites;
+    result.decrypts = counters.decrypts;
+    result.nonceEvictions = counters.nonceEvictions;
+    result.opaqueBufferResizes = counters.opaqueBufferResizes;
+    result.inMemoryStoreGrowths = counters.inMemoryStoreGrowths;
+    result.secureStopChallenges = counters.secureStopChallenges;
+    result.secureTimeRequests = counters.secureTimeRequests;
+    result.revocationPackagesStored = counters.revocationPackagesStored;
+    result.openDecryptContexts = counters.openDecryptContexts;
+    return result;
+}
+
+void ResetStatistics()
+{
+    Counters& counters = Stats();
+    counters.licenseChallenges = 0;
+    counters.challengeSizingCalls = 0;
+    counters.licenseResponses = 0;
+    counters.binds = 0;
+    counters.commits = 0;
+    counters.storeWrites = 0;
+    counters.decrypts = 0;
+    counters.nonceEvictions = 0;
+    counters.opaqueBufferResizes = 0;
+    counters.inMemoryStoreGrowths = 0;
+    counters.secureStopChallenges = 0;
+    counters.secureTimeRequests = 0;
+    counters.revocationPackagesStored = 0;
+}
+
+void SleepMicroseconds(uint64_t us)
+{
+    if (us > 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(us));
+    }
+}
+
+void ToggleKeyId(uint8_t keyId[16])
+{
+    std::swap(keyId[0], keyId[3]);
+    std::swap(keyId[1], keyId[2]);
+    std::swap(keyId[4], keyId[5]);
+    std::swap(keyId[6], keyId[7]);
+}
+
+std::string Base64Encode(const uint8_t* data, size_t length)
+{
+    static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    out.reserve(((length + 2) / 3) * 4);
+    for (size_t i = 0; i < length; i += 3) {
+        uint32_t value = data[i] << 16;
+        if (i + 1 < length) {
+            value |= data[i + 1] << 8;
+        }
+        if (i + 2 < length) {
+            value |= data[i + 2];
+        }
+        out += table[(value >> 18) & 0x3F];
+        out += table[(value >> 12) & 0x3F];
+        out += (i + 1 < length) ? table[(value >> 6) & 0x3F] : '=';
+        out += (i + 2 < length) ? table[value & 0x3F] : '=';
+    }
+    return out;
+}
+
+bool Base64Decode(const std::string& text, std::vector<uint8_t>& out)
+{
+    uint32_t accumulator = 0;
+    int bits = 0;
+    out.clear();
+    for (size_t i = 0; i < text.size(); ++i) {
+        const char c = text[i];
+        int value;
+        if ((c >= 'A') && (c <= 'Z')) {
+            value = c - 'A';
+        } else if ((c >= 'a') && (c <= 'z')) {
+            value = c - 'a' + 26;
+        } else if ((c >= '0') && (c <= '9')) {
+            value = c - '0' + 52;
+        } else if (c == '+') {
+            value = 62;
+        } else if (c == '/') {
+            value = 63;
+        } else if (c == '=') {
+            break;
+        } else {
+            return false;
+        }
+        accumulator = (accumulator << 6) | value;
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            out.push_back(static_cast<uint8_t>(accumulator >> bits));
+        }
+    }
+    return true;
+}
+
+bool ExtractElement(const std::string& text, const std::string& tag, size_t& offset, std::string& value)
+{
+    const std::string open = "<" + tag + ">";
+    const std::string close = "</" + tag + ">";
+    size_t start = text.find(open, offset);
+    if (start == std::string::npos) {
+        return false;
+    }
+    start += open.size();
+    size_t end = text.find(close, start);
+    if (end == std::string::npos) {
+        return false;
+    }
+    value = text.substr(start, end - start);
+    offset = end + close.size();
+    return true;
+}
+
+std::vector<KeyId> HeaderKeyIds(const uint8_t* header, size_t size)
+{
+    std::string text;
+    text.reserve(size);
+    for (size_t i = 0; i < size; ++i) {
+        if (header[i] != 0) {
+            text += static_cast<char>(header[i]);
+        }
+    }
+
+    std::vector<KeyId> result;
+    size_t offset = 0;
+    while ((offset = text.find("<KID", offset)) != std::string::npos) {
+        std::string encoded;
+        offset += 4;
+        if (text.compare(offset, 1, ">") == 0) {
+            size_t end = text.find("</KID>", offset);
+            if (end == std::string::npos) {
+                break;
+            }
+            encoded = text.substr(offset + 1, end - offset - 1);
+        } else {
+            size_t value = text.find("VALUE=\"", offset);
+            size_t tagEnd = text.find('>', offset);
+            if ((value == std::string::npos) || (value > tagEnd)) {
+                continue;
+            }
+            value += 7;
+            size_t end = text.find('"', value);
+            if (end == std::string::npos) {
+                break;
+            }
+            encoded = text.substr(value, end - value);
+        }
+
+        std::vector<uint8_t> decoded;
+        if (Base64Decode(encoded, decoded) && (decoded.size() == 16)) {
+            KeyId keyId;
+            std::copy(decoded.begin(), decoded.end(), keyId.begin());
+            if (std::find(result.begin(), result.end(), keyId) == result.end()) {
+                result.push_back(keyId);
+            }
+        }
+    }
+    return result;
+}
+
+void ContentKey(const KeyId& keyId, uint8_t key[16])
+{
+    static const char label[] = "fake-playready-content-key";
+    uint8_t input[sizeof(label) - 1 + 16];
+    uint8_t digest[SHA256_DIGEST_LENGTH];
+    memcpy(input, label, sizeof(label) - 1);
+    memcpy(input + sizeof(label) - 1, keyId.data(), keyId.size());
+    SHA256(input, sizeof(input), digest);
+    memcpy(key, digest, 16);
+}
+
+std::vector<uint8_t> BuildHeader(const std::vector<KeyId>& keyIds)
+{
+    std::string xml = "<WRMHEADER xmlns=\"http://schemas.microsoft.com/DRM/2007/03/PlayReadyHeader\" version=\"4.3.0.0\">"
+                      "<DATA><PROTECTINFO><KIDS>";
+    for (size_t i = 0; i < keyIds.size(); ++i) {
+        uint8_t keyId[16];
+        std::copy(keyIds[i].begin(), keyIds[i].end(), keyId);
+        ToggleKeyId(keyId);
+        xml += "<KID ALGID=\"AESCTR\" VALUE=\"" + Base64Encode(keyId, sizeof(keyId)) + "\"></KID>";
+    }
+    xml += "</KIDS></PROTECTINFO><LA_URL>http://localhost/rightsmanager.asmx</LA_URL></DATA></WRMHEADER>";
+
+    // PlayReady object: length (4) | record count (2) | record type (2) | record length (2) | UTF-16LE record
+    const uint32_t recordLength = static_cast<uint32_t>(xml.size() * 2);
+    const uint32_t objectLength = recordLength + 10;
+    std::vector<uint8_t> object;
+    object.reserve(objectLength);
+    AppendLittleEndian(object, objectLength, 4);
+    AppendLittleEndian(object, 1, 2);
+    AppendLittleEndian(object, 1, 2);
+    AppendLittleEndian(object, recordLength, 2);
+    for (size_t i = 0; i < xml.size(); ++i) {
+        object.push_back(static_cast<uint8_t>(xml[i]));
+        object.push_back(0);
+    }
+    return object;
+}
+
+std::vector<uint8_t> BuildPssh(const std::vector<KeyId>& keyIds, bool version1)
+{
+    const std::vector<uint8_t> data = BuildHeader(keyIds);
+    std::vector<uint8_t> box;
+    const uint32_t size = 4 + 4 + 4 + sizeof(PlayReadySystemId) + (version1 ? 4 + 16 * keyIds.size() : 0) + 4 + data.size();
+    AppendBigEndian32(box, size);
+    box.insert(box.end(), { 'p', 's', 's', 'h' });
+    AppendBigEndian32(box, version1 ? 0x01000000 : 0);
+    box.insert(box.end(), PlayReadySystemId, PlayReadySystemId + sizeof(PlayReadySystemId));
+    if (version1) {
+        AppendBigEndian32(box, static_cast<uint32_t>(keyIds.size()));
+        for (size_t i = 0; i < keyIds.size(); ++i) {
+            box.insert(box.end(), keyIds[i].begin(), keyIds[i].end());
+        }
+    }
+    AppendBigEndian32(box, static_cast<uint32_t>(data.size()));
+    box.insert(box.end(), data.begin(), data.end());
+    return box;
+}
+
+void EncryptSample(const KeyId& keyId, uint64_t iv, const std::vector<uint32_t>& subsamples, uint8_t* data, size_t size)
+{
+    uint8_t key[16];
+    uint8_t counter[16] = { 0 };
+    ContentKey(keyId, key);
+    for (int i = 0; i < 8; ++i) {
+        counter[i] = static_cast<uint8_t>(iv >> (56 - 8 * i));
+    }
+
+    EVP_CIPHER_CTX* context = EVP_CIPHER_CTX_new();
+    EVP_EncryptInit_ex(context, EVP_aes_128_ctr(), nullptr, key, counter);
+
+    int produced = 0;
+    if (subsamples.empty()) {
+        EVP_EncryptUpdate(context, data, &produced, data, static_cast<int>(size));
+    } else {
+        size_t offset = 0;
+        for (size_t i = 0; (i + 1 < subsamples.size()) && (offset < size); i += 2) {
+            offset += subsamples[i];
+            const size_t encrypted = std::min<size_t>(subsamples[i + 1], size - std::min(offset, size));
+            if (encrypted > 0) {
+                EVP_EncryptUpdate(context, data + offset, &produced, data + offset, static_cast<int>(encrypted));
+            }
+            offset += encrypted;
+        }
+    }
+    EVP_CIPHER_CTX_free(context);
+}
+
+std::vector<KeyId> ChallengeKeyIds(const uint8_t* challenge, size_t challengeSize)
+{
+    std::vector<KeyId> result;
+    const std::string text(reinterpret_cast<const char*>(challenge), challengeSize);
+    std::string encoded;
+    size_t offset = 0;
+    while (ExtractElement(text, "KID", offset, encoded)) {
+        std::vector<uint8_t> decoded;
+        if (Base64Decode(encoded, decoded) && (decoded.size() == 16)) {
+            ToggleKeyId(decoded.data());
+            KeyId keyId;
+            std::copy(decoded.begin(), decoded.end(), keyId.begin());
+            result.push_back(keyId);
+        }
+    }
+    return result;
+}
+
+namespace {
+
+std::vector<uint8_t> BuildLicenseResponse(const std::vector<KeyId>& keyIds, const uint8_t nonce[16], bool persistent)
+{
+    std::vector<uint8_t> response;
+    response.reserve(LicenseHeaderSize + keyIds.size() * LicenseEntrySize);
+    response.insert(response.end(), LicenseMagic, LicenseMagic + 4);
+    response.push_back(1);
+    response.push_back(persistent ? LicenseFlagPersistent : 0);
+    AppendLittleEndian(response, 0, 2);
+    AppendLittleEndian(response, keyIds.size(), 4);
+    response.insert(response.end(), nonce, nonce + 16);
+    for (size_t i = 0; i < keyIds.size(); ++i) {
+        uint8_t keyId[16];
+        uint8_t key[16];
+        ContentKey(keyIds[i], key);
+        std::copy(keyIds[i].begin(), keyIds[i].end(), keyId);
+        ToggleKeyId(keyId);
+        response.insert(response.end(), keyId, keyId + 16);
+        response.insert(response.end(), key, key + 16);
+        AppendLittleEndian(response, 0, 8);
+    }
+
+    SleepMicroseconds(static_cast<uint64_t>(CurrentSettings().licenseServerLatencyMs) * 1000);
+    return response;
+}
+
+} // namespace
+
+std::vector<uint8_t> LicenseResponse(const uint8_t* challenge, size_t challengeSize, bool persistent)
+{
+    uint8_t nonce[16] = { 0 };
+    const std::string text(reinterpret_cast<const char*>(challenge), challengeSize);
+    std::string encoded;
+    size_t offset = 0;
+    if (ExtractElement(text, "Nonce", offset, encoded)) {
+        std::vector<uint8_t> decoded;
+        if (Base64Decode(encoded, decoded) && (decoded.size() == sizeof(nonce))) {
+            memcpy(nonce, decoded.data(), sizeof(nonce));
+        }
+    }
+    return BuildLicenseResponse(ChallengeKeyIds(challenge, challengeSize), nonce, persistent);
+}
+
+std::vector<uint8_t> LicenseResponse(const std::vector<KeyId>& keyIds, bool persistent)
+{
+    const uint8_t nonce[16] = { 0 };
+    return BuildLicenseResponse(keyIds, nonce, persistent);
+}
+
+std::vector<uint8_t> SecureStopResponse(const uint8_t* challenge, size_t challengeSize)
+{
+    const std::string text(reinterpret_cast<const char*>(challenge), challengeSize);
+    std::string sessionId;
+    size_t offset = 0;
+    ExtractElement(text, "SessionID", offset, sessionId);
+    const std::string ack = std::string(SecureStopAckPrefix) + sessionId;
+    return std::vector<uint8_t>(ack.begin(), ack.end());
+}
+
+} // namespace FakePlayReady